@@ -0,0 +1,600 @@
+/**
+ * Sample program that downloads the measurement log of every SL900A
+ * tag in the field and decodes it into a time series.
+ *
+ * For each tag the log setup and log state are read first, which give
+ * the logging form, the enabled sensors, the log interval and the
+ * number of stored measurements. The measurement area of user memory is
+ * then read in the largest chunks the link accepts: a chunk that fails
+ * is halved and retried. Every tag starts again from the largest size,
+ * since a failing read says more about that tag's spot in the field
+ * than about the link. Each chunk is decoded as it arrives, so the log is never held as
+ * raw memory. Samples are stored column by column (time offset, sensor,
+ * raw code) and can be written out as CSV with --out.
+ *
+ * Dense logs hold packed 10-bit samples that cycle through the enabled
+ * sensors. The other logging forms hold 32-bit records, a 10-bit sample
+ * followed by the 22-bit index of the measurement cycle it was taken in.
+ * @file SL900Alogdownload.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --password 0 --out log.csv\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+#define MAX_TAGS 64
+/* Largest and smallest user memory read, in words */
+#define MAX_CHUNK_WORDS 96
+#define MIN_CHUNK_WORDS 4
+#define MAX_CHUNK_RETRIES 3
+
+typedef enum LogSensor
+{
+  LOG_SENSOR_TEMP,
+  LOG_SENSOR_EXT1,
+  LOG_SENSOR_EXT2,
+  LOG_SENSOR_BATT,
+} LogSensor;
+
+static const char *sensorNames[] = { "temp", "ext1", "ext2", "batt" };
+
+/* Columnar store of decoded samples */
+typedef struct LogSeries
+{
+  uint32_t count;
+  uint32_t capacity;
+  /* Seconds since the log was started */
+  uint32_t *time;
+  uint8_t *sensor;
+  uint16_t *raw;
+} LogSeries;
+
+/* Decoder state that carries over from one chunk to the next */
+typedef struct LogDecoder
+{
+  bool dense;
+  uint8_t sensors[4];
+  uint8_t sensorCount;
+  uint16_t interval;
+  uint32_t expected;
+  uint32_t decoded;
+  uint64_t bits;
+  uint8_t bitCount;
+} LogDecoder;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* Default conversion, as in SL900Agetsensorvalue */
+double getCelsiusTemp(uint16_t value)
+{
+  return ((double)value) * 0.18-89.3;
+}
+
+static void
+appendSample(LogSeries *series, uint32_t time, uint8_t sensor, uint16_t raw)
+{
+  if (series->count == series->capacity)
+  {
+    series->capacity = (0 == series->capacity) ? 256 : 2 * series->capacity;
+    series->time = realloc(series->time, series->capacity * sizeof(*series->time));
+    series->sensor = realloc(series->sensor, series->capacity * sizeof(*series->sensor));
+    series->raw = realloc(series->raw, series->capacity * sizeof(*series->raw));
+    if ((NULL == series->time) || (NULL == series->sensor) || (NULL == series->raw))
+    {
+      errx(1, "Error: out of memory for %"PRIu32" samples\n", series->capacity);
+    }
+  }
+  series->time[series->count] = time;
+  series->sensor[series->count] = sensor;
+  series->raw[series->count] = raw;
+  series->count++;
+}
+
+static void
+initDecoder(LogDecoder *dec, const TMR_TagOp_GEN2_IDS_SL900A_MeasurementSetupData *setup, uint32_t expected)
+{
+  const LogModeData *mode = &setup->logModeData;
+
+  memset(dec, 0, sizeof(*dec));
+  dec->dense = (TMR_GEN2_IDS_SL900A_LOGGINGFORM_DENSE == mode->Form);
+  if (mode->TempEnable)
+  {
+    dec->sensors[dec->sensorCount++] = LOG_SENSOR_TEMP;
+  }
+  if (mode->Ext1Enable)
+  {
+    dec->sensors[dec->sensorCount++] = LOG_SENSOR_EXT1;
+  }
+  if (mode->Ext2Enable)
+  {
+    dec->sensors[dec->sensorCount++] = LOG_SENSOR_EXT2;
+  }
+  if (mode->BattEnable)
+  {
+    dec->sensors[dec->sensorCount++] = LOG_SENSOR_BATT;
+  }
+  if (0 == dec->sensorCount)
+  {
+    dec->sensors[dec->sensorCount++] = LOG_SENSOR_TEMP;
+  }
+  dec->interval = setup->logInterval;
+  dec->expected = expected;
+}
+
+/* Bits taken up by one stored measurement */
+static uint32_t
+recordBits(const LogDecoder *dec)
+{
+  return dec->dense ? 10 : 32;
+}
+
+/**
+ * helper function to decode one chunk of the measurement area. Records
+ * that straddle the end of the chunk are finished by the next one.
+ */
+static void
+decodeChunk(LogDecoder *dec, const uint8_t *data, uint32_t len, LogSeries *series)
+{
+  uint32_t i, record, width = recordBits(dec);
+  uint32_t cycle;
+  uint8_t sensor;
+
+  for (i = 0; (i < len) && (dec->decoded < dec->expected); i++)
+  {
+    dec->bits = (dec->bits << 8) | data[i];
+    dec->bitCount += 8;
+    while ((dec->bitCount >= width) && (dec->decoded < dec->expected))
+    {
+      record = (uint32_t)(dec->bits >> (dec->bitCount - width)) & (uint32_t)((1ULL << width) - 1);
+      dec->bitCount -= width;
+      if (dec->dense)
+      {
+        cycle = dec->decoded / dec->sensorCount;
+        sensor = dec->sensors[dec->decoded % dec->sensorCount];
+        appendSample(series, cycle * dec->interval, sensor, (uint16_t)record);
+      }
+      else
+      {
+        cycle = record & 0x3fffff;
+        appendSample(series, cycle * dec->interval, dec->sensors[0], (uint16_t)(record >> 22));
+      }
+      dec->decoded++;
+    }
+  }
+}
+
+/**
+ * helper function to read and decode the measurement area of one tag.
+ * *chunkWords is the working chunk size and is shrunk when reads of
+ * that size fail.
+ */
+static TMR_Status
+downloadLog(TMR_Reader *rp, TMR_TagFilter *filter, uint32_t password, uint16_t *chunkWords,
+            LogSeries *series, uint32_t *bytesRead, uint32_t *measurements)
+{
+  TMR_TagOp op;
+  TMR_Status ret;
+  TMR_uint8List data;
+  uint8_t buf[2 * MAX_CHUNK_WORDS + 16];
+  TMR_TagOp_GEN2_IDS_SL900A_MeasurementSetupData setup;
+  TMR_TagOp_GEN2_IDS_SL900A_LogState logState;
+  LogDecoder dec;
+  uint32_t address, endAddress, totalBits;
+  uint16_t words;
+  int failures;
+
+  data.list = buf;
+  data.max = sizeof(buf);
+
+  data.len = 0;
+  ret = TMR_TagOp_init_GEN2_IDS_SL900A_GetMeasurementSetup(&op, 0, TMR_GEN2_IDS_SL900A_PASSWORD_APPLICATION, password);
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_executeTagOp(rp, &op, filter, &data);
+  }
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  TMR_init_GEN2_IDS_SL900A_MeasurementSetupData(&data, &setup);
+
+  data.len = 0;
+  ret = TMR_TagOp_init_GEN2_IDS_SL900A_GetLogState(&op, 0, TMR_GEN2_IDS_SL900A_PASSWORD_APPLICATION, password);
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_executeTagOp(rp, &op, filter, &data);
+  }
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  TMR_init_GEN2_IDS_SL900A_LogState(&data, &logState);
+
+  *measurements = logState.statStatus.NumMeasurements;
+  initDecoder(&dec, &setup, *measurements);
+  printf("  %s log, %"PRIu32" measurements every %u s, started %04u-%02u-%02u %02u:%02u:%02u\n",
+         dec.dense ? "dense" : "limits", *measurements, setup.logInterval,
+         setup.startTime.tm_year, setup.startTime.tm_mon, setup.startTime.tm_mday,
+         setup.startTime.tm_hour, setup.startTime.tm_min, setup.startTime.tm_sec);
+
+  /* The measurement area follows the words reserved for the application */
+  totalBits = *measurements * recordBits(&dec);
+  address = setup.addData.NumberOfWords;
+  endAddress = address + (totalBits + 15) / 16;
+  failures = 0;
+  while (address < endAddress)
+  {
+    words = *chunkWords;
+    if (endAddress - address < words)
+    {
+      words = (uint16_t)(endAddress - address);
+    }
+    data.len = 0;
+    ret = TMR_TagOp_init_GEN2_ReadData(&op, TMR_GEN2_BANK_USER, address, (uint8_t)words);
+    if (TMR_SUCCESS == ret)
+    {
+      ret = TMR_executeTagOp(rp, &op, filter, &data);
+    }
+    if (TMR_SUCCESS != ret)
+    {
+      /* Try a smaller chunk before giving up on the tag */
+      if (*chunkWords > MIN_CHUNK_WORDS)
+      {
+        *chunkWords /= 2;
+        continue;
+      }
+      if (++failures > MAX_CHUNK_RETRIES)
+      {
+        return ret;
+      }
+      continue;
+    }
+    failures = 0;
+    decodeChunk(&dec, data.list, data.len, series);
+    *bytesRead += data.len;
+    address += words;
+  }
+  return TMR_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t password = 0;
+  const char *outFile = NULL;
+  FILE *out = NULL;
+  static TMR_TagData tags[MAX_TAGS];
+  uint32_t tagCount = 0, t, s, first;
+  uint32_t bytesRead, measurements, totalSamples = 0, downloaded = 0;
+  uint16_t chunkWords;
+  uint64_t start, tagStart, elapsed;
+  LogSeries series;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--password", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNx32, &password))
+      {
+        fprintf(stdout, "Can't parse '%s' as a hex password\n", argv[i+1]);
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--out", argv[i]))
+    {
+      outFile = argv[i+1];
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  //Use first antenna for operation
+  if (NULL != antennaList)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_TAGOP_ANTENNA, &antennaList[0]);
+    checkerr(rp, ret, 1, "setting tagop antenna");
+  }
+
+  //Set up the reader configuration
+  {
+    TMR_GEN2_Session session = TMR_GEN2_SESSION_S0;
+
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_SESSION, &session);
+    checkerr(rp, ret, 1, "setting the session");
+  }
+
+  ret = TMR_read(rp, 500, NULL);
+  if (TMR_ERROR_TAG_ID_BUFFER_FULL == ret)
+  {
+    /* In case of TAG ID Buffer Full, extract the tags present
+    * in buffer.
+    */
+    fprintf(stdout, "reading tags:%s\n", TMR_strerr(rp, ret));
+  }
+  else
+  {
+    checkerr(rp, ret, 1, "reading tags");
+  }
+  while ((TMR_SUCCESS == TMR_hasMoreTags(rp)) && (tagCount < MAX_TAGS))
+  {
+    TMR_TagReadData trd;
+
+    ret = TMR_getNextTag(rp, &trd);
+    checkerr(rp, ret, 1, "fetching tag");
+    tags[tagCount++] = trd.tag;
+  }
+  printf("%"PRIu32" loggers in the field\n", tagCount);
+
+  if (NULL != outFile)
+  {
+    out = fopen(outFile, "w");
+    if (NULL == out)
+    {
+      errx(1, "Error: can't open %s\n", outFile);
+    }
+    fprintf(out, "epc,time,sensor,raw,celsius\n");
+  }
+
+  memset(&series, 0, sizeof(series));
+  start = tmr_gettime();
+  for (t = 0; t < tagCount; t++)
+  {
+    TMR_TagFilter filter;
+    char epcStr[128];
+    double minTemp = 0, maxTemp = 0, temp;
+    bool haveTemp = false;
+
+    TMR_bytesToHex(tags[t].epc, tags[t].epcByteCount, epcStr);
+    printf("%s\n", epcStr);
+    TMR_TF_init_tag(&filter, &tags[t]);
+
+    first = series.count;
+    chunkWords = MAX_CHUNK_WORDS;
+    bytesRead = 0;
+    measurements = 0;
+    tagStart = tmr_gettime();
+    ret = downloadLog(rp, &filter, password, &chunkWords, &series, &bytesRead, &measurements);
+    elapsed = tmr_gettime() - tagStart;
+    if (TMR_SUCCESS != ret)
+    {
+      printf("  download failed: %s\n", TMR_strerr(rp, ret));
+      /* Drop the samples decoded before the failure */
+      series.count = first;
+      continue;
+    }
+    downloaded++;
+
+    for (s = first; s < series.count; s++)
+    {
+      temp = getCelsiusTemp(series.raw[s]);
+      if (LOG_SENSOR_TEMP == series.sensor[s])
+      {
+        if (!haveTemp || (temp < minTemp))
+        {
+          minTemp = temp;
+        }
+        if (!haveTemp || (temp > maxTemp))
+        {
+          maxTemp = temp;
+        }
+        haveTemp = true;
+      }
+      if (NULL != out)
+      {
+        fprintf(out, "%s,%"PRIu32",%s,%u", epcStr, series.time[s], sensorNames[series.sensor[s]], series.raw[s]);
+        if (LOG_SENSOR_TEMP == series.sensor[s])
+        {
+          fprintf(out, ",%.2f", temp);
+        }
+        fprintf(out, "\n");
+      }
+    }
+    printf("  %"PRIu32" samples, %"PRIu32" bytes in %"PRIu64" ms, chunk %u words", series.count - first,
+           bytesRead, elapsed, chunkWords);
+    if (haveTemp)
+    {
+      printf(", %.1f to %.1f C", minTemp, maxTemp);
+    }
+    printf("\n");
+  }
+  totalSamples = series.count;
+
+  printf("%"PRIu32"/%"PRIu32" logs downloaded, %"PRIu32" samples in %"PRIu64" ms\n",
+         downloaded, tagCount, totalSamples, tmr_gettime() - start);
+
+  if (NULL != out)
+  {
+    fclose(out);
+  }
+  free(series.time);
+  free(series.sensor);
+  free(series.raw);
+  TMR_destroy(rp);
+  return 0;
+}
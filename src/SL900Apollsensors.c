@@ -0,0 +1,497 @@
+/**
+ * Sample program that polls the temperature of a fleet of SL900A tags
+ * and publishes the readings as a stream.
+ *
+ * An inventory over all antennas, restricted by a TID select to SL900A
+ * chips, finds the tags and remembers, for each one, the antenna that
+ * read it with the strongest RSSI. Tags are
+ * then polled round-robin with GetSensorValue, each addressed with a
+ * select filter on its EPC and sent on its best antenna. Tags that are
+ * due in the same round are grouped by antenna, so the tagop antenna
+ * changes at most once per antenna per round. A tag that does not
+ * answer backs off exponentially, and the inventory is repeated from
+ * time to time to pick up new tags and refresh the best antennas. Tags
+ * missing from the latest inventory are not polled until seen again.
+ *
+ * Each reading is written to stdout as one line:
+ * epc,antenna,timestamp,celsius
+ * @file SL900Apollsensors.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --interval 5000 --duration 600\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+#define MAX_SENSOR_TAGS 256
+#define DEFAULT_INTERVAL_MS 5000
+#define DEFAULT_DURATION_S 600
+#define INVENTORY_ROUNDS 4
+#define INVENTORY_TIMEOUT 250
+#define REINVENTORY_MS 30000
+/* Backoff after a failed poll doubles from BACKOFF_BASE_MS up to BACKOFF_MAX_MS */
+#define BACKOFF_BASE_MS 500
+#define BACKOFF_MAX_MS 60000
+/* Polling rounds sleep this long when nothing is due */
+#define IDLE_SLEEP_MS 20
+/* SL900A TID: mask designer IDS (ams) and its model number */
+#define SL900A_MDID 0x036
+#define SL900A_TMN 0x401
+
+typedef struct SensorTag
+{
+  TMR_TagData tag;
+  uint8_t antenna;
+  int32_t rssi;
+  uint64_t nextDue;
+  uint32_t failures;
+  uint32_t polls;
+  uint32_t errors;
+} SensorTag;
+
+typedef struct SensorFleet
+{
+  SensorTag tags[MAX_SENSOR_TAGS];
+  uint32_t count;
+} SensorFleet;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* Default conversion, as in SL900Agetsensorvalue */
+double getCelsiusTemp(TMR_TagOp_GEN2_IDS_SL900A_SensorReading *sensorReading)
+{
+  return ((double)sensorReading->Value) * 0.18-89.3;
+}
+
+static SensorTag *
+findTag(SensorFleet *fleet, const TMR_TagData *tag)
+{
+  uint32_t i;
+
+  for (i = 0; i < fleet->count; i++)
+  {
+    if ((fleet->tags[i].tag.epcByteCount == tag->epcByteCount)
+        && (0 == memcmp(fleet->tags[i].tag.epc, tag->epc, tag->epcByteCount)))
+    {
+      return &fleet->tags[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * helper function to inventory all antennas and note the strongest
+ * antenna for every tag. Known tags keep their poll schedule.
+ */
+static void
+inventory(TMR_Reader *rp, SensorFleet *fleet, uint64_t now)
+{
+  TMR_Status ret;
+  SensorTag *st;
+  int round;
+
+  /* Best antennas are chosen afresh on each inventory */
+  for (st = fleet->tags; st < fleet->tags + fleet->count; st++)
+  {
+    st->rssi = INT32_MIN;
+  }
+
+  for (round = 0; round < INVENTORY_ROUNDS; round++)
+  {
+    ret = TMR_read(rp, INVENTORY_TIMEOUT, NULL);
+    if ((TMR_SUCCESS != ret) && (TMR_ERROR_TAG_ID_BUFFER_FULL != ret))
+    {
+      fprintf(stderr, "reading tags:%s\n", TMR_strerr(rp, ret));
+      continue;
+    }
+    while (TMR_SUCCESS == TMR_hasMoreTags(rp))
+    {
+      TMR_TagReadData trd;
+
+      ret = TMR_getNextTag(rp, &trd);
+      checkerr(rp, ret, 1, "fetching tag");
+
+      st = findTag(fleet, &trd.tag);
+      if (NULL == st)
+      {
+        if (MAX_SENSOR_TAGS == fleet->count)
+        {
+          continue;
+        }
+        st = &fleet->tags[fleet->count++];
+        memset(st, 0, sizeof(*st));
+        st->tag = trd.tag;
+        st->rssi = INT32_MIN;
+        st->nextDue = now;
+      }
+      if (trd.rssi > st->rssi)
+      {
+        st->rssi = trd.rssi;
+        st->antenna = trd.antenna;
+      }
+    }
+  }
+}
+
+static int
+compareAntenna(const void *a, const void *b)
+{
+  const SensorTag *x = *(SensorTag * const *)a;
+  const SensorTag *y = *(SensorTag * const *)b;
+
+  return (int)x->antenna - (int)y->antenna;
+}
+
+/* helper function to poll one tag and publish the reading */
+static TMR_Status
+pollTag(TMR_Reader *rp, SensorTag *st)
+{
+  TMR_Status ret;
+  TMR_TagOp op;
+  TMR_TagFilter filter;
+  TMR_uint8List data;
+  uint8_t dataBuffer[16];
+  TMR_TagOp_GEN2_IDS_SL900A_SensorReading reading;
+  char epcStr[128];
+
+  data.list = dataBuffer;
+  data.max = sizeof(dataBuffer)/sizeof(dataBuffer[0]);
+  data.len = 0;
+
+  TMR_TF_init_gen2_select(&filter, false, TMR_GEN2_BANK_EPC, 32, st->tag.epcByteCount * 8, st->tag.epc);
+  ret = TMR_TagOp_init_GEN2_IDS_SL900A_GetSensorValue(&op, 0, 0, 0, TMR_GEN2_IDS_SL900A_SENSOR_TEMP);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  ret = TMR_executeTagOp(rp, &op, &filter, &data);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  if (0 == data.len)
+  {
+    return TMR_ERROR_NO_TAGS;
+  }
+  TMR_init_GEN2_IDS_SL900A_SensorReading(&data, &reading);
+  if (reading.ADError)
+  {
+    return TMR_ERROR_INVALID;
+  }
+
+  TMR_bytesToHex(st->tag.epc, st->tag.epcByteCount, epcStr);
+  printf("%s,%u,%"PRIu64",%.2f\n", epcStr, st->antenna, tmr_gettime(), getCelsiusTemp(&reading));
+  fflush(stdout);
+  return TMR_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_TagFilter sl900aFilter;
+  /* TID bits 11-31: 9-bit MDID then 12-bit TMN, left aligned */
+  uint8_t sl900aMask[] = {
+    (uint8_t)(((SL900A_MDID << 12) | SL900A_TMN) >> 13),
+    (uint8_t)(((SL900A_MDID << 12) | SL900A_TMN) >> 5),
+    (uint8_t)(((SL900A_MDID << 12) | SL900A_TMN) << 3)
+  };
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t interval = DEFAULT_INTERVAL_MS, duration = DEFAULT_DURATION_S;
+  static SensorFleet fleet;
+  static SensorTag *due[MAX_SENSOR_TAGS];
+  uint32_t dueCount, t, backoff, polls = 0, errors = 0, antennaSwitches = 0;
+  uint8_t currentAntenna = 0;
+  uint64_t now, end, nextInventory;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--interval", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNu32, &interval))
+      {
+        fprintf(stdout, "Can't parse '%s' as an interval in milliseconds\n", argv[i+1]);
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNu32, &duration))
+      {
+        fprintf(stdout, "Can't parse '%s' as a duration in seconds\n", argv[i+1]);
+        usage();
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stderr;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  /**
+   * Only SL900A tags join the fleet. MDID and TMN follow each other from
+   * TID bit 11, so one 21-bit select matches both.
+   */
+  ret = TMR_TF_init_gen2_select(&sl900aFilter, false, TMR_GEN2_BANK_TID, 11, 21, sl900aMask);
+  checkerr(rp, ret, 1, "initializing the SL900A filter");
+  ret = TMR_RP_set_filter(&plan, &sl900aFilter);
+  checkerr(rp, ret, 1, "setting the SL900A filter");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  //Set up the reader configuration
+  {
+    TMR_GEN2_Session session = TMR_GEN2_SESSION_S0;
+
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_SESSION, &session);
+    checkerr(rp, ret, 1, "setting the session");
+  }
+
+  now = tmr_gettime();
+  end = now + (uint64_t)duration * 1000;
+  nextInventory = now;
+  while ((now = tmr_gettime()) < end)
+  {
+    if (now >= nextInventory)
+    {
+      inventory(rp, &fleet, now);
+      fprintf(stderr, "%"PRIu32" sensor tags known\n", fleet.count);
+      nextInventory = tmr_gettime() + REINVENTORY_MS;
+      now = tmr_gettime();
+    }
+
+    dueCount = 0;
+    for (t = 0; t < fleet.count; t++)
+    {
+      if ((fleet.tags[t].nextDue <= now) && (INT32_MIN != fleet.tags[t].rssi))
+      {
+        due[dueCount++] = &fleet.tags[t];
+      }
+    }
+    if (0 == dueCount)
+    {
+      tmr_sleep(IDLE_SLEEP_MS);
+      continue;
+    }
+    qsort(due, dueCount, sizeof(due[0]), compareAntenna);
+
+    for (t = 0; t < dueCount; t++)
+    {
+      SensorTag *st = due[t];
+
+      if (st->antenna != currentAntenna)
+      {
+        ret = TMR_paramSet(rp, TMR_PARAM_TAGOP_ANTENNA, &st->antenna);
+        checkerr(rp, ret, 1, "setting tagop antenna");
+        currentAntenna = st->antenna;
+        antennaSwitches++;
+      }
+
+      st->polls++;
+      polls++;
+      ret = pollTag(rp, st);
+      now = tmr_gettime();
+      if (TMR_SUCCESS == ret)
+      {
+        st->failures = 0;
+        st->nextDue = now + interval;
+      }
+      else
+      {
+        st->errors++;
+        errors++;
+        backoff = BACKOFF_BASE_MS << ((st->failures < 7) ? st->failures : 7);
+        if (backoff > BACKOFF_MAX_MS)
+        {
+          backoff = BACKOFF_MAX_MS;
+        }
+        st->failures++;
+        st->nextDue = now + backoff;
+      }
+    }
+  }
+
+  fprintf(stderr, "%"PRIu32" polls, %"PRIu32" failed, %"PRIu32" antenna switches over %"PRIu32" tags\n",
+          polls, errors, antennaSwitches, fleet.count);
+
+  TMR_destroy(rp);
+  return 0;
+}
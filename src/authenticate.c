@@ -266,9 +266,8 @@ int main(int argc, char *argv[])
 			checkerr(rp, ret, 1, "executing Authenticate tagop");
 			if(SendRawData)
 			{
-				//TODO:Currently C API don't have support for decrypting raw data.
-				// TO decrypt this data use online AES decryptor
-				//http://aes.online-domain-tools.com/
+				//Raw data is encrypted with the tag key, tamverify.c shows
+				//how to decrypt and verify it locally.
 				char dataStr[255];
 				TMR_bytesToHex(dataList.list,dataList.len,dataStr);
 				printf("Raw data:%s\n",dataStr);
@@ -296,9 +295,8 @@ int main(int argc, char *argv[])
 			checkerr(rp, ret, 1, "executing Untraceable tagop");
 			if(SendRawData)
 			{
-			//TODO:Currently C API don't have support for decrypting raw data.
-			// TO decrypt this data use online AES decryptor
-			//http://aes.online-domain-tools.com/
+			//Raw data is encrypted with the tag key, tamverify.c shows
+			//how to decrypt and verify it locally.
 			char dataStr[255];
 			TMR_bytesToHex(dataList.list,dataList.len,dataStr);
 			printf("Raw data:%s\n",dataStr);
@@ -327,9 +325,8 @@ int main(int argc, char *argv[])
 			checkerr(rp, ret, 1, "executing Untraceable tagop");
 			if(SendRawData)
 			{
-			//TODO:Currently C API don't have support for decrypting raw data.
-			// TO decrypt this data use online AES decryptor
-			//http://aes.online-domain-tools.com/
+			//Raw data is encrypted with the tag key, tamverify.c shows
+			//how to decrypt and verify it locally.
 			char dataStr[255];
 			TMR_bytesToHex(dataList.list,dataList.len,dataStr);
 			printf("Raw data:%s\n",dataStr);
@@ -0,0 +1,409 @@
+/**
+ * Sample program that receives autonomous mode responses and delivers
+ * them to the application in batches.
+ *
+ * The read and stats listeners run on the API's autonomous reader
+ * thread. They only copy each response into a preallocated ring of
+ * compact records and return, so the serial port keeps being drained
+ * while the application processes earlier reads. A delivery thread
+ * hands the records to batchCallback once BATCH_SIZE records are
+ * queued or the oldest one has waited BATCH_TIMEOUT ms. Tag reads and
+ * stats reports share the ring, so they are delivered in the order the
+ * module sent them.
+ *
+ * The module must already be in autonomous mode, see autonomousmode.c.
+ * @file autonomousstream.c
+ */
+
+#include <tm_reader.h>
+#include <serial_reader_imp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4\n");}
+
+/* Number of records in the ring, must be a power of two */
+#define RING_SIZE 4096
+/* Deliver as soon as this many records are queued */
+#define BATCH_SIZE 64
+/* Deliver records that have been queued for this long, in milliseconds */
+#define BATCH_TIMEOUT 50
+/* How long to receive for, in seconds */
+#define RECEIVE_DURATION 30
+
+typedef enum StreamRecordType
+{
+  STREAM_RECORD_TAG,
+  STREAM_RECORD_STATS
+} StreamRecordType;
+
+/**
+ * Compact copy of an autonomous response. Only the fields the
+ * application needs are kept so a record is a fraction of the size of
+ * a TMR_TagReadData.
+ */
+typedef struct StreamRecord
+{
+  uint8_t type;
+  uint8_t antenna;
+  uint8_t epcByteCount;
+  int8_t temperature;
+  int32_t rssi;
+  uint32_t readCount;
+  uint64_t timestamp;
+  uint64_t queuedAt;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+} StreamRecord;
+
+typedef void (*StreamBatchListener)(const StreamRecord *records, uint32_t count, void *cookie);
+
+typedef struct AutonomousStream
+{
+  StreamRecord ring[RING_SIZE];
+  StreamRecord batch[BATCH_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint64_t received;
+  uint64_t dropped;
+  uint64_t batches;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t delivery;
+  bool exitThread;
+  StreamBatchListener listener;
+  void *cookie;
+} AutonomousStream;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie);
+void statsCallback (TMR_Reader *reader, const TMR_Reader_StatsValues* stats, void *cookie);
+void batchCallback(const StreamRecord *records, uint32_t count, void *cookie);
+
+/**
+ * helper function to reserve the next free slot in the ring. The
+ * producer is the API's reader thread, which must never wait on the
+ * application, so when the ring is full the new record is dropped and
+ * counted instead. Returns NULL in that case. Called with the lock held.
+ */
+static StreamRecord *
+ringReserve(AutonomousStream *stream)
+{
+  StreamRecord *rec;
+
+  stream->received++;
+  if (RING_SIZE == stream->head - stream->tail)
+  {
+    stream->dropped++;
+    return NULL;
+  }
+  rec = &stream->ring[stream->head & (RING_SIZE - 1)];
+  rec->queuedAt = tmr_gettime();
+  return rec;
+}
+
+/**
+ * helper function to publish a record reserved with ringReserve. The
+ * consumer is woken for a full batch, and for the first record into an
+ * empty ring so it can start the batch timeout.
+ */
+static void
+ringCommit(AutonomousStream *stream)
+{
+  uint32_t count;
+
+  stream->head++;
+  count = stream->head - stream->tail;
+  if ((1 == count) || (BATCH_SIZE <= count))
+  {
+    pthread_cond_signal(&stream->cond);
+  }
+}
+
+static void*
+deliveryRoutine(void *arg)
+{
+  AutonomousStream *stream = arg;
+  struct timespec deadline;
+  uint32_t count, i;
+  uint64_t age;
+
+  pthread_mutex_lock(&stream->lock);
+  while (1)
+  {
+    count = stream->head - stream->tail;
+    if (0 == count)
+    {
+      if (stream->exitThread)
+      {
+        break;
+      }
+      pthread_cond_wait(&stream->cond, &stream->lock);
+      continue;
+    }
+
+    age = tmr_gettime() - stream->ring[stream->tail & (RING_SIZE - 1)].queuedAt;
+    if ((count < BATCH_SIZE) && (age < BATCH_TIMEOUT) && (false == stream->exitThread))
+    {
+      /* Not enough records yet, wait for more or for the oldest to expire */
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += (BATCH_TIMEOUT - age) * 1000000;
+      if (deadline.tv_nsec >= 1000000000)
+      {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&stream->cond, &stream->lock, &deadline);
+      continue;
+    }
+
+    if (count > BATCH_SIZE)
+    {
+      count = BATCH_SIZE;
+    }
+    for (i = 0; i < count; i++)
+    {
+      stream->batch[i] = stream->ring[(stream->tail + i) & (RING_SIZE - 1)];
+    }
+    stream->tail += count;
+    stream->batches++;
+
+    /* Run the application callback without holding up the producer */
+    pthread_mutex_unlock(&stream->lock);
+    stream->listener(stream->batch, count, stream->cookie);
+    pthread_mutex_lock(&stream->lock);
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_ReadListenerBlock rlb;
+  TMR_StatsListenerBlock slb;
+  TMR_String model;
+  char str[64];
+  static AutonomousStream stream;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc != 2)
+  {
+    usage();
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (!((0 == strcmp("M6e", model.value)) || (0 == strcmp("M6e PRC", model.value))
+    || (0 == strcmp("M6e Micro", model.value)) || (0 == strcmp("M6e Nano", model.value))
+    || (0 == strcmp("M6e Micro USB", model.value)) || (0 == strcmp("M6e Micro USBPro", model.value))))
+  {
+    errx(1, "Error: This codelet works only on M6e and it's variant\n");
+  }
+
+  pthread_mutex_init(&stream.lock, NULL);
+  pthread_cond_init(&stream.cond, NULL);
+  stream.listener = batchCallback;
+  stream.cookie = NULL;
+  if (0 != pthread_create(&stream.delivery, NULL, deliveryRoutine, &stream))
+  {
+    errx(1, "Error creating delivery thread\n");
+  }
+
+  rlb.listener = callback;
+  rlb.cookie = &stream;
+
+  slb.listener = statsCallback;
+  slb.cookie = &stream;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addStatsListener(rp, &slb);
+  checkerr(rp, ret, 1, "adding the stats listener");
+
+  ret = TMR_receiveAutonomousReading(rp, NULL, NULL);
+  checkerr(rp, ret, 1, "Autonomous reading");
+
+  printf("Receiving for %d seconds\n", RECEIVE_DURATION);
+  tmr_sleep(RECEIVE_DURATION * 1000);
+
+  /* remove the listeners to stop receiving the tags */
+  ret = TMR_removeReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "remove read listener");
+  ret = TMR_removeStatsListener(rp, &slb);
+  checkerr(rp, ret, 1, "remove stats listener");
+
+  /* Flush whatever is still queued and wait for the delivery thread */
+  pthread_mutex_lock(&stream.lock);
+  stream.exitThread = true;
+  pthread_cond_signal(&stream.cond);
+  pthread_mutex_unlock(&stream.lock);
+  pthread_join(stream.delivery, NULL);
+
+  printf("Received %"PRIu64" records in %"PRIu64" batches, %"PRIu64" dropped\n",
+         stream.received, stream.batches, stream.dropped);
+
+  pthread_cond_destroy(&stream.cond);
+  pthread_mutex_destroy(&stream.lock);
+  TMR_destroy(rp);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
+
+void
+callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  AutonomousStream *stream = cookie;
+  StreamRecord *rec;
+
+  pthread_mutex_lock(&stream->lock);
+  rec = ringReserve(stream);
+  if (NULL != rec)
+  {
+    rec->type = STREAM_RECORD_TAG;
+    rec->antenna = t->antenna;
+    rec->rssi = t->rssi;
+    rec->readCount = t->readCount;
+    rec->timestamp = ((uint64_t)t->timestampHigh << 32) | t->timestampLow;
+    rec->epcByteCount = t->tag.epcByteCount;
+    memcpy(rec->epc, t->tag.epc, t->tag.epcByteCount);
+    ringCommit(stream);
+  }
+  pthread_mutex_unlock(&stream->lock);
+}
+
+void
+statsCallback (TMR_Reader *reader, const TMR_Reader_StatsValues* stats, void *cookie)
+{
+  AutonomousStream *stream = cookie;
+  StreamRecord *rec;
+
+  /** Currently supporting only temperature value */
+  if (0 == (TMR_READER_STATS_FLAG_TEMPERATURE & stats->valid))
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&stream->lock);
+  rec = ringReserve(stream);
+  if (NULL != rec)
+  {
+    rec->type = STREAM_RECORD_STATS;
+    rec->temperature = stats->temperature;
+    rec->timestamp = tmr_gettime();
+    rec->epcByteCount = 0;
+    ringCommit(stream);
+  }
+  pthread_mutex_unlock(&stream->lock);
+}
+
+void
+batchCallback(const StreamRecord *records, uint32_t count, void *cookie)
+{
+  char epcStr[128];
+  uint32_t i;
+
+  printf("Batch of %"PRIu32" records\n", count);
+  for (i = 0; i < count; i++)
+  {
+    if (STREAM_RECORD_STATS == records[i].type)
+    {
+      printf("  Temperature %d(C)\n", records[i].temperature);
+    }
+    else
+    {
+      TMR_bytesToHex(records[i].epc, records[i].epcByteCount, epcStr);
+      printf("  [ant:%d] %s rssi:%"PRId32" count:%"PRIu32"\n", records[i].antenna, epcStr,
+             records[i].rssi, records[i].readCount);
+    }
+  }
+}
@@ -0,0 +1,513 @@
+/**
+ * Sample program that encodes a batch of tags from a job file.
+ *
+ * Each line of the job file describes one tag:
+ *   <target EPC> <new EPC> <user data|-> <lock: epc|user|epc+user|->
+ * for example
+ *   E20000000000000000000001 300833B2DDD9014000000001 0011223344556677 epc
+ *
+ * Every step addresses its tag directly with a TMR_TF_init_tag filter,
+ * so no inventory round is needed between tags. User memory is written
+ * with BlockWrite while the tag still has its old EPC, then the EPC is
+ * rewritten. The verify step is a short inventory filtered on the new
+ * EPC with the user memory read as an embedded tagop and a stop trigger
+ * of one tag, so finding the tag and reading back its data is one
+ * command. The lock is applied last. Each job reports its result and
+ * the time of every step.
+ * @file bulkencode.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL and job file, such as:\n"\
+                         "tmr:///com4 jobs.txt or tmr:///com4 jobs.txt --ant 1 --password 0x11112222\n"\
+                         "tmr://my-reader.example.com jobs.txt or tmr://my-reader.example.com jobs.txt --ant 1\n");}
+
+#define MAX_JOBS 1024
+#define MAX_USER_WORDS 32
+/* Timeout of the verify inventory, in milliseconds */
+#define VERIFY_TIMEOUT 100
+
+typedef enum EncodeStep
+{
+  STEP_USER_DATA,
+  STEP_WRITE_EPC,
+  STEP_VERIFY,
+  STEP_LOCK,
+  NUM_STEPS
+} EncodeStep;
+
+static const char *stepNames[NUM_STEPS] = { "userdata", "epc", "verify", "lock" };
+
+typedef struct EncodeJob
+{
+  TMR_TagData target;
+  TMR_TagData newEpc;
+  uint16_t userData[MAX_USER_WORDS];
+  uint16_t userWords;
+  uint16_t lockBits;
+  /* Results */
+  TMR_Status status;
+  EncodeStep failedStep;
+  uint32_t stepTime[NUM_STEPS];
+} EncodeJob;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* helper function to parse a hex EPC into a TMR_TagData */
+static bool
+parseEpc(const char *hex, TMR_TagData *tag)
+{
+  uint32_t len;
+
+  memset(tag, 0, sizeof(*tag));
+  if (TMR_SUCCESS != TMR_hexToBytes(hex, tag->epc, TMR_MAX_EPC_BYTE_COUNT, &len) || (0 == len))
+  {
+    return false;
+  }
+  tag->epcByteCount = (uint8_t)len;
+  tag->protocol = TMR_TAG_PROTOCOL_GEN2;
+  return true;
+}
+
+/**
+ * helper function to load the job file. Returns the number of jobs,
+ * exits on a malformed line.
+ */
+static uint32_t
+loadJobs(const char *path, EncodeJob *jobs)
+{
+  FILE *fp;
+  char line[512];
+  char target[128], newEpc[128], user[2 * 2 * MAX_USER_WORDS + 1], lock[16];
+  uint8_t userBytes[2 * MAX_USER_WORDS];
+  uint32_t count = 0, lineNo = 0, len, i;
+  EncodeJob *job;
+
+  fp = fopen(path, "r");
+  if (NULL == fp)
+  {
+    errx(1, "Can't open job file %s\n", path);
+  }
+
+  while ((count < MAX_JOBS) && (NULL != fgets(line, sizeof(line), fp)))
+  {
+    lineNo++;
+    if (('#' == line[0]) || ('\n' == line[0]))
+    {
+      continue;
+    }
+    if (4 != sscanf(line, "%127s %127s %128s %15s", target, newEpc, user, lock))
+    {
+      errx(1, "%s:%"PRIu32": expected <target> <new EPC> <user data|-> <lock|->\n", path, lineNo);
+    }
+
+    job = &jobs[count];
+    memset(job, 0, sizeof(*job));
+    if (!parseEpc(target, &job->target) || !parseEpc(newEpc, &job->newEpc))
+    {
+      errx(1, "%s:%"PRIu32": can't parse EPC\n", path, lineNo);
+    }
+    if (0 != strcmp("-", user))
+    {
+      if ((TMR_SUCCESS != TMR_hexToBytes(user, userBytes, sizeof(userBytes), &len)) || (len & 1))
+      {
+        errx(1, "%s:%"PRIu32": user data must be a whole number of 16-bit words\n", path, lineNo);
+      }
+      job->userWords = (uint16_t)(len / 2);
+      for (i = 0; i < job->userWords; i++)
+      {
+        job->userData[i] = (uint16_t)((userBytes[2 * i] << 8) | userBytes[2 * i + 1]);
+      }
+    }
+    if (NULL != strstr(lock, "epc"))
+    {
+      job->lockBits |= TMR_GEN2_LOCK_BITS_EPC;
+    }
+    if (NULL != strstr(lock, "user"))
+    {
+      job->lockBits |= TMR_GEN2_LOCK_BITS_USER;
+    }
+    count++;
+  }
+  fclose(fp);
+  return count;
+}
+
+/**
+ * helper function for the verify step: inventory filtered on the new
+ * EPC, stopping at the first tag, with the user data read back as an
+ * embedded tagop.
+ */
+static TMR_Status
+verifyTag(TMR_Reader *rp, EncodeJob *job, uint8_t antennaCount, uint8_t *antennaList)
+{
+  TMR_ReadPlan plan;
+  TMR_TagFilter filter;
+  TMR_TagOp readOp;
+  TMR_TagReadData trd;
+  uint8_t dataBuf[2 * MAX_USER_WORDS];
+  TMR_Status ret;
+  uint16_t i;
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  TMR_TF_init_tag(&filter, &job->newEpc);
+  TMR_RP_set_filter(&plan, &filter);
+  TMR_RP_set_stopTrigger(&plan, 1);
+  if (0 < job->userWords)
+  {
+    TMR_TagOp_init_GEN2_ReadData(&readOp, TMR_GEN2_BANK_USER, 0, (uint8_t)job->userWords);
+    TMR_RP_set_tagop(&plan, &readOp);
+  }
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+  ret = TMR_read(rp, VERIFY_TIMEOUT, NULL);
+  if ((TMR_SUCCESS != ret) && (TMR_ERROR_TAG_ID_BUFFER_FULL != ret))
+  {
+    return ret;
+  }
+
+  while (TMR_SUCCESS == TMR_hasMoreTags(rp))
+  {
+    TMR_TRD_init_data(&trd, sizeof(dataBuf), dataBuf);
+    ret = TMR_getNextTag(rp, &trd);
+    if (TMR_SUCCESS != ret)
+    {
+      return ret;
+    }
+    if ((trd.tag.epcByteCount != job->newEpc.epcByteCount)
+        || (0 != memcmp(trd.tag.epc, job->newEpc.epc, trd.tag.epcByteCount)))
+    {
+      continue;
+    }
+    /* The tag answered with its new EPC; now compare the user data */
+    if (trd.data.len < 2 * job->userWords)
+    {
+      return TMR_ERROR_INVALID;
+    }
+    for (i = 0; i < job->userWords; i++)
+    {
+      if (job->userData[i] != ((dataBuf[2 * i] << 8) | dataBuf[2 * i + 1]))
+      {
+        return TMR_ERROR_INVALID;
+      }
+    }
+    return TMR_SUCCESS;
+  }
+  return TMR_ERROR_NO_TAGS_FOUND;
+}
+
+/* helper function to run every step of one job, recording the time of each */
+static void
+encodeTag(TMR_Reader *rp, EncodeJob *job, TMR_GEN2_Password password,
+          uint8_t antennaCount, uint8_t *antennaList)
+{
+  TMR_TagFilter filter;
+  TMR_TagOp op;
+  TMR_uint16List data;
+  uint64_t start;
+  EncodeStep step;
+
+  job->status = TMR_SUCCESS;
+  for (step = STEP_USER_DATA; step < NUM_STEPS; step++)
+  {
+    start = tmr_gettime();
+    switch (step)
+    {
+    case STEP_USER_DATA:
+      if (0 == job->userWords)
+      {
+        continue;
+      }
+      data.list = job->userData;
+      data.max = data.len = job->userWords;
+      TMR_TF_init_tag(&filter, &job->target);
+      TMR_TagOp_init_GEN2_BlockWrite(&op, TMR_GEN2_BANK_USER, 0, &data);
+      job->status = TMR_executeTagOp(rp, &op, &filter, NULL);
+      break;
+    case STEP_WRITE_EPC:
+      TMR_TF_init_tag(&filter, &job->target);
+      TMR_TagOp_init_GEN2_WriteTag(&op, &job->newEpc);
+      job->status = TMR_executeTagOp(rp, &op, &filter, NULL);
+      break;
+    case STEP_VERIFY:
+      job->status = verifyTag(rp, job, antennaCount, antennaList);
+      break;
+    case STEP_LOCK:
+      if (0 == job->lockBits)
+      {
+        continue;
+      }
+      TMR_TF_init_tag(&filter, &job->newEpc);
+      TMR_TagOp_init_GEN2_Lock(&op, job->lockBits, job->lockBits, password);
+      job->status = TMR_executeTagOp(rp, &op, &filter, NULL);
+      break;
+    default:
+      break;
+    }
+    job->stepTime[step] = (uint32_t)(tmr_gettime() - start);
+    if (TMR_SUCCESS != job->status)
+    {
+      job->failedStep = step;
+      return;
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  static EncodeJob jobs[MAX_JOBS];
+  uint32_t jobCount, succeeded = 0, j;
+  TMR_GEN2_Password password = 0;
+  TMR_GEN2_Session session;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  char epcStr[128];
+  uint64_t start, elapsed;
+  EncodeStep step;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 3)
+  {
+    usage();
+  }
+
+  for (i = 3; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--password", argv[i]))
+    {
+      password = (TMR_GEN2_Password)strtoul(argv[i+1], NULL, 0);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  jobCount = loadJobs(argv[2], jobs);
+  printf("Loaded %"PRIu32" jobs\n", jobCount);
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+  //Use first antenna for operation
+  if (NULL != antennaList)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_TAGOP_ANTENNA, &antennaList[0]);
+    checkerr(rp, ret, 1, "setting tagop antenna");
+  }
+
+  /* Session 0 so a tag that was just written answers the verify inventory */
+  session = TMR_GEN2_SESSION_S0;
+  ret = TMR_paramSet(rp, TMR_PARAM_GEN2_SESSION, &session);
+  checkerr(rp, ret, 1, "setting session");
+  ret = TMR_paramSet(rp, TMR_PARAM_GEN2_ACCESSPASSWORD, &password);
+  checkerr(rp, ret, 1, "setting access password");
+
+  start = tmr_gettime();
+  for (j = 0; j < jobCount; j++)
+  {
+    encodeTag(rp, &jobs[j], password, antennaCount, antennaList);
+
+    TMR_bytesToHex(jobs[j].newEpc.epc, jobs[j].newEpc.epcByteCount, epcStr);
+    if (TMR_SUCCESS == jobs[j].status)
+    {
+      succeeded++;
+      printf("%4"PRIu32" %s OK  ", j + 1, epcStr);
+    }
+    else
+    {
+      printf("%4"PRIu32" %s FAILED at %s: %s  ", j + 1, epcStr, stepNames[jobs[j].failedStep],
+             TMR_strerr(rp, jobs[j].status));
+    }
+    for (step = STEP_USER_DATA; step < NUM_STEPS; step++)
+    {
+      printf(" %s:%"PRIu32"ms", stepNames[step], jobs[j].stepTime[step]);
+    }
+    printf("\n");
+  }
+  elapsed = tmr_gettime() - start;
+
+  printf("Encoded %"PRIu32"/%"PRIu32" tags in %"PRIu64" ms", succeeded, jobCount, elapsed);
+  if (0 < elapsed)
+  {
+    printf(" (%"PRIu64" tags/min)", (uint64_t)succeeded * 60000 / elapsed);
+  }
+  printf("\n");
+
+  TMR_destroy(rp);
+  return 0;
+}
@@ -0,0 +1,433 @@
+/**
+ * Sample program that connects to a reader using a persistent cache of
+ * reader capabilities, then reads tags for a fixed period of time (500ms).
+ *
+ * Most samples query the region and, on a fresh module, the supported
+ * regions after every connect, then set the region. This sample keeps a
+ * local cache file keyed on the reader URI. The cached region is handed
+ * to the reader before TMR_connect, so it goes out with the connect
+ * sequence and no region commands are needed afterwards. The entry is
+ * then checked against the model and firmware version, which the
+ * reader already holds from the connect; a mismatch (another module on
+ * the port, or a firmware update) probes the reader and rewrites the
+ * entry. If the first read fails with cached settings, the reader is
+ * probed again and the entry is refreshed.
+ * @file cachedconnect.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --cache file\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2 --cache file\n");}
+
+#define DEFAULT_CACHE_FILE "reader_capabilities.cache"
+#define MAX_CACHE_ENTRIES 64
+
+/**
+ * Cached reader capabilities. The URI selects the entry before
+ * connecting; model and software version validate it afterwards.
+ * The region is what the sample would otherwise have to query.
+ */
+typedef struct CapabilityEntry
+{
+  char uri[256];
+  char model[64];
+  char software[64];
+  TMR_Region region;
+} CapabilityEntry;
+
+typedef struct CapabilityCache
+{
+  CapabilityEntry entries[MAX_CACHE_ENTRIES];
+  uint32_t count;
+} CapabilityCache;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/**
+ * helper function to load the cache file. Each line holds one reader:
+ * URI, model, software and region, separated by tabs since model
+ * names contain spaces.
+ */
+void loadCache(CapabilityCache *cache, const char *path)
+{
+  FILE *fp;
+  char line[512];
+  unsigned int region;
+  CapabilityEntry *e;
+
+  cache->count = 0;
+  fp = fopen(path, "r");
+  if (NULL == fp)
+  {
+    return;
+  }
+
+  while ((cache->count < MAX_CACHE_ENTRIES) && (NULL != fgets(line, sizeof(line), fp)))
+  {
+    e = &cache->entries[cache->count];
+    memset(e, 0, sizeof(*e));
+    if (4 != sscanf(line, "%255[^\t]\t%63[^\t]\t%63[^\t]\t%u",
+                    e->uri, e->model, e->software, &region))
+    {
+      continue;
+    }
+    e->region = (TMR_Region)region;
+    cache->count++;
+  }
+  fclose(fp);
+}
+
+void saveCache(const CapabilityCache *cache, const char *path)
+{
+  FILE *fp;
+  uint32_t i;
+
+  fp = fopen(path, "w");
+  if (NULL == fp)
+  {
+    fprintf(stdout, "Can't write capability cache %s\n", path);
+    return;
+  }
+  for (i = 0; i < cache->count; i++)
+  {
+    const CapabilityEntry *e = &cache->entries[i];
+
+    fprintf(fp, "%s\t%s\t%s\t%u\n", e->uri, e->model, e->software, (unsigned int)e->region);
+  }
+  fclose(fp);
+}
+
+/**
+ * helper function to find the entry for a reader URI.
+ */
+CapabilityEntry *findEntry(CapabilityCache *cache, const char *uri)
+{
+  uint32_t i;
+
+  for (i = 0; i < cache->count; i++)
+  {
+    if (0 == strcmp(uri, cache->entries[i].uri))
+    {
+      return &cache->entries[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * helper function to fill in the model and software version. The
+ * reader caches both from the version reply it gets while connecting,
+ * so these don't go out to the module.
+ */
+void identifyReader(TMR_Reader *rp, CapabilityEntry *e)
+{
+  TMR_Status ret;
+  TMR_String str;
+
+  str.value = e->model;
+  str.max = sizeof(e->model);
+  ret = TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &str);
+  checkerr(rp, ret, 1, "getting model");
+  str.value = e->software;
+  str.max = sizeof(e->software);
+  ret = TMR_paramGet(rp, TMR_PARAM_VERSION_SOFTWARE, &str);
+  checkerr(rp, ret, 1, "getting software version");
+}
+
+/**
+ * helper function to query the region, setting it if the module
+ * doesn't have one yet. These are the round trips the cache saves.
+ */
+void probeReader(TMR_Reader *rp, CapabilityEntry *e)
+{
+  TMR_Status ret;
+
+  e->region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &e->region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == e->region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    e->region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &e->region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_ReadPlan plan;
+  static CapabilityCache cache;
+  CapabilityEntry probed, *entry;
+  const char *cacheFile = DEFAULT_CACHE_FILE;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  uint64_t start;
+  bool cached;
+  bool preset = false;
+  int32_t tagCount;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--cache", argv[i]))
+    {
+      cacheFile = argv[i+1];
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  start = tmr_gettime();
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  loadCache(&cache, cacheFile);
+  entry = findEntry(&cache, argv[1]);
+  if (NULL != entry)
+  {
+    /**
+     * Before connecting, the reader only stores the region; it is sent
+     * to the module as part of the connect sequence.
+     */
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &entry->region);
+    preset = (TMR_SUCCESS == ret);
+    if (!preset)
+    {
+      printf("Reader won't take a region before connecting, probing after connect\n");
+    }
+  }
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  memset(&probed, 0, sizeof(probed));
+  snprintf(probed.uri, sizeof(probed.uri), "%s", argv[1]);
+  identifyReader(rp, &probed);
+
+  cached = ((NULL != entry) && preset
+            && (0 == strcmp(probed.model, entry->model))
+            && (0 == strcmp(probed.software, entry->software)));
+  if (cached)
+  {
+    printf("Using cached capabilities for %s (%s %s)\n", entry->uri, entry->model, entry->software);
+  }
+  else
+  {
+    if (NULL != entry)
+    {
+      printf("Reader changed from %s %s to %s %s, probing reader\n",
+             entry->model, entry->software, probed.model, probed.software);
+    }
+    else
+    {
+      printf("No cached capabilities for %s, probing reader\n", probed.uri);
+      entry = (cache.count < MAX_CACHE_ENTRIES) ? &cache.entries[cache.count++] : &cache.entries[0];
+    }
+    probeReader(rp, &probed);
+    *entry = probed;
+    saveCache(&cache, cacheFile);
+  }
+
+  if (((0 == strcmp("M6e Micro", entry->model)) ||(0 == strcmp("M6e Nano", entry->model)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  // initialize the read plan
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+
+  /* Commit read plan */
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  ret = TMR_read(rp, 500, &tagCount);
+  if (cached && (TMR_ERROR_INVALID_REGION == ret || TMR_ERROR_MSG_INVALID_PARAMETER_VALUE == ret))
+  {
+    /* The module lost its settings since the entry was cached */
+    printf("Cached capabilities are stale, probing reader\n");
+    probeReader(rp, &probed);
+    *entry = probed;
+    saveCache(&cache, cacheFile);
+    ret = TMR_read(rp, 500, &tagCount);
+  }
+  if (TMR_ERROR_TAG_ID_BUFFER_FULL == ret)
+  {
+    /* In case of TAG ID Buffer Full, extract the tags present
+    * in buffer.
+    */
+    fprintf(stdout, "reading tags:%s\n", TMR_strerr(rp, ret));
+  }
+  else
+  {
+    checkerr(rp, ret, 1, "reading tags");
+  }
+  printf("First read completed %"PRIu64" ms after start (%s)\n", tmr_gettime() - start,
+         cached ? "cached" : "probed");
+
+  while (TMR_SUCCESS == TMR_hasMoreTags(rp))
+  {
+    TMR_TagReadData trd;
+    char epcStr[128];
+
+    ret = TMR_getNextTag(rp, &trd);
+    checkerr(rp, ret, 1, "fetching tag");
+
+    TMR_bytesToHex(trd.tag.epc, trd.tag.epcByteCount, epcStr);
+    printf("EPC:%s ant:%d count:%d\n", epcStr, trd.antenna, trd.readCount);
+  }
+
+  TMR_destroy(rp);
+  return 0;
+}
@@ -0,0 +1,828 @@
+/**
+ * Sample program that removes duplicate tag reads on the host within a
+ * time window while reading in the background.
+ *
+ * The module's own filtering (the uniqueByAntenna and readFilterTimeout
+ * settings) and TMR_ENABLE_API_SIDE_DEDUPLICATION only know about EPC and
+ * antenna, and can't say how often a tag was suppressed. Here every read
+ * goes through a dedup stage whose identity key is chosen with --key from
+ * epc, ant, proto and data (embedded read data, see --tid). The first read
+ * of a key is forwarded, later ones are counted until the key's --window
+ * has passed; --sliding 1 restarts the window on every repeat instead.
+ *
+ * Live keys sit in a hash table and in a timing wheel of --tick sized
+ * slots, so a read and an expiry each cost O(1) no matter how many tags
+ * are in the field. Entries come from a fixed pool of --capacity; when it
+ * runs dry the key closest to expiry is evicted early. Every expiry
+ * reports the key with the number of reads it suppressed.
+ * @file dedupread.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --key epc,ant --window 5000 --duration 10000\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1 --key epc,data --tid 2 --sliding 1\n");}
+
+#define DEFAULT_WINDOW_MS 5000
+#define DEFAULT_TICK_MS 100
+#define DEFAULT_CAPACITY 4096
+#define DEFAULT_DURATION_MS 10000
+
+/* Identity key fields, combined with --key */
+#define KEY_EPC      0x01
+#define KEY_ANTENNA  0x02
+#define KEY_PROTOCOL 0x04
+#define KEY_DATA     0x08
+
+/* Embedded data beyond this many bytes isn't part of the key */
+#define MAX_KEY_DATA_BYTES 32
+/* epc length + epc, antenna, protocol, data length + data */
+#define MAX_KEY_BYTES (1 + TMR_MAX_EPC_BYTE_COUNT + 1 + 1 + 1 + MAX_KEY_DATA_BYTES)
+
+typedef enum ExpiryReason
+{
+  EXPIRY_WINDOW,
+  EXPIRY_EVICTED,
+  EXPIRY_FLUSH
+} ExpiryReason;
+
+/* One live key */
+typedef struct DedupEntry
+{
+  struct DedupEntry *hashNext;
+  struct DedupEntry *wheelPrev;
+  struct DedupEntry *wheelNext;
+  uint32_t hash;
+  uint64_t expireTick;
+  uint64_t firstMs;
+  uint64_t lastMs;
+  uint32_t suppressed;
+  uint8_t keyLen;
+  uint8_t key[MAX_KEY_BYTES];
+} DedupEntry;
+
+struct Dedup;
+typedef void (*ExpiryCallback)(struct Dedup *d, const DedupEntry *e,
+                               ExpiryReason reason, void *cookie);
+
+/* Time-windowed dedup stage */
+typedef struct Dedup
+{
+  pthread_mutex_t lock;
+  uint32_t keyFields;
+  uint32_t tickMs;
+  uint32_t windowTicks;
+  bool sliding;
+  ExpiryCallback onExpire;
+  void *cookie;
+  /* Entry pool */
+  DedupEntry *pool;
+  DedupEntry *freeList;
+  uint32_t capacity;
+  uint32_t live;
+  uint32_t peakLive;
+  /* Hash table, chained */
+  DedupEntry **buckets;
+  uint32_t bucketMask;
+  /* Timing wheel, one circular list per slot with a sentinel head */
+  DedupEntry *wheel;
+  uint32_t wheelMask;
+  uint64_t baseMs;
+  uint64_t currentTick;
+  /* Statistics */
+  uint64_t reads;
+  uint64_t forwarded;
+  uint64_t suppressed;
+  uint64_t expired;
+  uint64_t evicted;
+} Dedup;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* helper function to parse the --key field list */
+static uint32_t parseKeyFields(char *args)
+{
+  char *token;
+  uint32_t fields = 0;
+
+  for (token = strtok(args, ","); NULL != token; token = strtok(NULL, ","))
+  {
+    if (0 == strcmp("epc", token))
+    {
+      fields |= KEY_EPC;
+    }
+    else if (0 == strcmp("ant", token))
+    {
+      fields |= KEY_ANTENNA;
+    }
+    else if (0 == strcmp("proto", token))
+    {
+      fields |= KEY_PROTOCOL;
+    }
+    else if (0 == strcmp("data", token))
+    {
+      fields |= KEY_DATA;
+    }
+    else
+    {
+      errx(1, "Unknown key field '%s', use epc, ant, proto or data\n", token);
+    }
+  }
+  if (0 == fields)
+  {
+    errx(1, "--key needs at least one field\n");
+  }
+  return fields;
+}
+
+static uint64_t nowMs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+hashKey(const uint8_t *key, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* helper function to round up to a power of two */
+static uint32_t roundPow2(uint32_t n)
+{
+  uint32_t p = 1;
+
+  while (p < n)
+  {
+    p <<= 1;
+  }
+  return p;
+}
+
+/**
+ * helper function to build the identity key of a read. Each field is
+ * length-prefixed where needed so different field sets can't collide.
+ */
+static uint8_t buildKey(uint32_t fields, const TMR_TagReadData *t, uint8_t *key)
+{
+  uint8_t len = 0;
+  uint16_t dataLen;
+
+  if (fields & KEY_EPC)
+  {
+    key[len++] = t->tag.epcByteCount;
+    memcpy(key + len, t->tag.epc, t->tag.epcByteCount);
+    len += t->tag.epcByteCount;
+  }
+  if (fields & KEY_ANTENNA)
+  {
+    key[len++] = t->antenna;
+  }
+  if (fields & KEY_PROTOCOL)
+  {
+    key[len++] = (uint8_t)t->tag.protocol;
+  }
+  if (fields & KEY_DATA)
+  {
+    dataLen = (t->data.len < MAX_KEY_DATA_BYTES) ? t->data.len : MAX_KEY_DATA_BYTES;
+    key[len++] = (uint8_t)dataLen;
+    memcpy(key + len, t->data.list, dataLen);
+    len += (uint8_t)dataLen;
+  }
+  return len;
+}
+
+/* helper function to print a key in readable form */
+static void printKey(FILE *out, uint32_t fields, const uint8_t *key)
+{
+  char hex[2 * MAX_KEY_BYTES + 1];
+  uint8_t pos = 0;
+
+  if (fields & KEY_EPC)
+  {
+    TMR_bytesToHex(key + pos + 1, key[pos], hex);
+    fprintf(out, "EPC:%s ", hex);
+    pos += 1 + key[pos];
+  }
+  if (fields & KEY_ANTENNA)
+  {
+    fprintf(out, "ant:%u ", key[pos++]);
+  }
+  if (fields & KEY_PROTOCOL)
+  {
+    fprintf(out, "proto:%u ", key[pos++]);
+  }
+  if (fields & KEY_DATA)
+  {
+    TMR_bytesToHex(key + pos + 1, key[pos], hex);
+    fprintf(out, "data:%s ", hex);
+  }
+}
+
+static void wheelUnlink(DedupEntry *e)
+{
+  e->wheelPrev->wheelNext = e->wheelNext;
+  e->wheelNext->wheelPrev = e->wheelPrev;
+}
+
+static void wheelLink(Dedup *d, DedupEntry *e)
+{
+  DedupEntry *head = &d->wheel[e->expireTick & d->wheelMask];
+
+  e->wheelPrev = head->wheelPrev;
+  e->wheelNext = head;
+  head->wheelPrev->wheelNext = e;
+  head->wheelPrev = e;
+}
+
+/* helper function to report an entry and give it back to the pool */
+static void dedupRelease(Dedup *d, DedupEntry *e, ExpiryReason reason)
+{
+  DedupEntry **link;
+
+  if (NULL != d->onExpire)
+  {
+    d->onExpire(d, e, reason, d->cookie);
+  }
+  wheelUnlink(e);
+  for (link = &d->buckets[e->hash & d->bucketMask]; *link != e; link = &(*link)->hashNext)
+  {
+  }
+  *link = e->hashNext;
+
+  e->hashNext = d->freeList;
+  d->freeList = e;
+  d->live--;
+  if (EXPIRY_EVICTED == reason)
+  {
+    d->evicted++;
+  }
+  else
+  {
+    d->expired++;
+  }
+}
+
+static TMR_Status dedupInit(Dedup *d, uint32_t fields, uint32_t windowMs,
+                            uint32_t tickMs, uint32_t capacity, bool sliding)
+{
+  uint32_t i, slots;
+
+  memset(d, 0, sizeof(*d));
+  d->keyFields = fields;
+  d->tickMs = tickMs;
+  /* Round the window up to whole ticks */
+  d->windowTicks = (windowMs + tickMs - 1) / tickMs;
+  if (0 == d->windowTicks)
+  {
+    d->windowTicks = 1;
+  }
+  d->sliding = sliding;
+  d->capacity = capacity;
+
+  /* Every live entry expires within windowTicks, so one lap is enough */
+  slots = roundPow2(d->windowTicks + 1);
+  d->wheelMask = slots - 1;
+  d->bucketMask = roundPow2(2 * capacity) - 1;
+
+  d->pool = calloc(capacity, sizeof(DedupEntry));
+  d->buckets = calloc(d->bucketMask + 1, sizeof(DedupEntry *));
+  d->wheel = calloc(slots, sizeof(DedupEntry));
+  if (NULL == d->pool || NULL == d->buckets || NULL == d->wheel)
+  {
+    free(d->pool);
+    free(d->buckets);
+    free(d->wheel);
+    return TMR_ERROR_OUT_OF_MEMORY;
+  }
+  for (i = 0; i < slots; i++)
+  {
+    d->wheel[i].wheelPrev = d->wheel[i].wheelNext = &d->wheel[i];
+  }
+  for (i = 0; i < capacity; i++)
+  {
+    d->pool[i].hashNext = d->freeList;
+    d->freeList = &d->pool[i];
+  }
+  d->baseMs = nowMs();
+  pthread_mutex_init(&d->lock, NULL);
+  return TMR_SUCCESS;
+}
+
+/**
+ * helper function to move the wheel up to the given time, expiring
+ * everything that is due. Must be called with the lock held. After an
+ * idle gap longer than one lap every slot is visited once, never more.
+ */
+static void dedupAdvanceLocked(Dedup *d, uint64_t ms)
+{
+  uint64_t target, tick, steps;
+  DedupEntry *head, *e, *next;
+
+  target = (ms - d->baseMs) / d->tickMs;
+  if (target <= d->currentTick)
+  {
+    return;
+  }
+  steps = target - d->currentTick;
+  if (steps > d->wheelMask + 1)
+  {
+    steps = d->wheelMask + 1;
+  }
+  for (tick = d->currentTick + 1; steps > 0; tick++, steps--)
+  {
+    head = &d->wheel[tick & d->wheelMask];
+    for (e = head->wheelNext; e != head; e = next)
+    {
+      next = e->wheelNext;
+      if (e->expireTick <= target)
+      {
+        dedupRelease(d, e, EXPIRY_WINDOW);
+      }
+    }
+  }
+  d->currentTick = target;
+}
+
+static void dedupAdvance(Dedup *d)
+{
+  pthread_mutex_lock(&d->lock);
+  dedupAdvanceLocked(d, nowMs());
+  pthread_mutex_unlock(&d->lock);
+}
+
+/* helper function to free one entry when the pool is empty: the one due first */
+static void dedupEvict(Dedup *d)
+{
+  DedupEntry *head;
+  uint32_t i;
+
+  for (i = 1; i <= d->wheelMask + 1; i++)
+  {
+    head = &d->wheel[(d->currentTick + i) & d->wheelMask];
+    if (head->wheelNext != head)
+    {
+      dedupRelease(d, head->wheelNext, EXPIRY_EVICTED);
+      return;
+    }
+  }
+}
+
+/**
+ * Feed one read through the dedup stage. Returns true if it is the first
+ * read of its key within the window and should be passed on.
+ */
+static bool dedupOffer(Dedup *d, const TMR_TagReadData *t)
+{
+  uint8_t key[MAX_KEY_BYTES];
+  uint8_t keyLen;
+  uint32_t hash;
+  uint64_t ms;
+  DedupEntry *e;
+  bool first = false;
+
+  keyLen = buildKey(d->keyFields, t, key);
+  hash = hashKey(key, keyLen);
+  ms = nowMs();
+
+  pthread_mutex_lock(&d->lock);
+  dedupAdvanceLocked(d, ms);
+  d->reads++;
+
+  for (e = d->buckets[hash & d->bucketMask]; NULL != e; e = e->hashNext)
+  {
+    if (e->hash == hash && e->keyLen == keyLen && 0 == memcmp(e->key, key, keyLen))
+    {
+      break;
+    }
+  }
+
+  if (NULL != e)
+  {
+    e->suppressed++;
+    e->lastMs = ms;
+    d->suppressed++;
+    if (d->sliding)
+    {
+      wheelUnlink(e);
+      e->expireTick = d->currentTick + d->windowTicks;
+      wheelLink(d, e);
+    }
+  }
+  else
+  {
+    if (NULL == d->freeList)
+    {
+      dedupEvict(d);
+    }
+    e = d->freeList;
+    d->freeList = e->hashNext;
+
+    e->hash = hash;
+    e->keyLen = keyLen;
+    memcpy(e->key, key, keyLen);
+    e->suppressed = 0;
+    e->firstMs = e->lastMs = ms;
+    e->expireTick = d->currentTick + d->windowTicks;
+    e->hashNext = d->buckets[hash & d->bucketMask];
+    d->buckets[hash & d->bucketMask] = e;
+    wheelLink(d, e);
+
+    d->live++;
+    if (d->live > d->peakLive)
+    {
+      d->peakLive = d->live;
+    }
+    d->forwarded++;
+    first = true;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return first;
+}
+
+/* helper function to expire every live key, used at shutdown */
+static void dedupFlush(Dedup *d)
+{
+  DedupEntry *head;
+  uint32_t i;
+
+  pthread_mutex_lock(&d->lock);
+  for (i = 0; i <= d->wheelMask; i++)
+  {
+    head = &d->wheel[i];
+    while (head->wheelNext != head)
+    {
+      dedupRelease(d, head->wheelNext, EXPIRY_FLUSH);
+    }
+  }
+  pthread_mutex_unlock(&d->lock);
+}
+
+static void dedupDestroy(Dedup *d)
+{
+  pthread_mutex_destroy(&d->lock);
+  free(d->pool);
+  free(d->buckets);
+  free(d->wheel);
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  Dedup *d = cookie;
+  uint8_t key[MAX_KEY_BYTES];
+
+  if (dedupOffer(d, t))
+  {
+    buildKey(d->keyFields, t, key);
+    printf("READ    ");
+    printKey(stdout, d->keyFields, key);
+    printf("rssi:%d\n", t->rssi);
+  }
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+/* Expiry callback: runs with the dedup lock held, keep it short */
+static void printExpiry(Dedup *d, const DedupEntry *e, ExpiryReason reason, void *cookie)
+{
+  static const char *reasons[] = {"EXPIRED ", "EVICTED ", "FLUSHED "};
+
+  printf("%s", reasons[reason]);
+  printKey(stdout, d->keyFields, e->key);
+  printf("suppressed:%" PRIu32 " seen for:%" PRIu64 " ms\n",
+         e->suppressed, e->lastMs - e->firstMs);
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_TagOp op;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t keyFields = KEY_EPC;
+  uint32_t windowMs = DEFAULT_WINDOW_MS;
+  uint32_t tickMs = DEFAULT_TICK_MS;
+  uint32_t capacity = DEFAULT_CAPACITY;
+  uint32_t durationMs = DEFAULT_DURATION_MS;
+  uint8_t tidWords = 0;
+  bool sliding = false;
+  uint64_t start;
+  Dedup *d;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--key", argv[i]))
+    {
+      keyFields = parseKeyFields(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--window", argv[i]))
+    {
+      windowMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--tick", argv[i]))
+    {
+      tickMs = (uint32_t)atoi(argv[i+1]);
+      if (0 == tickMs)
+      {
+        errx(1, "--tick must be at least 1 ms\n");
+      }
+    }
+    else if (0x00 == strcmp("--capacity", argv[i]))
+    {
+      capacity = (uint32_t)atoi(argv[i+1]);
+      if (0 == capacity)
+      {
+        errx(1, "--capacity must be at least 1\n");
+      }
+    }
+    else if (0x00 == strcmp("--sliding", argv[i]))
+    {
+      sliding = (0 != atoi(argv[i+1]));
+    }
+    else if (0x00 == strcmp("--tid", argv[i]))
+    {
+      tidWords = (uint8_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      durationMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  if ((keyFields & KEY_DATA) && 0 == tidWords)
+  {
+    fprintf(stdout, "Note: --key data without --tid, embedded data will be empty\n");
+  }
+
+  d = malloc(sizeof(*d));
+  if (NULL == d || TMR_SUCCESS != dedupInit(d, keyFields, windowMs, tickMs, capacity, sliding))
+  {
+    errx(1, "Out of memory\n");
+  }
+  d->onExpire = printExpiry;
+  d->cookie = NULL;
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  if (0 != tidWords)
+  {
+    /* Embedded TID read, its bytes become the data key field */
+    ret = TMR_TagOp_init_GEN2_ReadData(&op, TMR_GEN2_BANK_TID, 0, tidWords);
+    checkerr(rp, ret, 1, "creating tagop: GEN2 read data");
+    ret = TMR_RP_set_tagop(&plan, &op);
+    checkerr(rp, ret, 1, "setting tagop");
+  }
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  rlb.listener = callback;
+  rlb.cookie = d;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  /* Keep the wheel turning so keys expire even when no reads come in */
+  start = nowMs();
+  while (nowMs() - start < durationMs)
+  {
+    tmr_sleep(tickMs);
+    dedupAdvance(d);
+  }
+
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+
+  dedupFlush(d);
+
+  printf("\n%" PRIu64 " reads, %" PRIu64 " forwarded, %" PRIu64 " suppressed",
+         d->reads, d->forwarded, d->suppressed);
+  if (0 != d->reads)
+  {
+    printf(" (%.1f%% less downstream traffic)", 100.0 * d->suppressed / d->reads);
+  }
+  printf("\n%" PRIu64 " keys expired, %" PRIu64 " evicted early, peak %" PRIu32
+         " of %" PRIu32 " entries in use\n",
+         d->expired, d->evicted, d->peakLive, d->capacity);
+
+  TMR_destroy(rp);
+  dedupDestroy(d);
+  free(d);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
@@ -0,0 +1,686 @@
+/**
+ * Sample program that keeps slow read listeners off the library's
+ * parser thread.
+ *
+ * Only one read listener is registered with the reader. It copies each
+ * tag read into a record taken from a preallocated pool and hands the
+ * record to every sink. Each sink owns a bounded queue and a worker
+ * thread that runs the sink's handler, so a sink that stalls (a log
+ * file on a slow disk, a network push) only fills its own queue. What
+ * happens when a queue is full is chosen per sink:
+ *
+ *   block     the dispatcher waits for room (nothing is lost, but a
+ *             sink that never drains will eventually stall reading)
+ *   drop      the oldest queued read is discarded for the new one
+ *   coalesce  a read replaces the queued read of the same EPC, if
+ *             there is one; otherwise behaves like drop
+ *
+ * Three sinks are set up: a printer, a deliberately slow "logger" and a
+ * per-EPC counter. Per-sink delivery, drop and queue depth statistics
+ * are printed on exit.
+ * @file dispatchread.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --duration 30 --slow 50 --log-policy drop\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n"\
+                         "policies: block, drop, coalesce\n");}
+
+#define DEFAULT_DURATION_S 30
+#define DEFAULT_SLOW_MS 50
+/* Records shared by all sink queues */
+#define POOL_SIZE 1024
+/* Per-sink queue length */
+#define QUEUE_LEN 128
+#define NUM_SINKS 3
+/* Distinct EPCs tracked by the counting sink */
+#define MAX_COUNTED 1024
+
+typedef enum QueuePolicy
+{
+  POLICY_BLOCK,
+  POLICY_DROP_OLDEST,
+  POLICY_COALESCE
+} QueuePolicy;
+
+static const char *policyNames[] = { "block", "drop", "coalesce" };
+
+/* Copy of one tag read, shared by every sink it was handed to */
+typedef struct ReadRecord
+{
+  struct ReadRecord *nextFree;
+  int refs;
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint8_t antenna;
+  int32_t rssi;
+  uint64_t timestamp;
+} ReadRecord;
+
+/* Preallocated records with a free list */
+typedef struct RecordPool
+{
+  pthread_mutex_t lock;
+  ReadRecord records[POOL_SIZE];
+  ReadRecord *free;
+  uint32_t exhausted;
+} RecordPool;
+
+struct Sink;
+typedef void (*SinkHandler)(struct Sink *sink, const ReadRecord *rec);
+
+/* One consumer with its own queue and worker thread */
+typedef struct Sink
+{
+  const char *name;
+  SinkHandler handler;
+  QueuePolicy policy;
+  void *cookie;
+  RecordPool *pool;
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  ReadRecord *queue[QUEUE_LEN];
+  int head;
+  int count;
+  bool stopping;
+  /* Statistics */
+  uint64_t offered;
+  uint64_t delivered;
+  uint64_t dropped;
+  uint64_t coalesced;
+  uint64_t blockedMs;
+  int maxDepth;
+} Sink;
+
+/* Per-EPC counters kept by the counting sink */
+typedef struct EpcCount
+{
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint32_t count;
+} EpcCount;
+
+typedef struct CountTable
+{
+  EpcCount entries[MAX_COUNTED];
+  int used;
+} CountTable;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static void poolInit(RecordPool *pool)
+{
+  int i;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->free = NULL;
+  for (i = POOL_SIZE - 1; i >= 0; i--)
+  {
+    pool->records[i].nextFree = pool->free;
+    pool->free = &pool->records[i];
+  }
+  pool->exhausted = 0;
+}
+
+/* helper function to take a record from the pool, NULL if none is left */
+static ReadRecord *poolGet(RecordPool *pool, int refs)
+{
+  ReadRecord *rec;
+
+  pthread_mutex_lock(&pool->lock);
+  rec = pool->free;
+  if (NULL != rec)
+  {
+    pool->free = rec->nextFree;
+    rec->refs = refs;
+  }
+  else
+  {
+    pool->exhausted++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return rec;
+}
+
+/* helper function to drop one reference, returning the record once unused */
+static void poolRelease(RecordPool *pool, ReadRecord *rec)
+{
+  pthread_mutex_lock(&pool->lock);
+  if (0 == --rec->refs)
+  {
+    rec->nextFree = pool->free;
+    pool->free = rec;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/* Worker: run the sink's handler on every record queued for it */
+static void *sinkWorker(void *arg)
+{
+  Sink *s = arg;
+  ReadRecord *rec;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&s->lock);
+    while (0 == s->count && !s->stopping)
+    {
+      pthread_cond_wait(&s->notEmpty, &s->lock);
+    }
+    if (0 == s->count)
+    {
+      pthread_mutex_unlock(&s->lock);
+      break;
+    }
+    rec = s->queue[s->head];
+    s->head = (s->head + 1) % QUEUE_LEN;
+    s->count--;
+    pthread_cond_signal(&s->notFull);
+    pthread_mutex_unlock(&s->lock);
+
+    s->handler(s, rec);
+    s->delivered++;
+    poolRelease(s->pool, rec);
+  }
+  return NULL;
+}
+
+static void sinkStart(Sink *s, const char *name, SinkHandler handler,
+                      QueuePolicy policy, void *cookie, RecordPool *pool)
+{
+  memset(s, 0, sizeof(*s));
+  s->name = name;
+  s->handler = handler;
+  s->policy = policy;
+  s->cookie = cookie;
+  s->pool = pool;
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->notEmpty, NULL);
+  pthread_cond_init(&s->notFull, NULL);
+  if (0 != pthread_create(&s->worker, NULL, sinkWorker, s))
+  {
+    errx(1, "Can't start worker for sink %s\n", name);
+  }
+}
+
+/* helper function to let a sink drain its queue and stop its worker */
+static void sinkStop(Sink *s)
+{
+  pthread_mutex_lock(&s->lock);
+  s->stopping = true;
+  pthread_cond_broadcast(&s->notEmpty);
+  pthread_cond_broadcast(&s->notFull);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->worker, NULL);
+}
+
+/* helper function to hand a record to a sink according to its policy */
+static void sinkOffer(Sink *s, ReadRecord *rec)
+{
+  ReadRecord *victim = NULL;
+  uint64_t start;
+  int i, slot;
+
+  pthread_mutex_lock(&s->lock);
+  s->offered++;
+
+  if (POLICY_COALESCE == s->policy)
+  {
+    /* Replace the queued read of the same tag, newest data wins */
+    for (i = 0; i < s->count; i++)
+    {
+      slot = (s->head + i) % QUEUE_LEN;
+      if (s->queue[slot]->epcByteCount == rec->epcByteCount
+          && 0 == memcmp(s->queue[slot]->epc, rec->epc, rec->epcByteCount))
+      {
+        victim = s->queue[slot];
+        s->queue[slot] = rec;
+        s->coalesced++;
+        pthread_mutex_unlock(&s->lock);
+        poolRelease(s->pool, victim);
+        return;
+      }
+    }
+  }
+
+  if (QUEUE_LEN == s->count)
+  {
+    if (POLICY_BLOCK == s->policy)
+    {
+      start = tmr_gettime();
+      while (QUEUE_LEN == s->count && !s->stopping)
+      {
+        pthread_cond_wait(&s->notFull, &s->lock);
+      }
+      s->blockedMs += tmr_gettime() - start;
+    }
+    else
+    {
+      victim = s->queue[s->head];
+      s->head = (s->head + 1) % QUEUE_LEN;
+      s->count--;
+      s->dropped++;
+    }
+  }
+
+  if (QUEUE_LEN == s->count)
+  {
+    /* Stopping while blocked: nobody will take it any more */
+    s->dropped++;
+    victim = rec;
+  }
+  else
+  {
+    s->queue[(s->head + s->count) % QUEUE_LEN] = rec;
+    s->count++;
+    if (s->count > s->maxDepth)
+    {
+      s->maxDepth = s->count;
+    }
+    pthread_cond_signal(&s->notEmpty);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  if (NULL != victim)
+  {
+    poolRelease(s->pool, victim);
+  }
+}
+
+/* Sink handlers: these run on the sink workers, never on the parser thread */
+
+static void printSink(Sink *s, const ReadRecord *rec)
+{
+  char epcStr[128];
+
+  TMR_bytesToHex(rec->epc, rec->epcByteCount, epcStr);
+  printf("Background read[ant:%u rssi:%d]: %s\n", rec->antenna, rec->rssi, epcStr);
+}
+
+static void slowLogSink(Sink *s, const ReadRecord *rec)
+{
+  uint32_t *delayMs = s->cookie;
+
+  /* Stand-in for a write to a slow disk or a remote service */
+  tmr_sleep(*delayMs);
+}
+
+static void countSink(Sink *s, const ReadRecord *rec)
+{
+  CountTable *t = s->cookie;
+  int i;
+
+  for (i = 0; i < t->used; i++)
+  {
+    if (t->entries[i].epcByteCount == rec->epcByteCount
+        && 0 == memcmp(t->entries[i].epc, rec->epc, rec->epcByteCount))
+    {
+      t->entries[i].count++;
+      return;
+    }
+  }
+  if (t->used < MAX_COUNTED)
+  {
+    t->entries[t->used].epcByteCount = rec->epcByteCount;
+    memcpy(t->entries[t->used].epc, rec->epc, rec->epcByteCount);
+    t->entries[t->used].count = 1;
+    t->used++;
+  }
+}
+
+/* Everything the dispatching listener needs */
+typedef struct Dispatcher
+{
+  RecordPool pool;
+  Sink sinks[NUM_SINKS];
+  uint64_t reads;
+} Dispatcher;
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  Dispatcher *d = cookie;
+  ReadRecord *rec;
+  int i;
+
+  d->reads++;
+  rec = poolGet(&d->pool, NUM_SINKS);
+  if (NULL == rec)
+  {
+    return;
+  }
+  rec->epcByteCount = t->tag.epcByteCount;
+  memcpy(rec->epc, t->tag.epc, t->tag.epcByteCount);
+  rec->antenna = t->antenna;
+  rec->rssi = t->rssi;
+  rec->timestamp = ((uint64_t)t->timestampHigh << 32) | t->timestampLow;
+
+  for (i = 0; i < NUM_SINKS; i++)
+  {
+    sinkOffer(&d->sinks[i], rec);
+  }
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+static bool parsePolicy(const char *name, QueuePolicy *policy)
+{
+  int i;
+
+  for (i = 0; i < (int)(sizeof(policyNames)/sizeof(policyNames[0])); i++)
+  {
+    if (0 == strcmp(name, policyNames[i]))
+    {
+      *policy = (QueuePolicy)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t duration = DEFAULT_DURATION_S;
+  uint32_t slowMs = DEFAULT_SLOW_MS;
+  QueuePolicy printPolicy = POLICY_BLOCK;
+  QueuePolicy logPolicy = POLICY_DROP_OLDEST;
+  QueuePolicy countPolicy = POLICY_COALESCE;
+  Dispatcher *d;
+  CountTable *counts;
+  Sink *s;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      duration = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--slow", argv[i]))
+    {
+      slowMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--print-policy", argv[i]))
+    {
+      if (!parsePolicy(argv[i+1], &printPolicy))
+      {
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--log-policy", argv[i]))
+    {
+      if (!parsePolicy(argv[i+1], &logPolicy))
+      {
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--count-policy", argv[i]))
+    {
+      if (!parsePolicy(argv[i+1], &countPolicy))
+      {
+        usage();
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  d = calloc(1, sizeof(*d));
+  counts = calloc(1, sizeof(*counts));
+  if (NULL == d || NULL == counts)
+  {
+    errx(1, "Out of memory\n");
+  }
+  poolInit(&d->pool);
+  sinkStart(&d->sinks[0], "print", printSink, printPolicy, NULL, &d->pool);
+  sinkStart(&d->sinks[1], "log", slowLogSink, logPolicy, &slowMs, &d->pool);
+  sinkStart(&d->sinks[2], "count", countSink, countPolicy, counts, &d->pool);
+
+  rlb.listener = callback;
+  rlb.cookie = d;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  printf("Reading for %" PRIu32 " seconds\n", duration);
+  tmr_sleep(duration * 1000);
+
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+
+  for (i = 0; i < NUM_SINKS; i++)
+  {
+    sinkStop(&d->sinks[i]);
+  }
+
+  printf("\n%" PRIu64 " reads dispatched, %" PRIu32 " lost to an exhausted record pool\n",
+         d->reads, d->pool.exhausted);
+  printf("%-6s %-9s %9s %9s %9s %9s %9s %9s\n", "SINK", "POLICY", "OFFERED",
+         "DELIVERED", "DROPPED", "COALESCED", "MAXDEPTH", "BLOCKms");
+  for (i = 0; i < NUM_SINKS; i++)
+  {
+    s = &d->sinks[i];
+    printf("%-6s %-9s %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9d %9" PRIu64 "\n",
+           s->name, policyNames[s->policy], s->offered, s->delivered,
+           s->dropped, s->coalesced, s->maxDepth, s->blockedMs);
+  }
+  printf("%d distinct tags counted\n", counts->used);
+
+  TMR_destroy(rp);
+  free(counts);
+  free(d);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
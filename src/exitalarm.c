@@ -0,0 +1,1154 @@
+/**
+ * Sample program for a retail exit gate: every tag read is checked
+ * against the set of sold EPCs, and an unsold tag sounds the alarm on a
+ * GPO pin.
+ *
+ * readasyncGPIOControl.c matches reads with a linear list search under a
+ * mutex, which doesn't scale to a store's worth of sold items. Here the
+ * sold set is a sorted file of fixed-size records that is mapped into
+ * memory and binary searched, so millions of EPCs cost no heap and load
+ * instantly. The file is built with
+ *   exitalarm --build sold.txt sold.set
+ * from a text file with one EPC in hex per line. Sales made after the
+ * build are picked up from --delta, a text file the point of sale appends
+ * to ("EPC" or "+EPC" for a sale, "-EPC" for a return); it is tailed into
+ * an in-memory overlay that takes precedence over the base file.
+ *
+ * As in readasyncGPIOControl.c the GPO can't be driven from the read
+ * listener, so the listener only does the lookup and hands alarms to a
+ * dedicated alarm thread that raises the pin, holds it for --hold ms and
+ * lowers it again. Histograms of the lookup time and of the time from a
+ * read arriving on the host to the GPO being set are printed at the end.
+ * --alarm-on listed turns the check around, for a watch list.
+ * @file exitalarm.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 --set sold.set or tmr:///com4 --ant 1,2 --set sold.set --delta sales.log --gpo 1 --hold 1000\n"\
+                         "tmr://my-reader.example.com --set watch.set --alarm-on listed --duration 60000\n"\
+                         "or build a set file: --build sold.txt sold.set\n");}
+
+#define DEFAULT_GPO 1
+#define DEFAULT_HOLD_MS 1000
+#define DEFAULT_DURATION_MS 10000
+/* Overlay slots, must be a power of two; kept at most 3/4 full */
+#define OVERLAY_SIZE 65536
+/* Pending alarms between the read listener and the alarm thread */
+#define ALARM_QUEUE_SIZE 256
+/* How often the delta file is checked for new lines */
+#define DELTA_POLL_MS 100
+
+/* Set records: EPC length byte, then the EPC padded with zeros */
+#define MAX_RECORD_SIZE (1 + TMR_MAX_EPC_BYTE_COUNT)
+#define SET_MAGIC "TMEPCSET"
+
+/**
+ * Latency histograms: 8 linear sub-buckets per power of two
+ * microseconds, so percentiles are exact to within 12.5%.
+ */
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (40 * HIST_SUB)
+
+typedef struct LatencyHistogram
+{
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t maxUs;
+} LatencyHistogram;
+
+/* Header of a set file, followed by count sorted records */
+typedef struct EpcSetHeader
+{
+  char magic[8];
+  uint32_t recordSize;
+  uint32_t reserved;
+  uint64_t count;
+} EpcSetHeader;
+
+/* Read-only view of a set file */
+typedef struct EpcSet
+{
+  const uint8_t *base;
+  uint64_t size;
+  const uint8_t *records;
+  uint32_t recordSize;
+  uint64_t count;
+} EpcSet;
+
+typedef enum OverlayState
+{
+  OVERLAY_EMPTY = 0,
+  OVERLAY_SOLD,
+  OVERLAY_RETURNED
+} OverlayState;
+
+typedef struct OverlayEntry
+{
+  uint8_t state;
+  uint8_t record[MAX_RECORD_SIZE];
+} OverlayEntry;
+
+/* Changes since the set file was built, they win over the file */
+typedef struct Overlay
+{
+  pthread_rwlock_t lock;
+  OverlayEntry *slots;
+  uint32_t used;
+  uint64_t sold;
+  uint64_t returned;
+  uint64_t rejected;
+} Overlay;
+
+typedef struct AlarmEvent
+{
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint64_t readUs;
+} AlarmEvent;
+
+/* Hand-off from the read listener to the alarm thread */
+typedef struct AlarmQueue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  AlarmEvent events[ALARM_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  bool stop;
+  /* Alarm thread state */
+  TMR_Reader *reader;
+  uint8_t gpo;
+  uint32_t holdMs;
+  bool gpoHigh;
+  uint64_t offAtUs;
+  /* Statistics */
+  uint64_t alarms;
+  uint64_t coalesced;
+  uint64_t dropped;
+  uint64_t gpoErrors;
+  LatencyHistogram toGpo;
+} AlarmQueue;
+
+/* Everything the read listener needs */
+typedef struct Gate
+{
+  EpcSet set;
+  Overlay overlay;
+  AlarmQueue alarm;
+  bool alarmOnListed;
+  uint64_t reads;
+  uint64_t flagged;
+  LatencyHistogram lookup;
+} Gate;
+
+/* Tailer of the --delta file */
+typedef struct DeltaTail
+{
+  const char *path;
+  Overlay *overlay;
+  volatile bool stop;
+} DeltaTail;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static uint64_t nowUs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* helper function to map a latency to its histogram bucket */
+static int histBucket(uint64_t us)
+{
+  int msb = 0;
+
+  if (us < HIST_SUB)
+  {
+    return (int)us;
+  }
+  while ((us >> (msb + 1)) != 0)
+  {
+    msb++;
+  }
+  /* Top HIST_SUB_BITS bits below the leading one select the sub-bucket */
+  msb = (msb - HIST_SUB_BITS + 1) * HIST_SUB
+        + (int)((us >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+  return (msb < HIST_BUCKETS) ? msb : HIST_BUCKETS - 1;
+}
+
+/* helper function to get the upper bound of a histogram bucket */
+static uint64_t histUpper(int bucket)
+{
+  int shift;
+
+  if (bucket < HIST_SUB)
+  {
+    return (uint64_t)bucket;
+  }
+  shift = bucket / HIST_SUB - 1;
+  return ((uint64_t)(HIST_SUB + bucket % HIST_SUB + 1) << shift) - 1;
+}
+
+static void histAdd(LatencyHistogram *h, uint64_t us)
+{
+  h->counts[histBucket(us)]++;
+  h->total++;
+  if (us > h->maxUs)
+  {
+    h->maxUs = us;
+  }
+}
+
+/* helper function to read a percentile (0-100) off a histogram */
+static uint64_t histPercentile(const LatencyHistogram *h, double pct)
+{
+  uint64_t rank, seen = 0;
+  int i;
+
+  if (0 == h->total)
+  {
+    return 0;
+  }
+  rank = (uint64_t)(h->total * pct / 100.0);
+  if (rank >= h->total)
+  {
+    rank = h->total - 1;
+  }
+  for (i = 0; i < HIST_BUCKETS; i++)
+  {
+    seen += h->counts[i];
+    if (seen > rank)
+    {
+      return (histUpper(i) < h->maxUs) ? histUpper(i) : h->maxUs;
+    }
+  }
+  return h->maxUs;
+}
+
+static void printHistogram(const char *name, const LatencyHistogram *h)
+{
+  printf("%-12s %8" PRIu64 " samples, p50 %" PRIu64 " us, p90 %" PRIu64
+         " us, p99 %" PRIu64 " us, max %" PRIu64 " us\n",
+         name, h->total, histPercentile(h, 50), histPercentile(h, 90),
+         histPercentile(h, 99), h->maxUs);
+}
+
+static uint32_t
+hashRecord(const uint8_t *record, uint32_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint32_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= record[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * helper function to turn an EPC into a maximum-size record. The set
+ * file compares a prefix of it, the overlay keeps it whole so a sale is
+ * never limited by the EPCs that happened to be in the set file.
+ */
+static void makeRecord(const uint8_t *epc, uint8_t len, uint8_t *record)
+{
+  memset(record, 0, MAX_RECORD_SIZE);
+  record[0] = len;
+  memcpy(record + 1, epc, len);
+}
+
+/* helper function to parse a hex EPC, returns the byte count or -1 */
+static int parseEpc(const char *hex, uint8_t *epc)
+{
+  int len = 0;
+  unsigned int byte;
+
+  while ('\0' != hex[0] && '\r' != hex[0] && '\n' != hex[0])
+  {
+    if (len >= TMR_MAX_EPC_BYTE_COUNT || 1 != sscanf(hex, "%2x", &byte)
+        || '\0' == hex[1] || '\n' == hex[1])
+    {
+      return -1;
+    }
+    epc[len++] = (uint8_t)byte;
+    hex += 2;
+  }
+  return (0 == len) ? -1 : len;
+}
+
+static uint32_t sortRecordSize;
+
+static int compareRecords(const void *a, const void *b)
+{
+  return memcmp(a, b, sortRecordSize);
+}
+
+/**
+ * Build a set file from a text file of hex EPCs. The record size is
+ * taken from the longest EPC so 96-bit EPCs cost 13 bytes each.
+ */
+static int buildSet(const char *textPath, const char *setPath)
+{
+  FILE *in, *out;
+  char line[2 * TMR_MAX_EPC_BYTE_COUNT + 8];
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint8_t *epcs = NULL, *records, *grown;
+  uint64_t count = 0, max = 0, unique = 0, i;
+  uint32_t recordSize = 1, lineNo = 0;
+  EpcSetHeader header;
+  int len;
+
+  if (NULL == (in = fopen(textPath, "r")))
+  {
+    errx(1, "Can't open %s\n", textPath);
+  }
+  /* First pass keeps the EPCs as maximum-size records */
+  while (NULL != fgets(line, sizeof(line), in))
+  {
+    lineNo++;
+    if ('#' == line[0] || '\n' == line[0] || '\r' == line[0])
+    {
+      continue;
+    }
+    if ((len = parseEpc(line, epc)) < 0)
+    {
+      errx(1, "%s:%" PRIu32 ": can't parse '%s' as an EPC in hex\n", textPath, lineNo, line);
+    }
+    if (count == max)
+    {
+      max = (0 == max) ? 65536 : 2 * max;
+      if (NULL == (grown = realloc(epcs, max * MAX_RECORD_SIZE)))
+      {
+        errx(1, "Out of memory\n");
+      }
+      epcs = grown;
+    }
+    makeRecord(epc, (uint8_t)len, epcs + count * MAX_RECORD_SIZE);
+    recordSize = ((uint32_t)len + 1 > recordSize) ? (uint32_t)len + 1 : recordSize;
+    count++;
+  }
+  fclose(in);
+
+  /* Shrink to the final record size in place, then sort and drop repeats */
+  records = epcs;
+  for (i = 0; i < count; i++)
+  {
+    memmove(records + i * recordSize, epcs + i * MAX_RECORD_SIZE, recordSize);
+  }
+  sortRecordSize = recordSize;
+  if (0 != count)
+  {
+    qsort(records, count, recordSize, compareRecords);
+  }
+  for (i = 0; i < count; i++)
+  {
+    if (0 == unique || 0 != memcmp(records + (unique - 1) * recordSize,
+                                   records + i * recordSize, recordSize))
+    {
+      memmove(records + unique * recordSize, records + i * recordSize, recordSize);
+      unique++;
+    }
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SET_MAGIC, sizeof(header.magic));
+  header.recordSize = recordSize;
+  header.count = unique;
+  if (NULL == (out = fopen(setPath, "wb"))
+      || 1 != fwrite(&header, sizeof(header), 1, out)
+      || (0 != unique && 1 != fwrite(records, unique * recordSize, 1, out))
+      || 0 != fclose(out))
+  {
+    errx(1, "Can't write %s\n", setPath);
+  }
+  printf("Wrote %" PRIu64 " EPCs (%" PRIu64 " duplicates dropped), %" PRIu32
+         " bytes each, to %s\n", unique, count - unique, recordSize, setPath);
+  free(epcs);
+  return 0;
+}
+
+/*
+ * helper function to map a set file into memory.
+ * Falls back to reading the whole file where mmap is not available.
+ */
+static bool openSet(EpcSet *set, const char *path)
+{
+  const EpcSetHeader *header;
+  struct stat st;
+  uint8_t *base;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("Can't open set file");
+    return false;
+  }
+  if (0 != fstat(fd, &st) || (uint64_t)st.st_size < sizeof(EpcSetHeader))
+  {
+    fprintf(stderr, "Can't use \"%s\": not a set file\n", path);
+    close(fd);
+    return false;
+  }
+  set->size = (uint64_t)st.st_size;
+
+#ifndef WIN32
+  base = mmap(NULL, set->size, PROT_READ, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == base)
+  {
+    perror("Can't map set file");
+    base = NULL;
+  }
+#else
+  base = malloc(set->size);
+  if (NULL != base && set->size != (uint64_t)read(fd, base, set->size))
+  {
+    perror("Can't read set file");
+    free(base);
+    base = NULL;
+  }
+#endif
+  close(fd);
+  if (NULL == base)
+  {
+    return false;
+  }
+
+  set->base = base;
+  header = (const EpcSetHeader *)base;
+  if (0 != memcmp(header->magic, SET_MAGIC, sizeof(header->magic))
+      || 0 == header->recordSize || header->recordSize > MAX_RECORD_SIZE
+      || header->count > (set->size - sizeof(EpcSetHeader)) / header->recordSize)
+  {
+    fprintf(stderr, "Can't use \"%s\": bad header or truncated\n", path);
+    return false;
+  }
+  set->records = base + sizeof(EpcSetHeader);
+  set->recordSize = header->recordSize;
+  set->count = header->count;
+#ifndef WIN32
+  /* Lookups jump around the whole file, don't let readahead guess */
+  madvise(base, set->size, MADV_RANDOM);
+#endif
+  return true;
+}
+
+static void closeSet(EpcSet *set)
+{
+  if (NULL == set->base)
+  {
+    return;
+  }
+#ifndef WIN32
+  munmap((void *)set->base, set->size);
+#else
+  free((void *)set->base);
+#endif
+  set->base = NULL;
+}
+
+static bool setContains(const EpcSet *set, const uint8_t *record)
+{
+  uint64_t lo = 0, hi = set->count, mid;
+  int cmp;
+
+  /* Longer than every EPC in the file */
+  if ((uint32_t)record[0] + 1 > set->recordSize)
+  {
+    return false;
+  }
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    cmp = memcmp(set->records + mid * set->recordSize, record, set->recordSize);
+    if (0 == cmp)
+    {
+      return true;
+    }
+    if (cmp < 0)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
+/**
+ * helper function to find a record's overlay slot, or the empty slot it
+ * would use. Past the length byte and the EPC a record is all zeros, so
+ * only that much is hashed and compared.
+ */
+static OverlayEntry *overlayFind(Overlay *o, const uint8_t *record)
+{
+  OverlayEntry *e;
+  uint32_t slot, i, used = (uint32_t)record[0] + 1;
+
+  slot = hashRecord(record, used);
+  for (i = 0; i < OVERLAY_SIZE; i++)
+  {
+    e = &o->slots[(slot + i) & (OVERLAY_SIZE - 1)];
+    if (OVERLAY_EMPTY == e->state || 0 == memcmp(e->record, record, used))
+    {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/* helper function to record a sale or a return, returns false if the overlay is full */
+static bool overlayApply(Overlay *o, const uint8_t *record, OverlayState state)
+{
+  OverlayEntry *e;
+
+  pthread_rwlock_wrlock(&o->lock);
+  e = overlayFind(o, record);
+  if (NULL != e && OVERLAY_EMPTY == e->state && o->used >= OVERLAY_SIZE / 4 * 3)
+  {
+    /* Entries are never removed, a full overlay means time to rebuild the set file */
+    e = NULL;
+  }
+  if (NULL == e)
+  {
+    o->rejected++;
+  }
+  else
+  {
+    if (OVERLAY_EMPTY == e->state)
+    {
+      memcpy(e->record, record, MAX_RECORD_SIZE);
+      o->used++;
+    }
+    e->state = (uint8_t)state;
+    if (OVERLAY_SOLD == state)
+    {
+      o->sold++;
+    }
+    else
+    {
+      o->returned++;
+    }
+  }
+  pthread_rwlock_unlock(&o->lock);
+  return NULL != e;
+}
+
+/* helper function to decide whether a tag is in the set, overlay first */
+static bool isListed(Gate *g, const uint8_t *epc, uint8_t len)
+{
+  uint8_t record[MAX_RECORD_SIZE];
+  OverlayEntry *e;
+  uint8_t state = OVERLAY_EMPTY;
+
+  makeRecord(epc, len, record);
+  /* Unlocked peek: skips the lock until the first delta line arrives */
+  if (0 != g->overlay.used)
+  {
+    pthread_rwlock_rdlock(&g->overlay.lock);
+    e = overlayFind(&g->overlay, record);
+    if (NULL != e)
+    {
+      state = e->state;
+    }
+    pthread_rwlock_unlock(&g->overlay.lock);
+  }
+  if (OVERLAY_EMPTY != state)
+  {
+    return OVERLAY_SOLD == state;
+  }
+  return setContains(&g->set, record);
+}
+
+/* helper function to apply one line of the delta file */
+static void applyDeltaLine(DeltaTail *d, const char *line)
+{
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint8_t record[MAX_RECORD_SIZE];
+  OverlayState state = OVERLAY_SOLD;
+  int len;
+
+  if ('+' == line[0] || '-' == line[0])
+  {
+    state = ('-' == line[0]) ? OVERLAY_RETURNED : OVERLAY_SOLD;
+    line++;
+  }
+  if ('#' == line[0] || '\n' == line[0] || '\r' == line[0] || '\0' == line[0])
+  {
+    return;
+  }
+  len = parseEpc(line, epc);
+  if (len < 0)
+  {
+    fprintf(stderr, "Ignoring delta line '%s'\n", line);
+    return;
+  }
+  makeRecord(epc, (uint8_t)len, record);
+  if (!overlayApply(d->overlay, record, state))
+  {
+    /* Nothing else tells the operator the gate has stopped following sales */
+    fprintf(stderr, "*** Overlay full: %s of %.*s NOT recorded, rebuild the set file with --build ***\n",
+            (OVERLAY_SOLD == state) ? "sale" : "return", 2 * len, line);
+  }
+}
+
+/**
+ * Delta tailer thread: applies the lines already in the file, then
+ * follows it like tail -f. A line is only applied once its newline has
+ * been written, so a sale being appended is never read half way.
+ */
+static void *deltaTailer(void *arg)
+{
+  DeltaTail *d = arg;
+  FILE *f = NULL;
+  char line[2 * TMR_MAX_EPC_BYTE_COUNT + 8];
+  size_t have = 0;
+
+  while (!d->stop)
+  {
+    if (NULL == f && NULL == (f = fopen(d->path, "r")))
+    {
+      tmr_sleep(DELTA_POLL_MS);
+      continue;
+    }
+    if (NULL != fgets(line + have, (int)(sizeof(line) - have), f))
+    {
+      have += strlen(line + have);
+      if ('\n' == line[have - 1] || have == sizeof(line) - 1)
+      {
+        applyDeltaLine(d, line);
+        have = 0;
+      }
+      continue;
+    }
+    clearerr(f);
+    tmr_sleep(DELTA_POLL_MS);
+  }
+  if (NULL != f)
+  {
+    fclose(f);
+  }
+  return NULL;
+}
+
+/* helper function to wait on a condition for at most the given time */
+static void condWaitUs(pthread_cond_t *cond, pthread_mutex_t *lock, uint64_t us)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += us / 1000000;
+  ts.tv_nsec += (long)(us % 1000000) * 1000;
+  if (ts.tv_nsec >= 1000000000)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  pthread_cond_timedwait(cond, lock, &ts);
+}
+
+/* helper function to drive the alarm output, called without the lock held */
+static TMR_Status setAlarmPin(AlarmQueue *a, bool high)
+{
+  TMR_GpioPin pin;
+
+  pin.id = a->gpo;
+  pin.high = high;
+  pin.output = true;
+  return TMR_gpoSet(a->reader, 1, &pin);
+}
+
+/**
+ * Alarm thread: raises the GPO for the first pending alarm, keeps it up
+ * while alarms keep coming and lowers it --hold ms after the last one.
+ * Nothing else runs on this thread, so an alarm never waits behind
+ * printing or bookkeeping of the read path.
+ */
+static void *alarmThread(void *arg)
+{
+  AlarmQueue *a = arg;
+  AlarmEvent ev;
+  char epcStr[128];
+  uint64_t now, latency;
+  TMR_Status ret;
+
+  pthread_mutex_lock(&a->lock);
+  while (!a->stop)
+  {
+    if (a->head == a->tail)
+    {
+      if (!a->gpoHigh)
+      {
+        pthread_cond_wait(&a->wake, &a->lock);
+        continue;
+      }
+      now = nowUs();
+      if (now < a->offAtUs)
+      {
+        condWaitUs(&a->wake, &a->lock, a->offAtUs - now);
+        continue;
+      }
+      a->gpoHigh = false;
+      pthread_mutex_unlock(&a->lock);
+      ret = setAlarmPin(a, false);
+      pthread_mutex_lock(&a->lock);
+      if (TMR_SUCCESS != ret)
+      {
+        a->gpoErrors++;
+      }
+      continue;
+    }
+
+    ev = a->events[a->head];
+    a->head = (a->head + 1) % ALARM_QUEUE_SIZE;
+    if (a->gpoHigh)
+    {
+      /* Already sounding, just keep it on longer */
+      a->coalesced++;
+      a->offAtUs = nowUs() + (uint64_t)a->holdMs * 1000;
+      continue;
+    }
+
+    a->gpoHigh = true;
+    pthread_mutex_unlock(&a->lock);
+    ret = setAlarmPin(a, true);
+    now = nowUs();
+    latency = now - ev.readUs;
+    TMR_bytesToHex(ev.epc, ev.epcByteCount, epcStr);
+    if (TMR_SUCCESS != ret)
+    {
+      printf("Error setting GPO %u for %s: %s\n", a->gpo, epcStr, TMR_strerr(a->reader, ret));
+    }
+    else
+    {
+      printf("ALARM EPC:%s read to GPO %.3f ms\n", epcStr, latency / 1000.0);
+    }
+    pthread_mutex_lock(&a->lock);
+    if (TMR_SUCCESS != ret)
+    {
+      a->gpoErrors++;
+      a->gpoHigh = false;
+    }
+    else
+    {
+      a->alarms++;
+      histAdd(&a->toGpo, latency);
+    }
+    a->offAtUs = now + (uint64_t)a->holdMs * 1000;
+  }
+  pthread_mutex_unlock(&a->lock);
+
+  if (a->gpoHigh)
+  {
+    setAlarmPin(a, false);
+  }
+  return NULL;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  Gate *g = cookie;
+  AlarmQueue *a = &g->alarm;
+  uint64_t readUs;
+  uint32_t next;
+  bool listed;
+
+  readUs = nowUs();
+  listed = isListed(g, t->tag.epc, t->tag.epcByteCount);
+  histAdd(&g->lookup, nowUs() - readUs);
+  g->reads++;
+
+  if (listed != g->alarmOnListed)
+  {
+    return;
+  }
+  g->flagged++;
+
+  pthread_mutex_lock(&a->lock);
+  next = (a->tail + 1) % ALARM_QUEUE_SIZE;
+  if (next == a->head)
+  {
+    a->dropped++;
+  }
+  else
+  {
+    a->events[a->tail].epcByteCount = t->tag.epcByteCount;
+    memcpy(a->events[a->tail].epc, t->tag.epc, t->tag.epcByteCount);
+    a->events[a->tail].readUs = readUs;
+    a->tail = next;
+    pthread_cond_signal(&a->wake);
+  }
+  pthread_mutex_unlock(&a->lock);
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  const char *setPath = NULL;
+  const char *deltaPath = NULL;
+  uint32_t durationMs = DEFAULT_DURATION_MS;
+  pthread_t alarmTid, deltaTid;
+  DeltaTail delta;
+  Gate *g;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+  if (0x00 == strcmp("--build", argv[1]))
+  {
+    if (4 != argc)
+    {
+      usage();
+    }
+    return buildSet(argv[2], argv[3]);
+  }
+
+  g = calloc(1, sizeof(*g));
+  if (NULL == g)
+  {
+    errx(1, "Out of memory\n");
+  }
+  g->alarm.gpo = DEFAULT_GPO;
+  g->alarm.holdMs = DEFAULT_HOLD_MS;
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--set", argv[i]))
+    {
+      setPath = argv[i+1];
+    }
+    else if (0x00 == strcmp("--delta", argv[i]))
+    {
+      deltaPath = argv[i+1];
+    }
+    else if (0x00 == strcmp("--gpo", argv[i]))
+    {
+      g->alarm.gpo = (uint8_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--hold", argv[i]))
+    {
+      g->alarm.holdMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--alarm-on", argv[i]))
+    {
+      if (0x00 == strcmp("listed", argv[i+1]))
+      {
+        g->alarmOnListed = true;
+      }
+      else if (0x00 != strcmp("unsold", argv[i+1]))
+      {
+        errx(1, "--alarm-on must be unsold or listed\n");
+      }
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      durationMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+  if (NULL == setPath)
+  {
+    fprintf(stdout, "Missing --set\n");
+    usage();
+  }
+
+  if (!openSet(&g->set, setPath))
+  {
+    errx(1, "Can't load set file %s\n", setPath);
+  }
+  g->overlay.slots = calloc(OVERLAY_SIZE, sizeof(OverlayEntry));
+  if (NULL == g->overlay.slots)
+  {
+    errx(1, "Out of memory\n");
+  }
+  pthread_rwlock_init(&g->overlay.lock, NULL);
+  printf("Loaded %" PRIu64 " EPCs from %s\n", g->set.count, setPath);
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  /* Start with the alarm off */
+  g->alarm.reader = rp;
+  ret = setAlarmPin(&g->alarm, false);
+  checkerr(rp, ret, 1, "clearing the alarm GPO");
+
+  pthread_mutex_init(&g->alarm.lock, NULL);
+  pthread_cond_init(&g->alarm.wake, NULL);
+  if (0 != pthread_create(&alarmTid, NULL, alarmThread, &g->alarm))
+  {
+    errx(1, "Can't start the alarm thread\n");
+  }
+
+  if (NULL != deltaPath)
+  {
+    delta.path = deltaPath;
+    delta.overlay = &g->overlay;
+    delta.stop = false;
+    if (0 != pthread_create(&deltaTid, NULL, deltaTailer, &delta))
+    {
+      errx(1, "Can't start the delta tailer\n");
+    }
+  }
+
+  rlb.listener = callback;
+  rlb.cookie = g;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  tmr_sleep(durationMs);
+
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+
+  pthread_mutex_lock(&g->alarm.lock);
+  g->alarm.stop = true;
+  pthread_cond_signal(&g->alarm.wake);
+  pthread_mutex_unlock(&g->alarm.lock);
+  pthread_join(alarmTid, NULL);
+  if (NULL != deltaPath)
+  {
+    delta.stop = true;
+    pthread_join(deltaTid, NULL);
+  }
+
+  printf("\n%" PRIu64 " reads, %" PRIu64 " flagged, %" PRIu64 " alarms raised, %"
+         PRIu64 " coalesced into a running alarm, %" PRIu64 " dropped, %" PRIu64 " GPO errors\n",
+         g->reads, g->flagged, g->alarm.alarms, g->alarm.coalesced,
+         g->alarm.dropped, g->alarm.gpoErrors);
+  printf("Set: %" PRIu64 " EPCs mapped, overlay %" PRIu64 " sales / %" PRIu64
+         " returns (%" PRIu32 " tags, %" PRIu64 " rejected)\n",
+         g->set.count, g->overlay.sold, g->overlay.returned, g->overlay.used,
+         g->overlay.rejected);
+  printHistogram("lookup", &g->lookup);
+  printHistogram("read to GPO", &g->alarm.toGpo);
+
+  TMR_destroy(rp);
+  pthread_cond_destroy(&g->alarm.wake);
+  pthread_mutex_destroy(&g->alarm.lock);
+  pthread_rwlock_destroy(&g->overlay.lock);
+  free(g->overlay.slots);
+  closeSet(&g->set);
+  free(g);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
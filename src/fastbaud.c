@@ -0,0 +1,367 @@
+/**
+ * Sample program that connects at the last known-good baud rate and
+ * then raises the serial link to the fastest rate that passes a
+ * throughput check.
+ *
+ * The baud rate that worked last time is kept in a local cache file,
+ * keyed on the reader URI. It is tried first on connect, ahead of the
+ * default probe list. After connecting, the sample steps through the
+ * rates above the current one, fastest first, up to --maxbaud (the
+ * limit of the host UART). Each candidate is verified with a burst of
+ * round trips to the module and kept only if its average round trip
+ * beats the starting rate's; behind a USB serial bridge a faster UART
+ * often gains nothing. If a rate fails verification, the sample
+ * reconnects and restores the last working rate. The chosen rate is
+ * written back to the cache.
+ * @file fastbaud.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --maxbaud 460800 --cache file\n");}
+
+#define DEFAULT_CACHE_FILE "reader_baudrate.cache"
+#define DEFAULT_MAX_BAUDRATE 921600
+#define MAX_CACHE_ENTRIES 64
+
+/* Number of round trips used to verify a baud rate */
+#define VERIFY_ROUND_TRIPS 20
+
+/* Rates the module supports, fastest first */
+static const uint32_t candidateRates[] =
+{
+  921600, 460800, 230400, 115200, 57600, 38400, 19200, 9600
+};
+#define NUM_CANDIDATE_RATES (sizeof(candidateRates)/sizeof(candidateRates[0]))
+
+typedef struct BaudCacheEntry
+{
+  char uri[TMR_MAX_READER_NAME_LENGTH];
+  uint32_t baudRate;
+} BaudCacheEntry;
+
+typedef struct BaudCache
+{
+  BaudCacheEntry entries[MAX_CACHE_ENTRIES];
+  uint32_t count;
+} BaudCache;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void loadCache(BaudCache *cache, const char *path)
+{
+  FILE *fp;
+  BaudCacheEntry *e;
+
+  cache->count = 0;
+  fp = fopen(path, "r");
+  if (NULL == fp)
+  {
+    return;
+  }
+  while (cache->count < MAX_CACHE_ENTRIES)
+  {
+    e = &cache->entries[cache->count];
+    if (2 != fscanf(fp, "%63s %"SCNu32, e->uri, &e->baudRate))
+    {
+      break;
+    }
+    cache->count++;
+  }
+  fclose(fp);
+}
+
+void saveCache(BaudCache *cache, const char *path, const char *uri, uint32_t baudRate)
+{
+  FILE *fp;
+  uint32_t i;
+
+  for (i = 0; i < cache->count; i++)
+  {
+    if (0 == strcmp(uri, cache->entries[i].uri))
+    {
+      break;
+    }
+  }
+  if (i == cache->count)
+  {
+    if (cache->count == MAX_CACHE_ENTRIES)
+    {
+      i = 0;
+    }
+    else
+    {
+      cache->count++;
+    }
+    snprintf(cache->entries[i].uri, sizeof(cache->entries[i].uri), "%s", uri);
+  }
+  cache->entries[i].baudRate = baudRate;
+
+  fp = fopen(path, "w");
+  if (NULL == fp)
+  {
+    fprintf(stdout, "Can't write baud rate cache %s\n", path);
+    return;
+  }
+  for (i = 0; i < cache->count; i++)
+  {
+    fprintf(fp, "%s %"PRIu32"\n", cache->entries[i].uri, cache->entries[i].baudRate);
+  }
+  fclose(fp);
+}
+
+/**
+ * helper function to create and connect the reader, trying the cached
+ * rate before the rest of the probe list.
+ */
+TMR_Status connectReader(TMR_Reader *rp, const char *uri, uint32_t knownRate)
+{
+  TMR_Status ret;
+  TMR_uint32List probeList;
+  uint32_t rates[TMR_MAX_PROBE_BAUDRATE_LENGTH];
+  uint32_t i;
+
+  ret = TMR_create(rp, uri);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+  if (0 != knownRate)
+  {
+    probeList.list = rates;
+    probeList.max = TMR_MAX_PROBE_BAUDRATE_LENGTH;
+    probeList.len = 0;
+    rates[probeList.len++] = knownRate;
+    for (i = 0; (i < NUM_CANDIDATE_RATES) && (probeList.len < probeList.max); i++)
+    {
+      if (candidateRates[i] != knownRate)
+      {
+        rates[probeList.len++] = candidateRates[i];
+      }
+    }
+    ret = TMR_paramSet(rp, TMR_PARAM_PROBEBAUDRATES, &probeList);
+    if (TMR_SUCCESS != ret)
+    {
+      return ret;
+    }
+    ret = TMR_paramSet(rp, TMR_PARAM_BAUDRATE, &knownRate);
+    if (TMR_SUCCESS != ret)
+    {
+      return ret;
+    }
+  }
+
+  return TMR_connect(rp);
+}
+
+/**
+ * helper function to check the link with a burst of round trips.
+ * Returns the average round trip time in microseconds in *rtt.
+ */
+TMR_Status verifyLink(TMR_Reader *rp, uint32_t *rtt)
+{
+  TMR_Status ret;
+  TMR_uint32List hopTable;
+  uint32_t hops[64];
+  int8_t temperature;
+  uint64_t start;
+  int i;
+
+  hopTable.list = hops;
+  hopTable.max = sizeof(hops)/sizeof(hops[0]);
+
+  start = tmr_gettime();
+  for (i = 0; i < VERIFY_ROUND_TRIPS; i++)
+  {
+    /* Alternate a short and a long response */
+    if (i & 1)
+    {
+      hopTable.len = 0;
+      ret = TMR_paramGet(rp, TMR_PARAM_REGION_HOPTABLE, &hopTable);
+    }
+    else
+    {
+      ret = TMR_paramGet(rp, TMR_PARAM_RADIO_TEMPERATURE, &temperature);
+    }
+    if (TMR_SUCCESS != ret)
+    {
+      return ret;
+    }
+  }
+  *rtt = (uint32_t)((tmr_gettime() - start) * 1000 / VERIFY_ROUND_TRIPS);
+  return TMR_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  static BaudCache cache;
+  const char *cacheFile = DEFAULT_CACHE_FILE;
+  uint32_t maxRate = DEFAULT_MAX_BAUDRATE;
+  uint32_t knownRate = 0;
+  uint32_t currentRate, rate, rtt, baseRtt;
+  uint64_t start;
+  uint32_t i;
+  int j;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (j = 2; j < argc; j+=2)
+  {
+    if (j + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[j]);
+      usage();
+    }
+    if (0x00 == strcmp("--maxbaud", argv[j]))
+    {
+      if (1 != sscanf(argv[j+1], "%"SCNu32, &maxRate))
+      {
+        fprintf(stdout, "Can't parse '%s' as a baud rate\n", argv[j+1]);
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--cache", argv[j]))
+    {
+      cacheFile = argv[j+1];
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[j]);
+      usage();
+    }
+  }
+
+  loadCache(&cache, cacheFile);
+  for (i = 0; i < cache.count; i++)
+  {
+    if (0 == strcmp(argv[1], cache.entries[i].uri))
+    {
+      knownRate = cache.entries[i].baudRate;
+      printf("Trying last known-good baud rate %"PRIu32"\n", knownRate);
+    }
+  }
+
+  rp = &r;
+  start = tmr_gettime();
+  ret = connectReader(rp, argv[1], knownRate);
+  checkerr(rp, ret, 1, "connecting reader");
+  if (TMR_READER_TYPE_SERIAL != rp->readerType)
+  {
+    errx(1, "Error: This codelet works only on serial readers\n");
+  }
+
+#if USE_TRANSPORT_LISTENER
+  tb.listener = serialPrinter;
+  tb.cookie = stdout;
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_paramGet(rp, TMR_PARAM_BAUDRATE, &currentRate);
+  checkerr(rp, ret, 1, "getting baud rate");
+  printf("Connected at %"PRIu32" baud in %"PRIu64" ms\n", currentRate, tmr_gettime() - start);
+
+  ret = verifyLink(rp, &baseRtt);
+  checkerr(rp, ret, 1, "verifying link");
+  printf("  average round trip %"PRIu32" us\n", baseRtt);
+
+  /* Try the faster rates, fastest first, and keep the first that pays off */
+  for (i = 0; i < NUM_CANDIDATE_RATES; i++)
+  {
+    rate = candidateRates[i];
+    if ((rate > maxRate) || (rate <= currentRate))
+    {
+      continue;
+    }
+
+    printf("Trying %"PRIu32" baud\n", rate);
+    ret = TMR_paramSet(rp, TMR_PARAM_BAUDRATE, &rate);
+    if (TMR_SUCCESS == ret)
+    {
+      ret = verifyLink(rp, &rtt);
+    }
+    if (TMR_SUCCESS == ret)
+    {
+      printf("  average round trip %"PRIu32" us\n", rtt);
+      if (rtt < baseRtt)
+      {
+        currentRate = rate;
+        break;
+      }
+      printf("  no faster than %"PRIu32" baud, switching back\n", currentRate);
+      ret = TMR_paramSet(rp, TMR_PARAM_BAUDRATE, &currentRate);
+      if (TMR_SUCCESS == ret)
+      {
+        continue;
+      }
+    }
+
+    /* The module may already have switched, reconnect at the old rate */
+    printf("  failed: %s\n", TMR_strerr(rp, ret));
+    TMR_destroy(rp);
+    ret = connectReader(rp, argv[1], currentRate);
+    checkerr(rp, ret, 1, "reconnecting reader");
+    ret = TMR_paramSet(rp, TMR_PARAM_BAUDRATE, &currentRate);
+    checkerr(rp, ret, 1, "restoring baud rate");
+  }
+
+  printf("Using %"PRIu32" baud\n", currentRate);
+  saveCache(&cache, cacheFile, argv[1], currentRate);
+
+  TMR_destroy(rp);
+  return 0;
+}
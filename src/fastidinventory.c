@@ -0,0 +1,615 @@
+/**
+ * Sample program that inventories tags by their TID rather than their
+ * EPC, without a separate TID read per tag.
+ *
+ * The read plan has two parts. The first sends the Impinj FastID select
+ * (as in fastid.c), which makes Monza tags backscatter their TID right
+ * after the EPC. The reply is split back into the EPC and the 96-bit
+ * TID. The second part covers every chip whose TID does not carry the
+ * Impinj mask designer ID, and reads the TID as an embedded tagop.
+ *
+ * The FastID select is inverted, so the first part inventories every
+ * tag, and a chip without FastID answers it with a plain EPC. The tag
+ * API takes a single select per subplan, so that can't be narrowed to
+ * Impinj chips; instead a plain EPC is looked up in the table, where a
+ * non-Impinj chip is already known from its embedded read. Only an EPC
+ * that is still unknown after the round (e.g. an older Monza that
+ * ignores FastID) gets a standalone ReadData for its TID.
+ *
+ * Reads are deduplicated in a table keyed on TID. A TID that turns up
+ * with a different EPC than before is reported, since a rewritten or
+ * cloned EPC is exactly what identity checks are for.
+ * @file fastidinventory.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --rounds 10\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+/* FastID appends the 96-bit TID to the EPC */
+#define FASTID_TID_BYTES 12
+#define TID_WORDS 6
+#define IMPINJ_MDID 0x001
+/* Number of dedup table slots, must be a power of two */
+#define TID_TABLE_SIZE 4096
+/* EPC index slots; entries go stale on EPC changes, so twice the table */
+#define EPC_INDEX_SIZE (2 * TID_TABLE_SIZE)
+#define MAX_PENDING 32
+#define DEFAULT_ROUNDS 10
+#define ROUND_TIMEOUT 500
+
+typedef enum TidSource
+{
+  TID_FROM_FASTID,
+  TID_FROM_EMBEDDED,
+  TID_FROM_TAGOP,
+} TidSource;
+
+static const char *sourceNames[] = { "fastid", "embedded", "tagop" };
+
+typedef struct TidEntry
+{
+  bool used;
+  uint8_t tidLen;
+  uint8_t tid[FASTID_TID_BYTES];
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  TidSource source;
+  uint32_t readCount;
+  uint64_t firstSeen;
+  uint64_t lastSeen;
+} TidEntry;
+
+typedef struct TidTable
+{
+  TidEntry entries[TID_TABLE_SIZE];
+  /* Entry index + 1 by EPC hash, 0 for an empty slot */
+  uint16_t epcIndex[EPC_INDEX_SIZE];
+  uint32_t count;
+  uint32_t epcChanges;
+} TidTable;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* Mask designer ID of an E2 class TID, or -1 for anything else */
+static int
+tidMaskDesigner(const uint8_t *tid, uint8_t len)
+{
+  if ((len < 3) || (0xE2 != tid[0]))
+  {
+    return -1;
+  }
+  return ((tid[1] & 0x1F) << 4) | (tid[2] >> 4);
+}
+
+static uint32_t
+hashTid(const uint8_t *tid, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= tid[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * helper function to index an entry under its current EPC. A slot left
+ * behind by an earlier EPC stays, and lookups skip it because the entry
+ * no longer matches.
+ */
+static void
+indexEpc(TidTable *table, uint32_t entry)
+{
+  const TidEntry *e = &table->entries[entry];
+  uint32_t i, slot;
+
+  slot = hashTid(e->epc, e->epcByteCount);
+  for (i = 0; i < EPC_INDEX_SIZE; i++)
+  {
+    uint16_t *s = &table->epcIndex[(slot + i) & (EPC_INDEX_SIZE - 1)];
+
+    if ((0 == *s) || (entry + 1 == *s))
+    {
+      *s = (uint16_t)(entry + 1);
+      return;
+    }
+  }
+}
+
+/**
+ * helper function to find the entry a tag's EPC currently belongs to,
+ * or NULL if its TID isn't known yet.
+ */
+static TidEntry *
+findEpc(TidTable *table, const uint8_t *epc, uint8_t epcLen)
+{
+  uint32_t i, slot;
+
+  slot = hashTid(epc, epcLen);
+  for (i = 0; i < EPC_INDEX_SIZE; i++)
+  {
+    uint16_t s = table->epcIndex[(slot + i) & (EPC_INDEX_SIZE - 1)];
+    TidEntry *e;
+
+    if (0 == s)
+    {
+      return NULL;
+    }
+    e = &table->entries[s - 1];
+    if ((e->epcByteCount == epcLen) && (0 == memcmp(e->epc, epc, epcLen)))
+    {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * helper function to record one identified tag in the dedup table.
+ * Returns true the first time a TID is seen.
+ */
+static bool
+recordTid(TidTable *table, const uint8_t *tid, uint8_t tidLen, const uint8_t *epc,
+          uint8_t epcLen, TidSource source, uint64_t now)
+{
+  uint32_t i, slot, entry;
+  TidEntry *e;
+  char tidStr[2 * FASTID_TID_BYTES + 1], oldStr[128], newStr[128];
+
+  slot = hashTid(tid, tidLen);
+  for (i = 0; i < TID_TABLE_SIZE; i++)
+  {
+    entry = (slot + i) & (TID_TABLE_SIZE - 1);
+    e = &table->entries[entry];
+    if (!e->used)
+    {
+      e->used = true;
+      e->tidLen = tidLen;
+      memcpy(e->tid, tid, tidLen);
+      e->epcByteCount = epcLen;
+      memcpy(e->epc, epc, epcLen);
+      e->source = source;
+      e->readCount = 1;
+      e->firstSeen = e->lastSeen = now;
+      table->count++;
+      indexEpc(table, entry);
+      return true;
+    }
+    if ((e->tidLen == tidLen) && (0 == memcmp(e->tid, tid, tidLen)))
+    {
+      if ((e->epcByteCount != epcLen) || (0 != memcmp(e->epc, epc, epcLen)))
+      {
+        TMR_bytesToHex(tid, tidLen, tidStr);
+        TMR_bytesToHex(e->epc, e->epcByteCount, oldStr);
+        TMR_bytesToHex(epc, epcLen, newStr);
+        printf("TID %s changed EPC from %s to %s\n", tidStr, oldStr, newStr);
+        e->epcByteCount = epcLen;
+        memcpy(e->epc, epc, epcLen);
+        table->epcChanges++;
+        indexEpc(table, entry);
+      }
+      e->readCount++;
+      e->lastSeen = now;
+      return false;
+    }
+  }
+  fprintf(stdout, "TID table full\n");
+  return false;
+}
+
+/**
+ * helper function to build the two part read plan: FastID for Impinj
+ * chips, embedded TID read for all other chips.
+ */
+static TMR_Status
+setFastIdPlan(TMR_Reader *rp, uint8_t antennaCount, uint8_t *antennaList)
+{
+  static TMR_ReadPlan plan, subplans[2];
+  static TMR_ReadPlan *subplanPtrs[2];
+  static TMR_TagFilter fastIdFilter, otherChipFilter;
+  static TMR_TagOp readTid;
+  static uint8_t fastIdMask[] = { 0x20, 0x01, 0xB0, 0x00 };
+  /* The MDID field starts at TID bit 11 */
+  static uint8_t impinjMask[] = { (IMPINJ_MDID >> 1) & 0xFF, (IMPINJ_MDID & 0x01) << 7 };
+  TMR_Status ret;
+
+  ret = TMR_RP_init_simple(&subplans[0], antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  ret = TMR_TF_init_gen2_select(&fastIdFilter, true, TMR_GEN2_BANK_TID, 0x04, 0x16, fastIdMask);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  TMR_RP_set_filter(&subplans[0], &fastIdFilter);
+
+  ret = TMR_RP_init_simple(&subplans[1], antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  ret = TMR_TF_init_gen2_select(&otherChipFilter, true, TMR_GEN2_BANK_TID, 11, 9, impinjMask);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  TMR_RP_set_filter(&subplans[1], &otherChipFilter);
+  ret = TMR_TagOp_init_GEN2_ReadData(&readTid, TMR_GEN2_BANK_TID, 0, TID_WORDS);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  TMR_RP_set_tagop(&subplans[1], &readTid);
+
+  subplanPtrs[0] = &subplans[0];
+  subplanPtrs[1] = &subplans[1];
+  ret = TMR_RP_init_multi(&plan, subplanPtrs, 2, 0);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  return TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t rounds = DEFAULT_ROUNDS, round, j;
+  static TidTable table;
+  TMR_TagData pending[MAX_PENDING];
+  uint32_t pendingCount;
+  uint32_t reads = 0, fastIdReads = 0, embeddedReads = 0, tagopReads = 0, unidentified = 0;
+  uint64_t start, now;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--rounds", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNu32, &rounds))
+      {
+        fprintf(stdout, "Can't parse '%s' as a round count\n", argv[i+1]);
+        usage();
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+  //Use first antenna for operation
+  if (NULL != antennaList)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_TAGOP_ANTENNA, &antennaList[0]);
+    checkerr(rp, ret, 1, "setting tagop antenna");
+  }
+
+  /* FastID reads in session S2, as in fastid.c */
+  {
+    TMR_GEN2_Session session = TMR_GEN2_SESSION_S2;
+
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_SESSION, &session);
+    checkerr(rp, ret, 1, "setting session to S2");
+  }
+
+  ret = setFastIdPlan(rp, antennaCount, antennaList);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  start = tmr_gettime();
+  for (round = 0; round < rounds; round++)
+  {
+    pendingCount = 0;
+    ret = TMR_read(rp, ROUND_TIMEOUT, NULL);
+    if (TMR_ERROR_TAG_ID_BUFFER_FULL == ret)
+    {
+      /* In case of TAG ID Buffer Full, extract the tags present
+      * in buffer.
+      */
+      fprintf(stdout, "reading tags:%s\n", TMR_strerr(rp, ret));
+    }
+    else
+    {
+      checkerr(rp, ret, 1, "reading tags");
+    }
+
+    now = tmr_gettime();
+    while (TMR_SUCCESS == TMR_hasMoreTags(rp))
+    {
+      TMR_TagReadData trd;
+      uint8_t dataBuf[32];
+      const uint8_t *tail;
+      uint8_t epcLen;
+      TidEntry *known;
+
+      ret = TMR_TRD_init_data(&trd, sizeof(dataBuf)/sizeof(uint8_t), dataBuf);
+      checkerr(rp, ret, 1, "creating tag read data");
+      ret = TMR_getNextTag(rp, &trd);
+      checkerr(rp, ret, 1, "fetching tag");
+      reads++;
+
+      /* Embedded TID read from a non-Impinj chip */
+      if (2 * TID_WORDS <= trd.data.len)
+      {
+        embeddedReads++;
+        recordTid(&table, trd.data.list, FASTID_TID_BYTES, trd.tag.epc, trd.tag.epcByteCount,
+                  TID_FROM_EMBEDDED, now);
+        continue;
+      }
+
+      /* FastID reply: EPC followed by the Impinj TID */
+      if (trd.tag.epcByteCount > FASTID_TID_BYTES)
+      {
+        epcLen = trd.tag.epcByteCount - FASTID_TID_BYTES;
+        tail = trd.tag.epc + epcLen;
+        if (IMPINJ_MDID == tidMaskDesigner(tail, FASTID_TID_BYTES))
+        {
+          fastIdReads++;
+          recordTid(&table, tail, FASTID_TID_BYTES, trd.tag.epc, epcLen, TID_FROM_FASTID, now);
+          continue;
+        }
+      }
+
+      /**
+       * Plain EPC from the FastID part: a non-Impinj chip, normally also
+       * read with its TID by the embedded part, or an Impinj chip that
+       * ignored FastID. Hold it until the round is done.
+       */
+      known = findEpc(&table, trd.tag.epc, trd.tag.epcByteCount);
+      if (NULL != known)
+      {
+        /* Embedded reads count themselves; tagop entries only show up here */
+        if (TID_FROM_TAGOP == known->source)
+        {
+          known->readCount++;
+          known->lastSeen = now;
+        }
+        continue;
+      }
+      for (j = 0; j < pendingCount; j++)
+      {
+        if ((pending[j].epcByteCount == trd.tag.epcByteCount)
+            && (0 == memcmp(pending[j].epc, trd.tag.epc, trd.tag.epcByteCount)))
+        {
+          break;
+        }
+      }
+      if ((j == pendingCount) && (pendingCount < MAX_PENDING))
+      {
+        pending[pendingCount++] = trd.tag;
+      }
+    }
+
+    for (j = 0; j < pendingCount; j++)
+    {
+      TMR_TagOp op;
+      TMR_TagFilter filter;
+      TMR_uint8List tidData;
+      uint8_t tidBuf[2 * TID_WORDS];
+
+      /* Identified by an embedded read later in the same round */
+      if (NULL != findEpc(&table, pending[j].epc, pending[j].epcByteCount))
+      {
+        continue;
+      }
+      tidData.list = tidBuf;
+      tidData.max = sizeof(tidBuf);
+      tidData.len = 0;
+      TMR_TF_init_tag(&filter, &pending[j]);
+      ret = TMR_TagOp_init_GEN2_ReadData(&op, TMR_GEN2_BANK_TID, 0, TID_WORDS);
+      checkerr(rp, ret, 1, "initializing ReadData");
+      ret = TMR_executeTagOp(rp, &op, &filter, &tidData);
+      if ((TMR_SUCCESS != ret) || (tidData.len < sizeof(tidBuf)))
+      {
+        unidentified++;
+        continue;
+      }
+      tagopReads++;
+      recordTid(&table, tidData.list, FASTID_TID_BYTES, pending[j].epc, pending[j].epcByteCount,
+                TID_FROM_TAGOP, now);
+    }
+  }
+
+  for (j = 0; j < TID_TABLE_SIZE; j++)
+  {
+    TidEntry *e = &table.entries[j];
+    char tidStr[2 * FASTID_TID_BYTES + 1], epcStr[128];
+
+    if (!e->used)
+    {
+      continue;
+    }
+    TMR_bytesToHex(e->tid, e->tidLen, tidStr);
+    TMR_bytesToHex(e->epc, e->epcByteCount, epcStr);
+    printf("TID %s EPC %s (%s) reads %"PRIu32"\n", tidStr, epcStr, sourceNames[e->source], e->readCount);
+  }
+  printf("%"PRIu32" unique TIDs from %"PRIu32" reads in %"PRIu64" ms: %"PRIu32" FastID, %"PRIu32" embedded, "
+         "%"PRIu32" extra tagops, %"PRIu32" unidentified, %"PRIu32" EPC changes\n",
+         table.count, reads, tmr_gettime() - start, fastIdReads, embeddedReads, tagopReads, unidentified,
+         table.epcChanges);
+
+  TMR_destroy(rp);
+  return 0;
+}
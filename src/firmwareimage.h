@@ -0,0 +1,80 @@
+#ifndef _FIRMWAREIMAGE_H
+#define _FIRMWAREIMAGE_H
+/**
+ * Firmware image checks shared by the firmware samples, so an image is
+ * judged the same way whether it goes to one reader or to a fleet.
+ * @file firmwareimage.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Firmware image header: magic followed by a big-endian image length */
+static const uint8_t imageMagic[] = {
+  0x54, 0x4D, 0x2D, 0x53, 0x50, 0x61, 0x69, 0x6B, 0x00, 0x00, 0x00, 0x02
+};
+#define IMAGE_HEADER_LEN (sizeof(imageMagic) + 4)
+
+/* helper function to compute the CRC-32 (IEEE 802.3) of a buffer */
+static uint32_t crc32(const uint8_t *data, uint32_t len)
+{
+  static uint32_t table[256];
+  static bool tableReady = false;
+  uint32_t crc, i, j;
+
+  if (false == tableReady)
+  {
+    for (i = 0; i < 256; i++)
+    {
+      crc = i;
+      for (j = 0; j < 8; j++)
+      {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+      }
+      table[i] = crc;
+    }
+    tableReady = true;
+  }
+
+  crc = 0xFFFFFFFF;
+  for (i = 0; i < len; i++)
+  {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+/*
+ * helper function to validate the image before it is sent to the module.
+ * Returns a description of the problem, or NULL if the image looks sound.
+ */
+static const char *validateImage(const uint8_t *base, uint32_t size,
+                                 bool checkCrc, uint32_t expectedCrc, uint32_t *crcOut)
+{
+  uint32_t appLen;
+
+  if (size < IMAGE_HEADER_LEN)
+  {
+    return "file is shorter than the image header";
+  }
+  if (0 != memcmp(base, imageMagic, sizeof(imageMagic)))
+  {
+    return "file is not a firmware image (bad magic)";
+  }
+  appLen = ((uint32_t)base[12] << 24) | ((uint32_t)base[13] << 16)
+         | ((uint32_t)base[14] << 8) | base[15];
+  if (0 == appLen || appLen > size - IMAGE_HEADER_LEN)
+  {
+    return "image length field does not fit the file (truncated download?)";
+  }
+
+  *crcOut = crc32(base, size);
+  if (checkCrc && *crcOut != expectedCrc)
+  {
+    return "CRC-32 does not match the expected value";
+  }
+  return NULL;
+}
+
+#endif /* _FIRMWAREIMAGE_H */
@@ -0,0 +1,572 @@
+/**
+ * Sample program to roll a firmware image out to a fleet of readers.
+ *
+ * Takes a file listing one reader URI per line, a firmware image and the
+ * target software version. The image is checked once before any reader
+ * is touched, the same way firmwareupdate.c checks it: the magic, the
+ * length field and, with --crc, the CRC-32. Readers already running the
+ * target version are skipped; the others are updated in parallel, at most --parallel at
+ * a time. Each updated reader is rebooted, reconnected and queried again
+ * (software, hardware and serial versions, as readerInfo does) to verify
+ * that it came back on the target version. A per-reader timing report is
+ * printed once the whole fleet is done.
+ * @file firmwarerollout.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+#include "firmwareimage.h"
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide a reader list, firmware image and target version, such as:\n"\
+                         "Usage: %s readerlist.txt firmwarefilename 1.21.1.2 [--crc 1a2b3c4d] [--parallel 8] [--reboot-timeout 180]\n"\
+                         "readerlist.txt holds one reader URI per line, such as:\n"\
+                         "tmr:///dev/ttyUSB0\n"\
+                         "tmr://my-reader.example.com\n", argv[0]);}
+
+#define MAX_READERS 1024
+#define MAX_URI_LEN 128
+#define VERSION_LEN 64
+#define DEFAULT_PARALLEL 8
+#define DEFAULT_REBOOT_TIMEOUT_S 180
+/* Delay between reconnect attempts while a reader reboots */
+#define RECONNECT_INTERVAL_MS 1000
+
+typedef enum JobResult
+{
+  JOB_PENDING,
+  JOB_SKIPPED,
+  JOB_UPDATED,
+  JOB_FAILED
+} JobResult;
+
+static const char *resultNames[] = { "pending", "skipped", "updated", "FAILED" };
+
+/* Everything known about one reader of the rollout */
+typedef struct ReaderJob
+{
+  char uri[MAX_URI_LEN];
+  JobResult result;
+  char oldVersion[VERSION_LEN];
+  char newVersion[VERSION_LEN];
+  char hardware[VERSION_LEN];
+  char serial[VERSION_LEN];
+  char error[96];
+  /* Phase durations in milliseconds */
+  uint32_t connectMs;
+  uint32_t loadMs;
+  uint32_t rebootMs;
+  uint32_t verifyMs;
+  uint32_t totalMs;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+} ReaderJob;
+
+/* Rollout shared by all workers */
+typedef struct Rollout
+{
+  ReaderJob *jobs;
+  int jobCount;
+  int nextJob;
+  int done;
+  pthread_mutex_t lock;
+  uint8_t *image;
+  uint32_t imageSize;
+  const char *target;
+  uint32_t rebootTimeoutMs;
+} Rollout;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+/* helper function to read the reader list, one URI per line */
+static int loadReaderList(const char *filename, ReaderJob *jobs, int max)
+{
+  FILE *f;
+  char line[MAX_URI_LEN];
+  char *p, *end;
+  int count = 0;
+
+  f = fopen(filename, "r");
+  if (NULL == f)
+  {
+    perror("Can't open reader list");
+    return -1;
+  }
+  while (NULL != fgets(line, sizeof(line), f))
+  {
+    /* Trim whitespace, skip blank lines and # comments */
+    for (p = line; ' ' == *p || '\t' == *p; p++);
+    end = p + strlen(p);
+    while (end > p && (' ' == end[-1] || '\t' == end[-1] || '\r' == end[-1] || '\n' == end[-1]))
+    {
+      *--end = '\0';
+    }
+    if ('\0' == *p || '#' == *p)
+    {
+      continue;
+    }
+    if (count == max)
+    {
+      fprintf(stderr, "Reader list truncated to %d readers\n", max);
+      break;
+    }
+    memset(&jobs[count], 0, sizeof(jobs[count]));
+    snprintf(jobs[count].uri, sizeof(jobs[count].uri), "%s", p);
+    count++;
+  }
+  fclose(f);
+  return count;
+}
+
+/* helper function to read the whole firmware image and validate it */
+static uint8_t *loadImage(const char *filename, uint32_t *size, bool checkCrc, uint32_t expectedCrc)
+{
+  FILE *f;
+  long len;
+  uint8_t *image;
+  const char *problem;
+  uint32_t crc;
+
+  f = fopen(filename, "rb");
+  if (NULL == f)
+  {
+    perror("Can't open firmware file");
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (len <= 0 || len > 0xFFFFFFFF)
+  {
+    fprintf(stderr, "Can't use \"%s\": not a regular, non-empty file\n", filename);
+    fclose(f);
+    return NULL;
+  }
+  image = malloc(len);
+  if (NULL == image || (size_t)len != fread(image, 1, len, f))
+  {
+    fprintf(stderr, "Can't read \"%s\"\n", filename);
+    free(image);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+  problem = validateImage(image, (uint32_t)len, checkCrc, expectedCrc, &crc);
+  if (NULL != problem)
+  {
+    fprintf(stderr, "\"%s\" rejected, %s\n", filename, problem);
+    free(image);
+    return NULL;
+  }
+  fprintf(stderr, "Image is %ld bytes, CRC-32 %08" PRIx32 "%s\n", len, crc, checkCrc ? " (verified)" : "");
+  *size = (uint32_t)len;
+  return image;
+}
+
+/* helper function to fetch a string parameter, "" if unavailable */
+static TMR_Status getString(TMR_Reader *rp, TMR_Param key, char *buf, int len)
+{
+  TMR_String str;
+  TMR_Status ret;
+
+  str.value = buf;
+  str.max = len;
+  buf[0] = '\0';
+  ret = TMR_paramGet(rp, key, &str);
+  if (TMR_SUCCESS != ret)
+  {
+    buf[0] = '\0';
+  }
+  else if (str.value != buf)
+  {
+    snprintf(buf, len, "%s", str.value);
+  }
+  return ret;
+}
+
+/*
+ * helper function to create and connect a reader, tolerating a corrupt
+ * application. On failure the reader is left created (when *created is
+ * set) so the caller can still fetch the error message before destroying it.
+ */
+static TMR_Status connectReader(TMR_Reader *rp, ReaderJob *job, bool *created)
+{
+  TMR_Status ret;
+
+  ret = TMR_create(rp, job->uri);
+  *created = (TMR_SUCCESS == ret);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+#if USE_TRANSPORT_LISTENER
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    job->tb.listener = serialPrinter;
+  }
+  else
+  {
+    job->tb.listener = stringPrinter;
+  }
+  job->tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &job->tb);
+#endif
+
+  ret = TMR_connect(rp);
+  if (TMR_ERROR_BL_INVALID_IMAGE_CRC == ret || TMR_ERROR_BL_INVALID_APP_END_ADDR == ret)
+  {
+    /* Sitting in the bootloader, a new image is exactly what it needs */
+    ret = TMR_SUCCESS;
+  }
+  return ret;
+}
+
+/* helper function to record a failure on a job */
+static void failJob(ReaderJob *job, TMR_Reader *rp, TMR_Status ret, const char *what)
+{
+  job->result = JOB_FAILED;
+  snprintf(job->error, sizeof(job->error), "%s: %s", what, TMR_strerr(rp, ret));
+}
+
+/* helper function to record a failed connect and release the reader */
+static void failConnect(ReaderJob *job, TMR_Reader *rp, TMR_Status ret,
+                        bool created, const char *what)
+{
+  failJob(job, rp, ret, what);
+  if (created)
+  {
+    TMR_destroy(rp);
+  }
+}
+
+/**
+ * helper function to compare a reported software version with the target.
+ * The reported string is the application version followed by '-'
+ * separated date and bootloader parts, so the target must match up to
+ * the end of the string or a '-'. Plain prefixes do not match: target
+ * 01.0B.03.1 is not 01.0B.03.11.
+ */
+static bool versionMatches(const char *version, const char *target)
+{
+  size_t len = strlen(target);
+
+  return (0 == strncmp(version, target, len))
+    && (('\0' == version[len]) || ('-' == version[len]));
+}
+
+/* Update one reader: check version, load, reboot, verify */
+static void runJob(Rollout *ro, ReaderJob *job)
+{
+  TMR_Reader r, *rp = &r;
+  TMR_Status ret;
+  TMR_memoryCookie cookie;
+  uint64_t start, t;
+  bool created;
+
+  start = t = tmr_gettime();
+  ret = connectReader(rp, job, &created);
+  job->connectMs = (uint32_t)(tmr_gettime() - t);
+  if (TMR_SUCCESS != ret)
+  {
+    failConnect(job, rp, ret, created, "connecting");
+    goto out;
+  }
+
+  getString(rp, TMR_PARAM_VERSION_SOFTWARE, job->oldVersion, sizeof(job->oldVersion));
+  if (versionMatches(job->oldVersion, ro->target))
+  {
+    snprintf(job->newVersion, sizeof(job->newVersion), "%s", job->oldVersion);
+    getString(rp, TMR_PARAM_VERSION_SERIAL, job->serial, sizeof(job->serial));
+    job->result = JOB_SKIPPED;
+    TMR_destroy(rp);
+    goto out;
+  }
+
+  /* Every job gets its own cookie over the shared, read-only image */
+  cookie.firmwareStart = ro->image;
+  cookie.firmwareSize = ro->imageSize;
+  t = tmr_gettime();
+  ret = TMR_firmwareLoad(rp, &cookie, TMR_memoryProvider);
+  job->loadMs = (uint32_t)(tmr_gettime() - t);
+  if (TMR_SUCCESS != ret)
+  {
+    failJob(job, rp, ret, "loading firmware");
+    TMR_destroy(rp);
+    goto out;
+  }
+
+  /* Reboot and wait for the reader to come back */
+  t = tmr_gettime();
+  ret = TMR_reboot(rp);
+  if (TMR_SUCCESS != ret)
+  {
+    failJob(job, rp, ret, "rebooting");
+    TMR_destroy(rp);
+    goto out;
+  }
+  TMR_destroy(rp);
+  for (;;)
+  {
+    tmr_sleep(RECONNECT_INTERVAL_MS);
+    ret = connectReader(rp, job, &created);
+    if (TMR_SUCCESS == ret || tmr_gettime() - t >= ro->rebootTimeoutMs)
+    {
+      break;
+    }
+    if (created)
+    {
+      TMR_destroy(rp);
+    }
+  }
+  job->rebootMs = (uint32_t)(tmr_gettime() - t);
+  if (TMR_SUCCESS != ret)
+  {
+    failConnect(job, rp, ret, created, "reconnecting after reboot");
+    goto out;
+  }
+
+  /* Verify with the same queries readerInfo makes */
+  t = tmr_gettime();
+  ret = getString(rp, TMR_PARAM_VERSION_SOFTWARE, job->newVersion, sizeof(job->newVersion));
+  getString(rp, TMR_PARAM_VERSION_HARDWARE, job->hardware, sizeof(job->hardware));
+  getString(rp, TMR_PARAM_VERSION_SERIAL, job->serial, sizeof(job->serial));
+  job->verifyMs = (uint32_t)(tmr_gettime() - t);
+  if (TMR_SUCCESS != ret)
+  {
+    failJob(job, rp, ret, "verifying version");
+  }
+  else if (!versionMatches(job->newVersion, ro->target))
+  {
+    job->result = JOB_FAILED;
+    snprintf(job->error, sizeof(job->error), "came back on version %s", job->newVersion);
+  }
+  else
+  {
+    job->result = JOB_UPDATED;
+  }
+  TMR_destroy(rp);
+
+out:
+  job->totalMs = (uint32_t)(tmr_gettime() - start);
+}
+
+/* Worker: keep taking the next reader of the list until none is left */
+static void *rolloutWorker(void *arg)
+{
+  Rollout *ro = arg;
+  ReaderJob *job;
+  int index;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&ro->lock);
+    index = ro->nextJob++;
+    pthread_mutex_unlock(&ro->lock);
+    if (index >= ro->jobCount)
+    {
+      break;
+    }
+    job = &ro->jobs[index];
+    runJob(ro, job);
+
+    pthread_mutex_lock(&ro->lock);
+    ro->done++;
+    fprintf(stderr, "[%d/%d] %s: %s%s%s (%" PRIu32 " ms)\n", ro->done, ro->jobCount,
+            job->uri, resultNames[job->result],
+            ('\0' != job->error[0]) ? ", " : "", job->error, job->totalMs);
+    pthread_mutex_unlock(&ro->lock);
+  }
+  return NULL;
+}
+
+/* helper function to print the per-reader timing report */
+static void printReport(Rollout *ro, uint64_t elapsed)
+{
+  int i, counts[4] = { 0, 0, 0, 0 };
+  ReaderJob *job;
+
+  printf("%-32s %-8s %-20s %-20s %-16s %8s %8s %8s %8s %8s\n",
+         "URI", "RESULT", "OLD VERSION", "NEW VERSION", "SERIAL",
+         "CONN ms", "LOAD ms", "BOOT ms", "VRFY ms", "TOTAL ms");
+  for (i = 0; i < ro->jobCount; i++)
+  {
+    job = &ro->jobs[i];
+    counts[job->result]++;
+    printf("%-32s %-8s %-20s %-20s %-16s %8" PRIu32 " %8" PRIu32 " %8" PRIu32
+           " %8" PRIu32 " %8" PRIu32 "\n",
+           job->uri, resultNames[job->result], job->oldVersion, job->newVersion,
+           job->serial, job->connectMs, job->loadMs, job->rebootMs,
+           job->verifyMs, job->totalMs);
+    if (JOB_FAILED == job->result)
+    {
+      printf("  %s\n", job->error);
+    }
+  }
+  printf("\n%d readers: %d updated, %d skipped, %d failed in %" PRIu64 " s\n",
+         ro->jobCount, counts[JOB_UPDATED], counts[JOB_SKIPPED],
+         counts[JOB_FAILED], elapsed / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+  Rollout ro;
+  pthread_t *workers;
+  int parallel = DEFAULT_PARALLEL;
+  int i, count, failed = 0;
+  uint64_t start;
+  uint32_t expectedCrc = 0;
+  bool checkCrc = false;
+
+  if (argc < 4)
+  {
+    usage();
+  }
+
+  memset(&ro, 0, sizeof(ro));
+  ro.target = argv[3];
+  ro.rebootTimeoutMs = DEFAULT_REBOOT_TIMEOUT_S * 1000;
+
+  for (i = 4; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--parallel", argv[i]))
+    {
+      parallel = atoi(argv[i+1]);
+      if (parallel < 1)
+      {
+        errx(1, "--parallel must be at least 1\n");
+      }
+    }
+    else if (0x00 == strcmp("--crc", argv[i]))
+    {
+      expectedCrc = (uint32_t)strtoul(argv[i+1], NULL, 16);
+      checkCrc = true;
+    }
+    else if (0x00 == strcmp("--reboot-timeout", argv[i]))
+    {
+      ro.rebootTimeoutMs = (uint32_t)atoi(argv[i+1]) * 1000;
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  ro.jobs = calloc(MAX_READERS, sizeof(ReaderJob));
+  if (NULL == ro.jobs)
+  {
+    errx(1, "Out of memory\n");
+  }
+  count = loadReaderList(argv[1], ro.jobs, MAX_READERS);
+  if (count <= 0)
+  {
+    errx(1, "No reader URIs in \"%s\"\n", argv[1]);
+  }
+  ro.jobCount = count;
+
+  /* A bad image must never reach any reader */
+  ro.image = loadImage(argv[2], &ro.imageSize, checkCrc, expectedCrc);
+  if (NULL == ro.image)
+  {
+    errx(1, "Rollout aborted, no reader was touched.\n");
+  }
+
+  if (parallel > count)
+  {
+    parallel = count;
+  }
+  fprintf(stderr, "Rolling out %s (%" PRIu32 " bytes) to %d readers, %d at a time\n",
+          ro.target, ro.imageSize, count, parallel);
+
+  pthread_mutex_init(&ro.lock, NULL);
+  workers = malloc(parallel * sizeof(pthread_t));
+  start = tmr_gettime();
+  for (i = 0; i < parallel; i++)
+  {
+    if (0 != pthread_create(&workers[i], NULL, rolloutWorker, &ro))
+    {
+      errx(1, "Can't start worker thread\n");
+    }
+  }
+  for (i = 0; i < parallel; i++)
+  {
+    pthread_join(workers[i], NULL);
+  }
+
+  printReport(&ro, tmr_gettime() - start);
+  for (i = 0; i < count; i++)
+  {
+    if (JOB_FAILED == ro.jobs[i].result)
+    {
+      failed++;
+    }
+  }
+
+  pthread_mutex_destroy(&ro.lock);
+  free(workers);
+  free(ro.image);
+  free(ro.jobs);
+  return (0 == failed) ? 0 : 2;
+}
@@ -0,0 +1,400 @@
+/**
+ * Sample program to update the reader firmware from a mapped image.
+ *
+ * The image file is mapped into memory and checked before the module
+ * is touched: it has to carry the firmware image magic, its length field
+ * has to fit the file, and its CRC-32 has to match the value given with
+ * --crc (when one is given). The image is then fed to TMR_firmwareLoad()
+ * straight out of the mapping, handing the loader as many bytes as it
+ * asks for on every call, while progress and throughput are printed.
+ * If the transport drops during the load, the reader is reconnected and
+ * the load is started over, up to --retries times.
+ * @file firmwareupdate.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "firmwareimage.h"
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4\n"\
+                         "tmr://my-reader.example.com\n"\
+                         "Usage: %s readeruri firmwarefilename [--crc 1a2b3c4d] [--retries 3]\n", argv[0]);}
+
+#define DEFAULT_RETRIES 3
+/* Delay before reconnecting after a transport error, doubled on every retry */
+#define RETRY_DELAY_MS 1000
+/* Reconnect attempts after each failed load, these don't count as retries */
+#define MAX_RECONNECTS 5
+/* Minimum interval between two progress lines */
+#define PROGRESS_INTERVAL_MS 250
+
+/* Firmware image mapped into memory and fed to the loader */
+typedef struct ImageCookie
+{
+  const uint8_t *base;
+  uint32_t size;
+  uint32_t offset;
+  /* Progress accounting for the current load attempt */
+  uint64_t startTime;
+  uint64_t lastReport;
+  uint32_t calls;
+  uint16_t largestChunk;
+} ImageCookie;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+/*
+ * helper function to map the image file into memory.
+ * Falls back to reading the whole file where mmap is not available.
+ */
+static const uint8_t *mapImage(const char *filename, uint32_t *size)
+{
+  struct stat st;
+  uint8_t *base;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("Can't open file");
+    return NULL;
+  }
+  if (0 != fstat(fd, &st) || 0 == st.st_size || st.st_size > 0xFFFFFFFF)
+  {
+    fprintf(stderr, "Can't use \"%s\": not a regular, non-empty file\n", filename);
+    close(fd);
+    return NULL;
+  }
+  *size = (uint32_t)st.st_size;
+
+#ifndef WIN32
+  base = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (MAP_FAILED == base)
+  {
+    perror("Can't map file");
+    base = NULL;
+  }
+#else
+  base = malloc(*size);
+  if (NULL != base && *size != (uint32_t)read(fd, base, *size))
+  {
+    perror("Can't read file");
+    free(base);
+    base = NULL;
+  }
+#endif
+  close(fd);
+  return base;
+}
+
+static void unmapImage(const uint8_t *base, uint32_t size)
+{
+#ifndef WIN32
+  munmap((void *)base, size);
+#else
+  free((void *)base);
+#endif
+}
+
+/* helper function to print one progress line for the current attempt */
+static void printProgress(ImageCookie *img, uint64_t now, bool final)
+{
+  uint64_t elapsed = now - img->startTime;
+  double rate = (0 != elapsed) ? (img->offset / 1.024) / elapsed : 0.0;
+
+  fprintf(stderr, "\r  %3u%%  %7" PRIu32 "/%" PRIu32 " bytes  %6.1f KiB/s%s",
+          (unsigned)((uint64_t)img->offset * 100 / img->size),
+          img->offset, img->size, rate, final ? "\n" : "");
+  fflush(stderr);
+}
+
+/*
+ * Firmware data provider reading from the mapped image.
+ * Every request is satisfied in full, so the loader always gets chunks
+ * as large as it is able to send to the bootloader.
+ */
+static bool mappedProvider(void *cookie, uint16_t *size, uint8_t *data)
+{
+  ImageCookie *img = cookie;
+  uint32_t remaining = img->size - img->offset;
+  uint64_t now;
+
+  if (*size > remaining)
+  {
+    *size = (uint16_t)remaining;
+  }
+  if (0 == *size)
+  {
+    return false;
+  }
+  memcpy(data, img->base + img->offset, *size);
+  img->offset += *size;
+  img->calls++;
+  if (*size > img->largestChunk)
+  {
+    img->largestChunk = *size;
+  }
+
+  now = tmr_gettime();
+  if (now - img->lastReport >= PROGRESS_INTERVAL_MS || img->offset == img->size)
+  {
+    printProgress(img, now, false);
+    img->lastReport = now;
+  }
+  return true;
+}
+
+/*
+ * helper function to create and connect the reader.
+ * A reader sitting in the bootloader with a corrupt application is
+ * accepted, since loading a new image is what fixes it.
+ */
+static TMR_Status connectReader(TMR_Reader *rp, const char *uri)
+{
+  TMR_Status ret;
+
+  ret = TMR_create(rp, uri);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+#if USE_TRANSPORT_LISTENER
+  {
+    static TMR_TransportListenerBlock tb;
+
+    if (TMR_READER_TYPE_SERIAL == rp->readerType)
+    {
+      tb.listener = serialPrinter;
+    }
+    else
+    {
+      tb.listener = stringPrinter;
+    }
+    tb.cookie = stdout;
+
+    TMR_addTransportListener(rp, &tb);
+  }
+#endif
+
+  ret = TMR_connect(rp);
+  switch (ret)
+  {
+  case TMR_ERROR_BL_INVALID_IMAGE_CRC:
+  case TMR_ERROR_BL_INVALID_APP_END_ADDR:
+    fprintf(stderr, "Warning: App image corrupt.  Proceeding to load firmware, anyway.\n");
+    ret = TMR_SUCCESS;
+    break;
+  default:
+    break;
+  }
+  return ret;
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  char *filename = NULL;
+  const char *problem;
+  const uint8_t *image;
+  uint32_t imageSize, crc;
+  uint32_t expectedCrc = 0;
+  bool checkCrc = false;
+  int retries = DEFAULT_RETRIES;
+  int attempt, reconnect, failedReconnects = 0, i;
+  uint32_t delay;
+  uint64_t loadStart;
+  ImageCookie img;
+
+  if (argc < 2)
+  {
+    usage();
+  }
+  if (argc < 3)
+  {
+    errx(2, "Please provide firmware filename\n"
+            "Usage: %s readeruri firmwarefilename [--crc 1a2b3c4d] [--retries 3]\n", argv[0]);
+  }
+  filename = argv[2];
+
+  for (i = 3; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--crc", argv[i]))
+    {
+      expectedCrc = (uint32_t)strtoul(argv[i+1], NULL, 16);
+      checkCrc = true;
+    }
+    else if (0x00 == strcmp("--retries", argv[i]))
+    {
+      retries = atoi(argv[i+1]);
+      if (retries < 0)
+      {
+        errx(1, "--retries must not be negative\n");
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  /* Validate the image before anything is sent to the module */
+  printf("Opening \"%s\"\n", filename);
+  image = mapImage(filename, &imageSize);
+  if (NULL == image)
+  {
+    return 1;
+  }
+  problem = validateImage(image, imageSize, checkCrc, expectedCrc, &crc);
+  if (NULL != problem)
+  {
+    unmapImage(image, imageSize);
+    errx(1, "Error: \"%s\" rejected, %s. Reader left untouched.\n", filename, problem);
+  }
+  printf("Image is %" PRIu32 " bytes, CRC-32 %08" PRIx32 "%s\n",
+         imageSize, crc, checkCrc ? " (verified)" : "");
+
+  rp = &r;
+  ret = connectReader(rp, argv[1]);
+  checkerr(rp, ret, 1, "connecting reader");
+  printf("Connected to reader\n");
+
+  memset(&img, 0, sizeof(img));
+  img.base = image;
+  img.size = imageSize;
+
+  loadStart = tmr_gettime();
+  delay = RETRY_DELAY_MS;
+  for (attempt = 0; ; attempt++)
+  {
+    /* The bootloader erases the application on every load, so each
+     * attempt starts again from the first byte of the image */
+    img.offset = 0;
+    img.calls = 0;
+    img.startTime = img.lastReport = tmr_gettime();
+
+    printf("Loading firmware%s\n", (0 == attempt) ? "" : " (retry)");
+    ret = TMR_firmwareLoad(rp, &img, mappedProvider);
+    printProgress(&img, tmr_gettime(), true);
+    if (TMR_SUCCESS == ret)
+    {
+      break;
+    }
+
+    fprintf(stderr, "Error loading firmware after %" PRIu32 " bytes: %s\n",
+            img.offset, TMR_strerr(rp, ret));
+    /* Only transport errors are worth another attempt, a rejected
+     * image will be rejected again */
+    if (!TMR_ERROR_IS_COMM(ret) || attempt >= retries)
+    {
+      TMR_destroy(rp);
+      unmapImage(image, imageSize);
+      errx(1, "Firmware update failed, the reader is left in the bootloader.\n");
+    }
+
+    TMR_destroy(rp);
+    fprintf(stderr, "Reconnecting in %" PRIu32 " ms (retry %d of %d)\n",
+            delay, attempt + 1, retries);
+    tmr_sleep(delay);
+    delay *= 2;
+    for (reconnect = 1; TMR_SUCCESS != (ret = connectReader(rp, argv[1])); reconnect++)
+    {
+      fprintf(stderr, "Error reconnecting: %s\n", TMR_strerr(rp, ret));
+      TMR_destroy(rp);
+      failedReconnects++;
+      if (reconnect >= MAX_RECONNECTS)
+      {
+        unmapImage(image, imageSize);
+        errx(1, "Firmware update failed, can't reach the reader.\n");
+      }
+      tmr_sleep(delay);
+      delay *= 2;
+    }
+  }
+
+  printf("Loaded %" PRIu32 " bytes in %" PRIu64 " ms (%" PRIu32
+         " provider calls, largest chunk %u bytes, %d retries, %d failed reconnects)\n",
+         imageSize, tmr_gettime() - loadStart, img.calls,
+         (unsigned)img.largestChunk, attempt, failedReconnects);
+  unmapImage(image, imageSize);
+
+  {
+    TMR_String value;
+    char value_data[64];
+    value.value = value_data;
+    value.max = sizeof(value_data)/sizeof(value_data[0]);
+
+    ret = TMR_paramGet(rp, TMR_PARAM_VERSION_SOFTWARE, &value);
+    checkerr(rp, ret, 1, "getting software version");
+    printf("New firmware version: %s\n", value.value);
+  }
+
+  TMR_destroy(rp);
+  return 0;
+}
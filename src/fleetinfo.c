@@ -0,0 +1,589 @@
+/**
+ * Sample program that collects the descriptive parameters of a whole
+ * fleet of readers at once.
+ *
+ * Takes a file listing one reader URI per line. A bounded pool of worker
+ * threads connects to the readers concurrently and fetches the same
+ * parameters readerInfo displays (versions, product IDs, description,
+ * region, antennas). Nothing is ever written to a reader. Every reader
+ * gets a time budget: the transport timeout is set from it, parameters
+ * are skipped once it is spent, and a reader that still hangs past it is
+ * reported as timed out while a fresh worker takes its pool slot. One
+ * JSON object per reader is printed per line, in completion order.
+ * @file fleetinfo.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide a reader list, such as:\n"\
+                         "Usage: %s readerlist.txt [--workers 16] [--timeout 10000]\n"\
+                         "readerlist.txt holds one reader URI per line, such as:\n"\
+                         "tmr:///dev/ttyUSB0\n"\
+                         "tmr://my-reader.example.com\n", argv[0]);}
+
+#define MAX_READERS 4096
+#define MAX_URI_LEN 128
+#define DEFAULT_WORKERS 16
+#define DEFAULT_TIMEOUT_MS 10000
+/* Extra time a worker gets past its budget before it is declared hung */
+#define HANG_GRACE_MS 2000
+#define JSON_LINE_LEN 2048
+
+typedef enum ScanState
+{
+  SCAN_QUEUED,
+  SCAN_RUNNING,
+  SCAN_REPORTED,
+  /* Reported by the watchdog; the worker stuck on it is retired */
+  SCAN_TIMED_OUT
+} ScanState;
+
+/* One reader of the fleet */
+typedef struct ScanJob
+{
+  char uri[MAX_URI_LEN];
+  ScanState state;
+  uint64_t started;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+} ScanJob;
+
+/* Scan shared by the workers and the watchdog */
+typedef struct FleetScan
+{
+  ScanJob *jobs;
+  int jobCount;
+  int nextJob;
+  int reported;
+  uint32_t timeoutMs;
+  pthread_mutex_t lock;
+} FleetScan;
+
+/* JSON object under construction */
+typedef struct JsonLine
+{
+  char buf[JSON_LINE_LEN];
+  size_t len;
+  bool first;
+} JsonLine;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+/* helper function to read the reader list, one URI per line */
+static int loadReaderList(const char *filename, ScanJob *jobs, int max)
+{
+  FILE *f;
+  char line[MAX_URI_LEN];
+  char *p, *end;
+  int count = 0;
+
+  f = fopen(filename, "r");
+  if (NULL == f)
+  {
+    perror("Can't open reader list");
+    return -1;
+  }
+  while (NULL != fgets(line, sizeof(line), f))
+  {
+    /* Trim whitespace, skip blank lines and # comments */
+    for (p = line; ' ' == *p || '\t' == *p; p++);
+    end = p + strlen(p);
+    while (end > p && (' ' == end[-1] || '\t' == end[-1] || '\r' == end[-1] || '\n' == end[-1]))
+    {
+      *--end = '\0';
+    }
+    if ('\0' == *p || '#' == *p)
+    {
+      continue;
+    }
+    if (count == max)
+    {
+      fprintf(stderr, "Reader list truncated to %d readers\n", max);
+      break;
+    }
+    memset(&jobs[count], 0, sizeof(jobs[count]));
+    snprintf(jobs[count].uri, sizeof(jobs[count].uri), "%s", p);
+    count++;
+  }
+  fclose(f);
+  return count;
+}
+
+/* helper function to append formatted text to a JSON line */
+static void jsonAppend(JsonLine *js, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  if (js->len >= sizeof(js->buf))
+  {
+    return;
+  }
+  va_start(ap, fmt);
+  n = vsnprintf(js->buf + js->len, sizeof(js->buf) - js->len, fmt, ap);
+  va_end(ap);
+  if (n > 0)
+  {
+    js->len += n;
+  }
+}
+
+/* helper function to start a new member of the JSON object */
+static void jsonKey(JsonLine *js, const char *key)
+{
+  jsonAppend(js, "%s\"%s\":", js->first ? "" : ",", key);
+  js->first = false;
+}
+
+/* helper function to append a JSON string, escaping as needed */
+static void jsonString(JsonLine *js, const char *key, const char *value)
+{
+  const char *p;
+
+  if (NULL != key)
+  {
+    jsonKey(js, key);
+  }
+  jsonAppend(js, "\"");
+  for (p = value; '\0' != *p; p++)
+  {
+    if ('"' == *p || '\\' == *p)
+    {
+      jsonAppend(js, "\\%c", *p);
+    }
+    else if ((unsigned char)*p < 0x20)
+    {
+      jsonAppend(js, "\\u%04x", (unsigned char)*p);
+    }
+    else
+    {
+      jsonAppend(js, "%c", *p);
+    }
+  }
+  jsonAppend(js, "\"");
+}
+
+static void jsonUint(JsonLine *js, const char *key, uint32_t value)
+{
+  jsonKey(js, key);
+  jsonAppend(js, "%" PRIu32, value);
+}
+
+/* Description of one parameter to collect */
+typedef struct InfoParam
+{
+  TMR_Param param;
+  const char *key;
+  enum { INFO_STRING, INFO_U16, INFO_REGION, INFO_U8LIST } kind;
+} InfoParam;
+
+static const InfoParam infoParams[] = {
+  { TMR_PARAM_VERSION_HARDWARE,   "hardware",         INFO_STRING },
+  { TMR_PARAM_VERSION_SERIAL,     "serial",           INFO_STRING },
+  { TMR_PARAM_VERSION_MODEL,      "model",            INFO_STRING },
+  { TMR_PARAM_VERSION_SOFTWARE,   "software",         INFO_STRING },
+  { TMR_PARAM_PRODUCT_ID,         "product_id",       INFO_U16 },
+  { TMR_PARAM_PRODUCT_GROUP_ID,   "product_group_id", INFO_U16 },
+  { TMR_PARAM_PRODUCT_GROUP,      "product_group",    INFO_STRING },
+  { TMR_PARAM_READER_DESCRIPTION, "description",      INFO_STRING },
+  { TMR_PARAM_READER_HOSTNAME,    "hostname",         INFO_STRING },
+  { TMR_PARAM_REGION_ID,          "region",           INFO_REGION },
+  { TMR_PARAM_ANTENNA_PORTLIST,   "antennas",         INFO_U8LIST },
+};
+#define NUM_INFO_PARAMS (sizeof(infoParams)/sizeof(infoParams[0]))
+
+/*
+ * helper function to fetch one parameter into the JSON line.
+ * Returns the status so the caller can collect failures.
+ */
+static TMR_Status addParam(TMR_Reader *rp, const InfoParam *ip, JsonLine *js)
+{
+  TMR_Status ret;
+  char string[64];
+  TMR_String str;
+  uint16_t u16;
+  TMR_Region region;
+  uint8_t portStore[64];
+  TMR_uint8List ports;
+  uint16_t i;
+
+  switch (ip->kind)
+  {
+  case INFO_STRING:
+    str.value = string;
+    str.max = sizeof(string);
+    ret = TMR_paramGet(rp, ip->param, &str);
+    if (TMR_SUCCESS == ret)
+    {
+      jsonString(js, ip->key, str.value);
+    }
+    break;
+  case INFO_U16:
+    ret = TMR_paramGet(rp, ip->param, &u16);
+    if (TMR_SUCCESS == ret)
+    {
+      jsonUint(js, ip->key, u16);
+    }
+    break;
+  case INFO_REGION:
+    ret = TMR_paramGet(rp, ip->param, &region);
+    if (TMR_SUCCESS == ret)
+    {
+      jsonUint(js, ip->key, region);
+    }
+    break;
+  default:
+    ports.list = portStore;
+    ports.max = sizeof(portStore)/sizeof(portStore[0]);
+    ports.len = 0;
+    ret = TMR_paramGet(rp, ip->param, &ports);
+    if (TMR_SUCCESS == ret)
+    {
+      jsonKey(js, ip->key);
+      jsonAppend(js, "[");
+      for (i = 0; i < ports.len && i < ports.max; i++)
+      {
+        jsonAppend(js, "%s%u", (0 == i) ? "" : ",", ports.list[i]);
+      }
+      jsonAppend(js, "]");
+    }
+    break;
+  }
+  return ret;
+}
+
+/* Connect to one reader and describe it as a JSON line */
+static void scanReader(FleetScan *fs, ScanJob *job, JsonLine *js)
+{
+  TMR_Reader r, *rp = &r;
+  TMR_Status ret;
+  uint32_t timeout = fs->timeoutMs;
+  uint64_t deadline;
+  const char *failed[NUM_INFO_PARAMS];
+  char failedMsg[NUM_INFO_PARAMS][64];
+  int numFailed = 0;
+  size_t i;
+
+  js->len = 0;
+  js->first = true;
+  jsonAppend(js, "{");
+  jsonString(js, "uri", job->uri);
+  deadline = job->started + timeout;
+
+  ret = TMR_create(rp, job->uri);
+  if (TMR_SUCCESS != ret)
+  {
+    jsonAppend(js, ",\"ok\":false");
+    jsonString(js, "error", TMR_strerr(rp, ret));
+    goto out;
+  }
+
+#if USE_TRANSPORT_LISTENER
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    job->tb.listener = serialPrinter;
+  }
+  else
+  {
+    job->tb.listener = stringPrinter;
+  }
+  job->tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &job->tb);
+#endif
+
+  /* No single exchange may take longer than the whole reader budget */
+  TMR_paramSet(rp, TMR_PARAM_TRANSPORTTIMEOUT, &timeout);
+
+  ret = TMR_connect(rp);
+  if (TMR_SUCCESS != ret)
+  {
+    jsonAppend(js, ",\"ok\":false");
+    jsonString(js, "error", TMR_strerr(rp, ret));
+    TMR_destroy(rp);
+    goto out;
+  }
+
+  for (i = 0; i < NUM_INFO_PARAMS; i++)
+  {
+    if (tmr_gettime() >= deadline)
+    {
+      failed[numFailed] = infoParams[i].key;
+      snprintf(failedMsg[numFailed], sizeof(failedMsg[0]), "skipped, time budget spent");
+      numFailed++;
+      continue;
+    }
+    ret = addParam(rp, &infoParams[i], js);
+    /* Parameters this reader type doesn't have are simply left out */
+    if (TMR_SUCCESS != ret && TMR_ERROR_NOT_FOUND != ret && TMR_ERROR_UNSUPPORTED != ret)
+    {
+      failed[numFailed] = infoParams[i].key;
+      snprintf(failedMsg[numFailed], sizeof(failedMsg[0]), "%s", TMR_strerr(rp, ret));
+      numFailed++;
+    }
+  }
+  TMR_destroy(rp);
+
+  jsonAppend(js, ",\"ok\":%s", (0 == numFailed) ? "true" : "false");
+  if (0 != numFailed)
+  {
+    jsonKey(js, "errors");
+    jsonAppend(js, "{");
+    for (i = 0; i < (size_t)numFailed; i++)
+    {
+      jsonAppend(js, "%s", (0 == i) ? "" : ",");
+      jsonString(js, NULL, failed[i]);
+      jsonAppend(js, ":");
+      jsonString(js, NULL, failedMsg[i]);
+    }
+    jsonAppend(js, "}");
+  }
+
+out:
+  jsonUint(js, "elapsed_ms", (uint32_t)(tmr_gettime() - job->started));
+  jsonAppend(js, "}");
+}
+
+/* Worker: keep taking the next reader of the list until none is left */
+static void *scanWorker(void *arg)
+{
+  FleetScan *fs = arg;
+  ScanJob *job;
+  JsonLine *js;
+  int index;
+  bool retired;
+
+  js = malloc(sizeof(*js));
+  if (NULL == js)
+  {
+    return NULL;
+  }
+  for (;;)
+  {
+    pthread_mutex_lock(&fs->lock);
+    index = fs->nextJob;
+    if (index < fs->jobCount)
+    {
+      fs->nextJob++;
+      job = &fs->jobs[index];
+      job->state = SCAN_RUNNING;
+      job->started = tmr_gettime();
+    }
+    pthread_mutex_unlock(&fs->lock);
+    if (index >= fs->jobCount)
+    {
+      break;
+    }
+
+    scanReader(fs, job, js);
+
+    /**
+     * The watchdog may already have given up on this reader. Its
+     * replacement then holds this worker's pool slot, so this worker
+     * exits rather than take another reader.
+     */
+    pthread_mutex_lock(&fs->lock);
+    retired = (SCAN_TIMED_OUT == job->state);
+    if (SCAN_RUNNING == job->state)
+    {
+      job->state = SCAN_REPORTED;
+      fs->reported++;
+      printf("%s\n", js->buf);
+      fflush(stdout);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    if (retired)
+    {
+      break;
+    }
+  }
+  free(js);
+  return NULL;
+}
+
+/* helper function to start a detached worker */
+static int startWorker(FleetScan *fs)
+{
+  pthread_t tid;
+
+  if (0 != pthread_create(&tid, NULL, scanWorker, fs))
+  {
+    return -1;
+  }
+  pthread_detach(tid);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  FleetScan fs;
+  int workers = DEFAULT_WORKERS;
+  int i, count;
+  uint64_t now;
+  ScanJob *job;
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  memset(&fs, 0, sizeof(fs));
+  fs.timeoutMs = DEFAULT_TIMEOUT_MS;
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--workers", argv[i]))
+    {
+      workers = atoi(argv[i+1]);
+      if (workers < 1)
+      {
+        errx(1, "--workers must be at least 1\n");
+      }
+    }
+    else if (0x00 == strcmp("--timeout", argv[i]))
+    {
+      fs.timeoutMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  fs.jobs = calloc(MAX_READERS, sizeof(ScanJob));
+  if (NULL == fs.jobs)
+  {
+    errx(1, "Out of memory\n");
+  }
+  count = loadReaderList(argv[1], fs.jobs, MAX_READERS);
+  if (count <= 0)
+  {
+    errx(1, "No reader URIs in \"%s\"\n", argv[1]);
+  }
+  fs.jobCount = count;
+  if (workers > count)
+  {
+    workers = count;
+  }
+
+  pthread_mutex_init(&fs.lock, NULL);
+  for (i = 0; i < workers; i++)
+  {
+    if (0 != startWorker(&fs))
+    {
+      errx(1, "Can't start worker thread\n");
+    }
+  }
+
+  /**
+   * Watchdog: a reader whose worker is stuck in a call well past its
+   * budget is reported as timed out, and a new worker replaces the
+   * stuck one so the rest of the fleet keeps its concurrency. The stuck
+   * worker is retired and exits once its call returns.
+   **/
+  for (;;)
+  {
+    tmr_sleep(100);
+    pthread_mutex_lock(&fs.lock);
+    if (fs.reported == fs.jobCount)
+    {
+      pthread_mutex_unlock(&fs.lock);
+      break;
+    }
+    now = tmr_gettime();
+    for (i = 0; i < fs.jobCount; i++)
+    {
+      job = &fs.jobs[i];
+      if (SCAN_RUNNING == job->state
+          && now - job->started > fs.timeoutMs + HANG_GRACE_MS)
+      {
+        JsonLine js;
+
+        js.len = 0;
+        js.first = true;
+        jsonAppend(&js, "{");
+        jsonString(&js, "uri", job->uri);
+        jsonAppend(&js, ",\"ok\":false");
+        jsonString(&js, "error", "timed out");
+        jsonUint(&js, "elapsed_ms", (uint32_t)(now - job->started));
+        jsonAppend(&js, "}");
+        printf("%s\n", js.buf);
+        fflush(stdout);
+
+        job->state = SCAN_TIMED_OUT;
+        fs.reported++;
+        if (fs.nextJob < fs.jobCount)
+        {
+          startWorker(&fs);
+        }
+      }
+    }
+    pthread_mutex_unlock(&fs.lock);
+  }
+
+  /* Workers still stuck in a hung reader are abandoned on exit */
+  return 0;
+}
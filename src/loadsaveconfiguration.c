@@ -1,5 +1,11 @@
 /**
  * Sample program that demonstrates the Load and Save the configuration file.
+ *
+ * With --binary the configuration is saved as a versioned binary
+ * snapshot instead. Loading a snapshot reads the current value of every
+ * saved parameter and only issues TMR_paramSet for the ones that differ,
+ * so re-applying an unchanged configuration after a reconnect costs one
+ * get per parameter and no sets.
  * @file loadsaveconfiguration.c
  */
 
@@ -7,6 +13,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
 #ifndef WIN32
 #include <unistd.h>
 #endif
@@ -17,8 +25,8 @@
 #endif
 
 #define usage() {errx(1, "Please provide reader URL, such as:\n"\
-                         "tmr:///com4 configfilename\n"\
-                         "tmr://my-reader.example.com configfilename\n");}
+                         "tmr:///com4 configfilename [--binary]\n"\
+                         "tmr://my-reader.example.com configfilename [--binary]\n");}
 
 void errx(int exitval, const char *fmt, ...)
 {
@@ -64,12 +72,473 @@ void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeo
 
 void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie);
 
+/* Binary snapshot layout, all integers little endian:
+ *   "TMRB" | version (2) | entry count (2)
+ *   per entry: name length (1) | name | kind (1) | value length (2) | value | hash (4)
+ *   hash of everything above (4)
+ * Parameters are stored by name so a snapshot stays valid across API
+ * versions that renumber TMR_Param.
+ */
+#define SNAPSHOT_MAGIC "TMRB"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_VALUE 512
+#define SNAPSHOT_MAX_SIZE 16384
+#define SNAPSHOT_MAX_LIST 64
+
+typedef enum SnapshotKind
+{
+  SNAPSHOT_KIND_U8 = 1,
+  SNAPSHOT_KIND_U16,
+  SNAPSHOT_KIND_U32,
+  SNAPSHOT_KIND_GEN2_Q,
+  SNAPSHOT_KIND_U32LIST,
+  SNAPSHOT_KIND_PORTVALUELIST
+} SnapshotKind;
+
+typedef struct SnapshotParam
+{
+  TMR_Param key;
+  SnapshotKind kind;
+} SnapshotParam;
+
+/**
+ * Parameters captured in a snapshot, in the order they are applied.
+ * The region goes first since changing it resets the hop table and
+ * power settings on the module.
+ */
+static const SnapshotParam snapshotParams[] =
+{
+  { TMR_PARAM_REGION_ID,                     SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_REGION_HOPTABLE,               SNAPSHOT_KIND_U32LIST },
+  { TMR_PARAM_REGION_HOPTIME,                SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_REGION_LBT_ENABLE,             SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_COMMANDTIMEOUT,                SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_TRANSPORTTIMEOUT,              SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_POWERMODE,                     SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_USERMODE,                      SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_ANTENNA_CHECKPORT,             SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_ANTENNA_SETTLINGTIMELIST,      SNAPSHOT_KIND_PORTVALUELIST },
+  { TMR_PARAM_RADIO_READPOWER,               SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_RADIO_WRITEPOWER,              SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_RADIO_PORTREADPOWERLIST,       SNAPSHOT_KIND_PORTVALUELIST },
+  { TMR_PARAM_RADIO_PORTWRITEPOWERLIST,      SNAPSHOT_KIND_PORTVALUELIST },
+  { TMR_PARAM_RADIO_ENABLEPOWERSAVE,         SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_GEN2_Q,                        SNAPSHOT_KIND_GEN2_Q },
+  { TMR_PARAM_GEN2_TAGENCODING,              SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_GEN2_SESSION,                  SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_GEN2_TARGET,                   SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_GEN2_BLF,                      SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_GEN2_TARI,                     SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_GEN2_WRITEMODE,                SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_READ_ASYNCONTIME,              SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_READ_ASYNCOFFTIME,             SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_TAGREADDATA_RECORDHIGHESTRSSI, SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_TAGREADDATA_REPORTRSSIINDBM,   SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_TAGREADDATA_UNIQUEBYANTENNA,   SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_TAGREADDATA_UNIQUEBYDATA,      SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_TAGOP_ANTENNA,                 SNAPSHOT_KIND_U8 },
+  { TMR_PARAM_TAGOP_PROTOCOL,                SNAPSHOT_KIND_U32 },
+  { TMR_PARAM_EXTENDEDEPC,                   SNAPSHOT_KIND_U8 },
+};
+#define NUM_SNAPSHOT_PARAMS (sizeof(snapshotParams)/sizeof(snapshotParams[0]))
+
+/* FNV-1a, used for the per-parameter and whole-file hashes */
+static uint32_t
+fnv1a(uint32_t hash, const uint8_t *data, uint32_t len)
+{
+  uint32_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void
+putLE(uint8_t *buf, uint32_t value, uint8_t bytes)
+{
+  uint8_t i;
+
+  for (i = 0; i < bytes; i++)
+  {
+    buf[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static uint32_t
+getLE(const uint8_t *buf, uint8_t bytes)
+{
+  uint32_t value = 0;
+  uint8_t i;
+
+  for (i = 0; i < bytes; i++)
+  {
+    value |= (uint32_t)buf[i] << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * helper function to read a parameter from the reader and encode it
+ * into its snapshot representation. Returns the encoded length in *len.
+ */
+static TMR_Status
+encodeParam(TMR_Reader *rp, const SnapshotParam *sp, uint8_t *buf, uint16_t *len)
+{
+  TMR_Status ret;
+  uint16_t i;
+
+  switch (sp->kind)
+  {
+  case SNAPSHOT_KIND_U8:
+    {
+      uint8_t value = 0;
+
+      ret = TMR_paramGet(rp, sp->key, &value);
+      buf[0] = value;
+      *len = 1;
+      break;
+    }
+  case SNAPSHOT_KIND_U16:
+    {
+      uint16_t value = 0;
+
+      ret = TMR_paramGet(rp, sp->key, &value);
+      putLE(buf, value, 2);
+      *len = 2;
+      break;
+    }
+  case SNAPSHOT_KIND_U32:
+    {
+      uint32_t value = 0;
+
+      ret = TMR_paramGet(rp, sp->key, &value);
+      putLE(buf, value, 4);
+      *len = 4;
+      break;
+    }
+  case SNAPSHOT_KIND_GEN2_Q:
+    {
+      TMR_GEN2_Q value;
+
+      memset(&value, 0, sizeof(value));
+      ret = TMR_paramGet(rp, sp->key, &value);
+      buf[0] = (uint8_t)value.type;
+      buf[1] = (TMR_SR_GEN2_Q_STATIC == value.type) ? value.u.staticQ.initialQ : 0;
+      *len = 2;
+      break;
+    }
+  case SNAPSHOT_KIND_U32LIST:
+    {
+      TMR_uint32List value;
+      uint32_t store[SNAPSHOT_MAX_LIST];
+
+      value.list = store;
+      value.max = SNAPSHOT_MAX_LIST;
+      value.len = 0;
+      ret = TMR_paramGet(rp, sp->key, &value);
+      if ((TMR_SUCCESS == ret) && (value.len > value.max))
+      {
+        /* A truncated list would be restored as if it were complete */
+        return TMR_ERROR_TOO_BIG;
+      }
+      for (i = 0; i < value.len; i++)
+      {
+        putLE(&buf[4 * i], store[i], 4);
+      }
+      *len = 4 * value.len;
+      break;
+    }
+  case SNAPSHOT_KIND_PORTVALUELIST:
+    {
+      TMR_PortValueList value;
+      TMR_PortValue store[SNAPSHOT_MAX_LIST];
+
+      value.list = store;
+      value.max = SNAPSHOT_MAX_LIST;
+      value.len = 0;
+      ret = TMR_paramGet(rp, sp->key, &value);
+      if ((TMR_SUCCESS == ret) && (value.len > value.max))
+      {
+        /* A truncated list would be restored as if it were complete */
+        return TMR_ERROR_TOO_BIG;
+      }
+      for (i = 0; i < value.len; i++)
+      {
+        buf[5 * i] = store[i].port;
+        putLE(&buf[5 * i + 1], (uint32_t)store[i].value, 4);
+      }
+      *len = 5 * value.len;
+      break;
+    }
+  default:
+    ret = TMR_ERROR_INVALID;
+    break;
+  }
+  return ret;
+}
+
+/* helper function to decode a snapshot value and set it on the reader */
+static TMR_Status
+applyParam(TMR_Reader *rp, const SnapshotParam *sp, const uint8_t *buf, uint16_t len)
+{
+  uint16_t i;
+
+  switch (sp->kind)
+  {
+  case SNAPSHOT_KIND_U8:
+    {
+      uint8_t value = buf[0];
+
+      return TMR_paramSet(rp, sp->key, &value);
+    }
+  case SNAPSHOT_KIND_U16:
+    {
+      uint16_t value = (uint16_t)getLE(buf, 2);
+
+      return TMR_paramSet(rp, sp->key, &value);
+    }
+  case SNAPSHOT_KIND_U32:
+    {
+      uint32_t value = getLE(buf, 4);
+
+      return TMR_paramSet(rp, sp->key, &value);
+    }
+  case SNAPSHOT_KIND_GEN2_Q:
+    {
+      TMR_GEN2_Q value;
+
+      memset(&value, 0, sizeof(value));
+      value.type = (TMR_GEN2_QType)buf[0];
+      value.u.staticQ.initialQ = buf[1];
+      return TMR_paramSet(rp, sp->key, &value);
+    }
+  case SNAPSHOT_KIND_U32LIST:
+    {
+      TMR_uint32List value;
+      uint32_t store[SNAPSHOT_MAX_LIST];
+
+      value.list = store;
+      value.max = SNAPSHOT_MAX_LIST;
+      value.len = len / 4;
+      for (i = 0; i < value.len; i++)
+      {
+        store[i] = getLE(&buf[4 * i], 4);
+      }
+      return TMR_paramSet(rp, sp->key, &value);
+    }
+  case SNAPSHOT_KIND_PORTVALUELIST:
+    {
+      TMR_PortValueList value;
+      TMR_PortValue store[SNAPSHOT_MAX_LIST];
+
+      value.list = store;
+      value.max = SNAPSHOT_MAX_LIST;
+      value.len = len / 5;
+      for (i = 0; i < value.len; i++)
+      {
+        store[i].port = buf[5 * i];
+        store[i].value = (int32_t)getLE(&buf[5 * i + 1], 4);
+      }
+      return TMR_paramSet(rp, sp->key, &value);
+    }
+  default:
+    return TMR_ERROR_INVALID;
+  }
+}
+
+static const SnapshotParam *
+findSnapshotParam(TMR_Param key)
+{
+  uint32_t i;
+
+  for (i = 0; i < NUM_SNAPSHOT_PARAMS; i++)
+  {
+    if (snapshotParams[i].key == key)
+    {
+      return &snapshotParams[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Save the reader configuration as a binary snapshot. Parameters the
+ * reader does not support are left out of the snapshot; a list longer
+ * than SNAPSHOT_MAX_LIST fails the save.
+ */
+TMR_Status
+saveBinaryConfig(TMR_Reader *rp, const char *filePath)
+{
+  static uint8_t file[SNAPSHOT_MAX_SIZE];
+  uint8_t value[SNAPSHOT_MAX_VALUE];
+  const char *name;
+  uint32_t pos = 8, hash;
+  uint16_t count = 0, len;
+  uint8_t nameLen;
+  uint32_t i;
+  TMR_Status ret;
+  FILE *fp;
+
+  for (i = 0; i < NUM_SNAPSHOT_PARAMS; i++)
+  {
+    name = TMR_paramName(snapshotParams[i].key);
+    ret = encodeParam(rp, &snapshotParams[i], value, &len);
+    if (TMR_ERROR_TOO_BIG == ret)
+    {
+      printf("%s has more than %d entries, not saving a truncated snapshot\n", name, SNAPSHOT_MAX_LIST);
+      return ret;
+    }
+    if (TMR_SUCCESS != ret)
+    {
+      continue;
+    }
+    nameLen = (uint8_t)strlen(name);
+    if (pos + 1 + nameLen + 3 + len + 4 + 4 > SNAPSHOT_MAX_SIZE)
+    {
+      return TMR_ERROR_OUT_OF_MEMORY;
+    }
+
+    file[pos++] = nameLen;
+    memcpy(&file[pos], name, nameLen);
+    pos += nameLen;
+    file[pos++] = (uint8_t)snapshotParams[i].kind;
+    putLE(&file[pos], len, 2);
+    pos += 2;
+    memcpy(&file[pos], value, len);
+    pos += len;
+    hash = fnv1a(fnv1a(2166136261u, (const uint8_t *)name, nameLen), value, len);
+    putLE(&file[pos], hash, 4);
+    pos += 4;
+    count++;
+  }
+
+  memcpy(file, SNAPSHOT_MAGIC, 4);
+  putLE(&file[4], SNAPSHOT_VERSION, 2);
+  putLE(&file[6], count, 2);
+  putLE(&file[pos], fnv1a(2166136261u, file, pos), 4);
+  pos += 4;
+
+  fp = fopen(filePath, "wb");
+  if (NULL == fp)
+  {
+    return TMR_ERROR_TRYAGAIN;
+  }
+  if (pos != fwrite(file, 1, pos, fp))
+  {
+    fclose(fp);
+    return TMR_ERROR_TRYAGAIN;
+  }
+  fclose(fp);
+
+  printf("Saved %d parameters (%"PRIu32" bytes)\n", count, pos);
+  return TMR_SUCCESS;
+}
+
+/**
+ * Load a binary snapshot and apply only the parameters whose current
+ * value on the reader differs from the saved one.
+ */
+TMR_Status
+loadBinaryConfig(TMR_Reader *rp, const char *filePath)
+{
+  static uint8_t file[SNAPSHOT_MAX_SIZE];
+  uint8_t current[SNAPSHOT_MAX_VALUE];
+  char name[256];
+  const SnapshotParam *sp;
+  uint32_t size, pos = 8, hash;
+  uint16_t count, len, currentLen, i;
+  uint16_t applied = 0, unchanged = 0, skipped = 0;
+  uint8_t nameLen, kind;
+  TMR_Status ret;
+  FILE *fp;
+
+  fp = fopen(filePath, "rb");
+  if (NULL == fp)
+  {
+    return TMR_ERROR_TRYAGAIN;
+  }
+  size = (uint32_t)fread(file, 1, sizeof(file), fp);
+  fclose(fp);
+
+  if ((size < 12) || (0 != memcmp(file, SNAPSHOT_MAGIC, 4))
+      || (SNAPSHOT_VERSION != getLE(&file[4], 2))
+      || (getLE(&file[size - 4], 4) != fnv1a(2166136261u, file, size - 4)))
+  {
+    printf("%s is not a valid configuration snapshot\n", filePath);
+    return TMR_ERROR_INVALID;
+  }
+  count = (uint16_t)getLE(&file[6], 2);
+
+  for (i = 0; i < count; i++)
+  {
+    if (pos + 1 > size - 4)
+    {
+      return TMR_ERROR_INVALID;
+    }
+    nameLen = file[pos++];
+    if (pos + nameLen + 3 > size - 4)
+    {
+      return TMR_ERROR_INVALID;
+    }
+    memcpy(name, &file[pos], nameLen);
+    name[nameLen] = '\0';
+    pos += nameLen;
+    kind = file[pos++];
+    len = (uint16_t)getLE(&file[pos], 2);
+    pos += 2;
+    if ((pos + len + 4 > size - 4) || (len > SNAPSHOT_MAX_VALUE))
+    {
+      return TMR_ERROR_INVALID;
+    }
+    hash = fnv1a(fnv1a(2166136261u, (const uint8_t *)name, nameLen), &file[pos], len);
+    if (hash != getLE(&file[pos + len], 4))
+    {
+      printf("Hash mismatch for %s\n", name);
+      return TMR_ERROR_INVALID;
+    }
+
+    sp = findSnapshotParam(TMR_paramID(name));
+    if ((NULL == sp) || (sp->kind != kind))
+    {
+      printf("Skipping unknown parameter %s\n", name);
+      skipped++;
+    }
+    else if ((TMR_SUCCESS == encodeParam(rp, sp, current, &currentLen))
+             && (currentLen == len) && (0 == memcmp(current, &file[pos], len)))
+    {
+      unchanged++;
+    }
+    else
+    {
+      ret = applyParam(rp, sp, &file[pos], len);
+      if (TMR_SUCCESS != ret)
+      {
+        printf("Error setting %s: %s\n", name, TMR_strerr(rp, ret));
+        skipped++;
+      }
+      else
+      {
+        printf("Set %s\n", name);
+        applied++;
+      }
+    }
+    pos += len + 4;
+  }
+
+  printf("Applied %d parameters, %d unchanged, %d skipped\n", applied, unchanged, skipped);
+  return TMR_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
   TMR_Reader r, *rp;
   TMR_Status ret;
   TMR_Region region;
   char *fileName = NULL;
+  bool binary = false;
   TMR_ReadExceptionListenerBlock reb;
 #if USE_TRANSPORT_LISTENER
   TMR_TransportListenerBlock tb;
@@ -79,6 +548,18 @@ int main(int argc, char *argv[])
   {
     usage();
   }
+  if (argc > 3)
+  {
+    if (0x00 == strcmp("--binary", argv[3]))
+    {
+      binary = true;
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[3]);
+      usage();
+    }
+  }
   
   rp = &r;
   ret = TMR_create(rp, argv[1]);
@@ -136,13 +617,26 @@ int main(int argc, char *argv[])
   ret = TMR_addReadExceptionListener(rp, &reb);
   checkerr(rp, ret, 1, "adding exception listener");
 
-  ret = TMR_saveConfig(rp, fileName);
-  checkerr(rp, ret, 1, "save configuration");
-  printf("Saved the configuration file at %s\n", fileName);
+  if (binary)
+  {
+    ret = saveBinaryConfig(rp, fileName);
+    checkerr(rp, ret, 1, "save binary configuration");
+    printf("Saved the configuration snapshot at %s\n", fileName);
+
+    printf("Loading the configuration snapshot from %s\n", fileName);
+    ret = loadBinaryConfig(rp, fileName);
+    checkerr(rp, ret, 1, "load binary configuration");
+  }
+  else
+  {
+    ret = TMR_saveConfig(rp, fileName);
+    checkerr(rp, ret, 1, "save configuration");
+    printf("Saved the configuration file at %s\n", fileName);
 
-  printf("Loading the configuration from %s\n", fileName);
-  ret = TMR_loadConfig(rp, fileName);
-  checkerr(rp, ret, 1, "load configuration");
+    printf("Loading the configuration from %s\n", fileName);
+    ret = TMR_loadConfig(rp, fileName);
+    checkerr(rp, ret, 1, "load configuration");
+  }
 
   TMR_destroy(rp);
   return 0;
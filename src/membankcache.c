@@ -0,0 +1,477 @@
+/**
+ * Sample program that reads tags repeatedly and caches their TID,
+ * user and reserved memory, keyed on EPC, so the memory banks of a
+ * tag are read over the air only once.
+ *
+ * Each round is either a plain inventory or, when the previous round
+ * found tags that are not in the cache (or whose entry has expired),
+ * a multi read plan with one subplan per unknown tag. Each subplan
+ * selects a single EPC with a Gen2 select filter and reads the memory
+ * banks as an embedded tagop, so tags that are already cached are not
+ * asked for their memory again.
+ * @file membankcache.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --ttl 60000\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+/* Number of cache slots, must be a power of two */
+#define CACHE_SIZE 4096
+/* Largest memory bank stored per tag, in bytes */
+#define MAX_BANK_BYTES 64
+/* Most unknown tags targeted by one embedded read round */
+#define MAX_SUBPLANS 8
+#define READ_ROUNDS 20
+#define ROUND_TIMEOUT 500
+
+typedef struct MemBank
+{
+  uint8_t data[MAX_BANK_BYTES];
+  uint8_t len;
+} MemBank;
+
+typedef struct CacheEntry
+{
+  bool used;
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  bool valid;
+  uint64_t readTime;
+  MemBank tid;
+  MemBank user;
+  MemBank reserved;
+} CacheEntry;
+
+typedef struct MemBankCache
+{
+  CacheEntry entries[CACHE_SIZE];
+  uint32_t count;
+  /* Entries older than this are read again, 0 keeps them forever */
+  uint32_t ttl;
+} MemBankCache;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static uint32_t
+hashEpc(const uint8_t *epc, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= epc[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * helper function to find the slot for an EPC by linear probing.
+ * Returns the matching entry, or the free slot where it belongs, or
+ * NULL when the cache is full.
+ */
+static CacheEntry *
+cacheSlot(MemBankCache *cache, const uint8_t *epc, uint8_t len)
+{
+  uint32_t i, slot;
+  CacheEntry *e;
+
+  slot = hashEpc(epc, len);
+  for (i = 0; i < CACHE_SIZE; i++)
+  {
+    e = &cache->entries[(slot + i) & (CACHE_SIZE - 1)];
+    if (!e->used)
+    {
+      return e;
+    }
+    if ((e->epcByteCount == len) && (0 == memcmp(e->epc, epc, len)))
+    {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+static bool
+cacheFresh(const MemBankCache *cache, const CacheEntry *e, uint64_t now)
+{
+  return (NULL != e) && e->used && e->valid && ((0 == cache->ttl) || (now - e->readTime < cache->ttl));
+}
+
+static void
+copyBank(MemBank *bank, const TMR_uint8List *data)
+{
+  bank->len = (data->len < MAX_BANK_BYTES) ? (uint8_t)data->len : MAX_BANK_BYTES;
+  memcpy(bank->data, data->list, bank->len);
+}
+
+/**
+ * helper function to build the read plan for the next round: a plain
+ * inventory, or one subplan per unknown tag with an embedded read.
+ */
+static TMR_Status
+buildPlan(TMR_Reader *rp, TMR_TagData *unknown, uint8_t unknownCount,
+          uint8_t antennaCount, uint8_t *antennaList)
+{
+  static TMR_ReadPlan plan, subplans[MAX_SUBPLANS];
+  static TMR_ReadPlan *subplanPtrs[MAX_SUBPLANS];
+  static TMR_TagFilter filters[MAX_SUBPLANS];
+  static TMR_TagOp readOp;
+  TMR_Status ret;
+  uint8_t i;
+
+  if (0 == unknownCount)
+  {
+    ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+    if (TMR_SUCCESS != ret)
+    {
+      return ret;
+    }
+    return TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  }
+
+  /* Full TID, user and reserved banks in one embedded read */
+  ret = TMR_TagOp_init_GEN2_ReadData(&readOp, (TMR_GEN2_BANK_TID | TMR_GEN2_BANK_TID_ENABLED
+                                     | TMR_GEN2_BANK_USER_ENABLED | TMR_GEN2_BANK_RESERVED_ENABLED), 0, 0);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+  for (i = 0; i < unknownCount; i++)
+  {
+    ret = TMR_RP_init_simple(&subplans[i], antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+    if (TMR_SUCCESS != ret)
+    {
+      return ret;
+    }
+    /* Select on the EPC itself, which starts at bit 32 of the EPC bank */
+    TMR_TF_init_gen2_select(&filters[i], false, TMR_GEN2_BANK_EPC, 32,
+                            unknown[i].epcByteCount * 8, unknown[i].epc);
+    TMR_RP_set_filter(&subplans[i], &filters[i]);
+    TMR_RP_set_tagop(&subplans[i], &readOp);
+    subplanPtrs[i] = &subplans[i];
+  }
+
+  if (1 == unknownCount)
+  {
+    return TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &subplans[0]);
+  }
+  ret = TMR_RP_init_multi(&plan, subplanPtrs, unknownCount, 0);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+  return TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  static MemBankCache cache;
+  TMR_TagData unknown[MAX_SUBPLANS];
+  uint8_t unknownCount = 0, targeted, j;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t round, hits = 0, misses = 0, embeddedRounds = 0;
+  uint64_t now;
+  CacheEntry *e;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--ttl", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNu32, &cache.ttl))
+      {
+        fprintf(stdout, "Can't parse '%s' as a time in milliseconds\n", argv[i+1]);
+        usage();
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  for (round = 0; round < READ_ROUNDS; round++)
+  {
+    ret = buildPlan(rp, unknown, unknownCount, antennaCount, antennaList);
+    checkerr(rp, ret, 1, "setting read plan");
+    targeted = unknownCount;
+    if (0 < targeted)
+    {
+      embeddedRounds++;
+    }
+    unknownCount = 0;
+
+    ret = TMR_read(rp, ROUND_TIMEOUT, NULL);
+    if (TMR_ERROR_TAG_ID_BUFFER_FULL == ret)
+    {
+      /* In case of TAG ID Buffer Full, extract the tags present
+      * in buffer.
+      */
+      fprintf(stdout, "reading tags:%s\n", TMR_strerr(rp, ret));
+    }
+    else
+    {
+      checkerr(rp, ret, 1, "reading tags");
+    }
+
+    printf("Round %"PRIu32" (%s)\n", round + 1, (0 < targeted) ? "embedded read" : "inventory");
+    now = tmr_gettime();
+    while (TMR_SUCCESS == TMR_hasMoreTags(rp))
+    {
+      TMR_TagReadData trd;
+      uint8_t dataBuf[258];
+      uint8_t tidBuf[258];
+      uint8_t userBuf[258];
+      uint8_t reservedBuf[258];
+      char epcStr[128];
+      char tidStr[2 * MAX_BANK_BYTES + 1];
+
+      ret = TMR_TRD_init_data(&trd, sizeof(dataBuf)/sizeof(uint8_t), dataBuf);
+      checkerr(rp, ret, 1, "creating tag read data");
+      TMR_TRD_MEMBANK_init_data(&trd.tidMemData, sizeof(tidBuf), tidBuf);
+      TMR_TRD_MEMBANK_init_data(&trd.userMemData, sizeof(userBuf), userBuf);
+      TMR_TRD_MEMBANK_init_data(&trd.reservedMemData, sizeof(reservedBuf), reservedBuf);
+
+      ret = TMR_getNextTag(rp, &trd);
+      checkerr(rp, ret, 1, "fetching tag");
+
+      TMR_bytesToHex(trd.tag.epc, trd.tag.epcByteCount, epcStr);
+      e = cacheSlot(&cache, trd.tag.epc, trd.tag.epcByteCount);
+      if (NULL == e)
+      {
+        printf("  %s (cache full)\n", epcStr);
+        continue;
+      }
+
+      if (0 < trd.tidMemData.len)
+      {
+        /* Embedded read result, store it */
+        if (!e->used)
+        {
+          e->used = true;
+          e->epcByteCount = trd.tag.epcByteCount;
+          memcpy(e->epc, trd.tag.epc, trd.tag.epcByteCount);
+          cache.count++;
+        }
+        copyBank(&e->tid, &trd.tidMemData);
+        copyBank(&e->user, &trd.userMemData);
+        copyBank(&e->reserved, &trd.reservedMemData);
+        e->readTime = now;
+        e->valid = true;
+      }
+      else if (cacheFresh(&cache, e, now))
+      {
+        hits++;
+      }
+      else
+      {
+        /* Queue the tag for the next embedded read round */
+        misses++;
+        for (j = 0; j < unknownCount; j++)
+        {
+          if ((unknown[j].epcByteCount == trd.tag.epcByteCount)
+              && (0 == memcmp(unknown[j].epc, trd.tag.epc, trd.tag.epcByteCount)))
+          {
+            break;
+          }
+        }
+        if ((j == unknownCount) && (unknownCount < MAX_SUBPLANS))
+        {
+          unknown[unknownCount++] = trd.tag;
+        }
+        printf("  %s TID: (not cached)\n", epcStr);
+        continue;
+      }
+
+      TMR_bytesToHex(e->tid.data, e->tid.len, tidStr);
+      printf("  %s TID: %s user: %d bytes reserved: %d bytes\n", epcStr, tidStr, e->user.len, e->reserved.len);
+    }
+  }
+
+  printf("%"PRIu32" tags cached, %"PRIu32" cache hits, %"PRIu32" misses, %"PRIu32"/%d rounds spent on embedded reads\n",
+         cache.count, hits, misses, embeddedRounds, READ_ROUNDS);
+
+  TMR_destroy(rp);
+  return 0;
+}
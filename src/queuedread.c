@@ -0,0 +1,638 @@
+/**
+ * Sample program that puts a host-side queue of configurable size
+ * between the reader's background reads and the application, and
+ * reports how full it gets.
+ *
+ * The library's own background queue is sized at compile time
+ * (TMR_MAX_QUEUE_SLOTS in tm_config.h) and can't be observed from the
+ * application. Here the read listener only copies each read into a tag
+ * queue whose capacity is given with --queue; a consumer thread takes
+ * reads off it and does the (optionally slowed down, --work) processing.
+ * The queue keeps its own instrumentation: current depth, high-water
+ * mark, enqueue and dequeue rates, overflows, and a histogram of the
+ * time each read spent queued, from which percentiles are reported every
+ * --interval seconds and once more for the whole run.
+ * @file queuedread.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --queue 1000 --work 200 --interval 1 --duration 30\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2 --block 1\n");}
+
+#define DEFAULT_QUEUE_SLOTS 256
+#define DEFAULT_INTERVAL_S 1
+#define DEFAULT_DURATION_S 30
+/**
+ * Time-in-queue histogram: 8 linear sub-buckets per power of two
+ * microseconds, so percentiles are exact to within 12.5%.
+ */
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (40 * HIST_SUB)
+
+/* One queued read */
+typedef struct QueuedRead
+{
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint8_t antenna;
+  int32_t rssi;
+  uint64_t enqueuedUs;
+} QueuedRead;
+
+/* Time-in-queue distribution */
+typedef struct LatencyHistogram
+{
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t maxUs;
+} LatencyHistogram;
+
+/* Snapshot of the queue instrumentation */
+typedef struct TagQueueStats
+{
+  uint32_t capacity;
+  uint32_t depth;
+  uint32_t highWater;
+  uint64_t enqueued;
+  uint64_t dequeued;
+  uint64_t overflows;
+  uint64_t blockedUs;
+} TagQueueStats;
+
+/* Bounded tag read queue with instrumentation */
+typedef struct TagQueue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  QueuedRead *slots;
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t depth;
+  bool blockWhenFull;
+  bool closed;
+  TagQueueStats stats;
+  /* Reset at every report, and one for the whole run */
+  LatencyHistogram interval;
+  LatencyHistogram overall;
+} TagQueue;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static uint64_t nowUs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* helper function to map a latency to its histogram bucket */
+static int histBucket(uint64_t us)
+{
+  int msb = 0;
+
+  if (us < HIST_SUB)
+  {
+    return (int)us;
+  }
+  while ((us >> (msb + 1)) != 0)
+  {
+    msb++;
+  }
+  /* Top HIST_SUB_BITS bits below the leading one select the sub-bucket */
+  msb = (msb - HIST_SUB_BITS + 1) * HIST_SUB
+        + (int)((us >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+  return (msb < HIST_BUCKETS) ? msb : HIST_BUCKETS - 1;
+}
+
+/* helper function to get the upper bound of a histogram bucket */
+static uint64_t histUpper(int bucket)
+{
+  int shift;
+
+  if (bucket < HIST_SUB)
+  {
+    return (uint64_t)bucket;
+  }
+  shift = bucket / HIST_SUB - 1;
+  return ((uint64_t)(HIST_SUB + bucket % HIST_SUB + 1) << shift) - 1;
+}
+
+static void histAdd(LatencyHistogram *h, uint64_t us)
+{
+  h->counts[histBucket(us)]++;
+  h->total++;
+  if (us > h->maxUs)
+  {
+    h->maxUs = us;
+  }
+}
+
+/* helper function to read a percentile (0-100) off a histogram */
+static uint64_t histPercentile(const LatencyHistogram *h, double pct)
+{
+  uint64_t rank, seen = 0;
+  int i;
+
+  if (0 == h->total)
+  {
+    return 0;
+  }
+  rank = (uint64_t)(h->total * pct / 100.0);
+  if (rank >= h->total)
+  {
+    rank = h->total - 1;
+  }
+  for (i = 0; i < HIST_BUCKETS; i++)
+  {
+    seen += h->counts[i];
+    if (seen > rank)
+    {
+      return (histUpper(i) < h->maxUs) ? histUpper(i) : h->maxUs;
+    }
+  }
+  return h->maxUs;
+}
+
+static bool TQ_init(TagQueue *q, uint32_t capacity, bool blockWhenFull)
+{
+  memset(q, 0, sizeof(*q));
+  q->slots = calloc(capacity, sizeof(QueuedRead));
+  if (NULL == q->slots)
+  {
+    return false;
+  }
+  q->capacity = capacity;
+  q->blockWhenFull = blockWhenFull;
+  q->stats.capacity = capacity;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->notEmpty, NULL);
+  pthread_cond_init(&q->notFull, NULL);
+  return true;
+}
+
+/**
+ * helper function to queue a read. When the queue is full the read is
+ * either dropped and counted as an overflow, or, with blockWhenFull,
+ * the caller waits for the consumer.
+ */
+static void TQ_push(TagQueue *q, const TMR_TagReadData *t)
+{
+  QueuedRead *slot;
+  uint64_t start;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->depth == q->capacity && q->blockWhenFull)
+  {
+    start = nowUs();
+    while (q->depth == q->capacity && !q->closed)
+    {
+      pthread_cond_wait(&q->notFull, &q->lock);
+    }
+    q->stats.blockedUs += nowUs() - start;
+  }
+  if (q->depth == q->capacity || q->closed)
+  {
+    q->stats.overflows++;
+    pthread_mutex_unlock(&q->lock);
+    return;
+  }
+
+  slot = &q->slots[(q->head + q->depth) % q->capacity];
+  slot->epcByteCount = t->tag.epcByteCount;
+  memcpy(slot->epc, t->tag.epc, t->tag.epcByteCount);
+  slot->antenna = t->antenna;
+  slot->rssi = t->rssi;
+  slot->enqueuedUs = nowUs();
+  q->depth++;
+  q->stats.enqueued++;
+  if (q->depth > q->stats.highWater)
+  {
+    q->stats.highWater = q->depth;
+  }
+  pthread_cond_signal(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/* helper function to take the oldest read, waiting for one. False once closed and empty. */
+static bool TQ_pop(TagQueue *q, QueuedRead *out)
+{
+  uint64_t waited;
+
+  pthread_mutex_lock(&q->lock);
+  while (0 == q->depth && !q->closed)
+  {
+    pthread_cond_wait(&q->notEmpty, &q->lock);
+  }
+  if (0 == q->depth)
+  {
+    pthread_mutex_unlock(&q->lock);
+    return false;
+  }
+  *out = q->slots[q->head];
+  q->head = (q->head + 1) % q->capacity;
+  q->depth--;
+  q->stats.dequeued++;
+  waited = nowUs() - out->enqueuedUs;
+  histAdd(&q->interval, waited);
+  histAdd(&q->overall, waited);
+  pthread_cond_signal(&q->notFull);
+  pthread_mutex_unlock(&q->lock);
+  return true;
+}
+
+static void TQ_close(TagQueue *q)
+{
+  pthread_mutex_lock(&q->lock);
+  q->closed = true;
+  pthread_cond_broadcast(&q->notEmpty);
+  pthread_cond_broadcast(&q->notFull);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * helper function to take a consistent snapshot of the instrumentation.
+ * The interval histogram is handed over and restarted when requested.
+ */
+static void TQ_snapshot(TagQueue *q, TagQueueStats *stats,
+                        LatencyHistogram *interval, bool resetInterval)
+{
+  pthread_mutex_lock(&q->lock);
+  *stats = q->stats;
+  stats->depth = q->depth;
+  if (NULL != interval)
+  {
+    *interval = q->interval;
+  }
+  if (resetInterval)
+  {
+    memset(&q->interval, 0, sizeof(q->interval));
+  }
+  pthread_mutex_unlock(&q->lock);
+}
+
+/* Consumer state */
+typedef struct Consumer
+{
+  TagQueue *queue;
+  uint32_t workUs;
+  uint64_t processed;
+} Consumer;
+
+static void *consumerThread(void *arg)
+{
+  Consumer *c = arg;
+  QueuedRead rec;
+  uint64_t until;
+
+  while (TQ_pop(c->queue, &rec))
+  {
+    /* Stand-in for the application's per-read work */
+    if (0 != c->workUs)
+    {
+      until = nowUs() + c->workUs;
+      while (nowUs() < until)
+      {
+        usleep(50);
+      }
+    }
+    c->processed++;
+  }
+  return NULL;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  TQ_push(cookie, t);
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+/* helper function to print one line of queue metrics */
+static void printStats(const char *label, const TagQueueStats *now,
+                       const TagQueueStats *prev, const LatencyHistogram *h,
+                       double seconds)
+{
+  printf("%-8s depth %5" PRIu32 "/%-5" PRIu32 " hwm %5" PRIu32
+         "  in %8.1f/s  out %8.1f/s  overflow %6" PRIu64
+         "  queued us p50 %6" PRIu64 " p90 %6" PRIu64 " p99 %6" PRIu64 " max %6" PRIu64 "\n",
+         label, now->depth, now->capacity, now->highWater,
+         (now->enqueued - prev->enqueued) / seconds,
+         (now->dequeued - prev->dequeued) / seconds,
+         now->overflows - prev->overflows,
+         histPercentile(h, 50), histPercentile(h, 90),
+         histPercentile(h, 99), h->maxUs);
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t queueSlots = DEFAULT_QUEUE_SLOTS;
+  uint32_t interval = DEFAULT_INTERVAL_S;
+  uint32_t duration = DEFAULT_DURATION_S;
+  bool blockWhenFull = false;
+  TagQueue *queue;
+  Consumer consumer;
+  pthread_t consumerTid;
+  TagQueueStats stats, prev, zero;
+  LatencyHistogram hist;
+  uint64_t start, last, now;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  memset(&consumer, 0, sizeof(consumer));
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--queue", argv[i]))
+    {
+      queueSlots = (uint32_t)atoi(argv[i+1]);
+      if (0 == queueSlots)
+      {
+        errx(1, "--queue must be at least 1\n");
+      }
+    }
+    else if (0x00 == strcmp("--work", argv[i]))
+    {
+      consumer.workUs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--block", argv[i]))
+    {
+      blockWhenFull = (0 != atoi(argv[i+1]));
+    }
+    else if (0x00 == strcmp("--interval", argv[i]))
+    {
+      interval = (uint32_t)atoi(argv[i+1]);
+      if (0 == interval)
+      {
+        errx(1, "--interval must be at least 1\n");
+      }
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      duration = (uint32_t)atoi(argv[i+1]);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  queue = malloc(sizeof(*queue));
+  if (NULL == queue || !TQ_init(queue, queueSlots, blockWhenFull))
+  {
+    errx(1, "Can't allocate a queue of %" PRIu32 " reads\n", queueSlots);
+  }
+  consumer.queue = queue;
+  if (0 != pthread_create(&consumerTid, NULL, consumerThread, &consumer))
+  {
+    errx(1, "Can't start consumer thread\n");
+  }
+
+  rlb.listener = callback;
+  rlb.cookie = queue;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  printf("Reading for %" PRIu32 " seconds, queue of %" PRIu32 " reads (%s when full)\n",
+         duration, queueSlots, blockWhenFull ? "block" : "drop");
+
+  memset(&prev, 0, sizeof(prev));
+  start = last = tmr_gettime();
+  while (tmr_gettime() - start < (uint64_t)duration * 1000)
+  {
+    tmr_sleep(interval * 1000);
+    now = tmr_gettime();
+    TQ_snapshot(queue, &stats, &hist, true);
+    printStats("interval", &stats, &prev, &hist, (now - last) / 1000.0);
+    prev = stats;
+    last = now;
+  }
+
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+  TQ_close(queue);
+  pthread_join(consumerTid, NULL);
+
+  TQ_snapshot(queue, &stats, NULL, false);
+  memset(&zero, 0, sizeof(zero));
+  printStats("overall", &stats, &zero, &queue->overall, (tmr_gettime() - start) / 1000.0);
+  printf("%" PRIu64 " reads processed, %" PRIu64 " dropped, %.1f ms spent blocked\n",
+         consumer.processed, stats.overflows, stats.blockedUs / 1000.0);
+
+  TMR_destroy(rp);
+  free(queue->slots);
+  free(queue);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
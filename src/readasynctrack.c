@@ -1,6 +1,7 @@
 /**
  * Sample program that reads tags in the background and track tags
- * that have been seen;
+ * that have been seen; --track sketch counts them at fixed memory
+ * instead of storing every EPC;
  * @file readasynctrack.c
  */
 
@@ -9,6 +10,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <math.h>
 #ifndef WIN32
 #include <string.h>
 #include <unistd.h>
@@ -21,7 +23,8 @@
 
 #define usage() {errx(1, "Please provide reader URL, such as:\n"\
                          "tmr:///com4 or tmr:///com4 --ant 1,2\n"\
-                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+                         "tmr:///com4 --ant 1,2 --track sketch --duration 60000 --save lane1.sketch\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2 --track sketch --merge lane1.sketch\n");}
 
 typedef struct tagdb_table
 {
@@ -153,6 +156,370 @@ void db_free(tag_database *db)
 }
 
 
+/**
+ * Sketch tracking backend, selected with --track sketch.
+ *
+ * The tag database above keeps every EPC for the whole run. The sketch
+ * keeps a fixed amount of state however many tags go by: a HyperLogLog
+ * for the unique tag count and a Count-Min sketch with a short list of
+ * candidates for the most-read tags. One sketch is kept per antenna and
+ * one overall. Sketches merge (registers by max, counters by sum), so the
+ * state saved with --save on several readers can be combined with --merge.
+ */
+#define HLL_PRECISION 14   /* about 0.8% standard error */
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+#define CM_DEPTH 4
+#define CM_WIDTH 2048
+#define TOPK_SIZE 10
+#define SKETCH_MAGIC 0x4B534D54   /* "TMSK" */
+#define SKETCH_VERSION 1
+
+typedef struct topk_entry
+{
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint32_t count;
+} topk_entry;
+
+typedef struct tag_sketch
+{
+  uint64_t reads;
+  uint8_t registers[HLL_REGISTERS];
+  uint32_t cm[CM_DEPTH][CM_WIDTH];
+  topk_entry topk[TOPK_SIZE];
+  uint32_t topkLen;
+  /* Kept up to date so an estimate doesn't have to scan the registers */
+  double hllSum;
+  uint32_t hllZeros;
+} tag_sketch;
+
+typedef struct sketch_set
+{
+  tag_sketch global;
+  tag_sketch *antenna[256];
+} sketch_set;
+
+uint64_t sketch_hash(const uint8_t *epc, uint8_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    h ^= epc[i];
+    h *= 1099511628211ULL;
+  }
+  /* Finalizer, so the high bits used by the HyperLogLog are well mixed */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void sketch_init(tag_sketch *sk)
+{
+  memset(sk, 0, sizeof(*sk));
+  sk->hllSum = HLL_REGISTERS;
+  sk->hllZeros = HLL_REGISTERS;
+}
+
+/* recompute the cached sums, after a merge or a load */
+void sketch_resum(tag_sketch *sk)
+{
+  uint32_t i;
+
+  sk->hllSum = 0;
+  sk->hllZeros = 0;
+  for (i = 0; i < HLL_REGISTERS; i++)
+  {
+    sk->hllSum += ldexp(1.0, -sk->registers[i]);
+    if (0 == sk->registers[i])
+    {
+      sk->hllZeros++;
+    }
+  }
+}
+
+uint32_t cm_estimate(const tag_sketch *sk, uint64_t h)
+{
+  uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+  uint32_t i, c, min = UINT32_MAX;
+
+  for (i = 0; i < CM_DEPTH; i++)
+  {
+    c = sk->cm[i][(h1 + i * h2) & (CM_WIDTH - 1)];
+    min = (c < min) ? c : min;
+  }
+  return min;
+}
+
+/* helper function to offer a tag with its estimated count to the top-K list */
+void topk_offer(tag_sketch *sk, const uint8_t *epc, uint8_t len, uint32_t count)
+{
+  topk_entry *e, *min = NULL;
+  uint32_t i;
+
+  for (i = 0; i < sk->topkLen; i++)
+  {
+    e = &sk->topk[i];
+    if (e->epcByteCount == len && 0 == memcmp(e->epc, epc, len))
+    {
+      e->count = count;
+      return;
+    }
+    if (NULL == min || e->count < min->count)
+    {
+      min = e;
+    }
+  }
+  if (sk->topkLen < TOPK_SIZE)
+  {
+    min = &sk->topk[sk->topkLen++];
+  }
+  else if (count <= min->count)
+  {
+    return;
+  }
+  min->epcByteCount = len;
+  memcpy(min->epc, epc, len);
+  min->count = count;
+}
+
+void sketch_add(tag_sketch *sk, const uint8_t *epc, uint8_t len)
+{
+  uint64_t h = sketch_hash(epc, len);
+  uint64_t w = (h << HLL_PRECISION) | (1ULL << (HLL_PRECISION - 1));
+  uint32_t idx = (uint32_t)(h >> (64 - HLL_PRECISION));
+  uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+  uint8_t rank = 1;
+  uint32_t i;
+
+  sk->reads++;
+
+  while (0 == (w & (1ULL << 63)))
+  {
+    rank++;
+    w <<= 1;
+  }
+  if (rank > sk->registers[idx])
+  {
+    sk->hllSum += ldexp(1.0, -rank) - ldexp(1.0, -sk->registers[idx]);
+    if (0 == sk->registers[idx])
+    {
+      sk->hllZeros--;
+    }
+    sk->registers[idx] = rank;
+  }
+
+  for (i = 0; i < CM_DEPTH; i++)
+  {
+    sk->cm[i][(h1 + i * h2) & (CM_WIDTH - 1)]++;
+  }
+  topk_offer(sk, epc, len, cm_estimate(sk, h));
+}
+
+double sketch_unique(const tag_sketch *sk)
+{
+  double m = HLL_REGISTERS;
+  double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sk->hllSum;
+
+  /* Small range correction: linear counting while registers are still empty */
+  if (estimate <= 2.5 * m && 0 != sk->hllZeros)
+  {
+    estimate = m * log(m / sk->hllZeros);
+  }
+  return estimate;
+}
+
+void sketch_merge(tag_sketch *dst, const tag_sketch *src)
+{
+  topk_entry candidates[TOPK_SIZE];
+  uint32_t i, j, count;
+
+  dst->reads += src->reads;
+  for (i = 0; i < HLL_REGISTERS; i++)
+  {
+    if (src->registers[i] > dst->registers[i])
+    {
+      dst->registers[i] = src->registers[i];
+    }
+  }
+  for (i = 0; i < CM_DEPTH; i++)
+  {
+    for (j = 0; j < CM_WIDTH; j++)
+    {
+      dst->cm[i][j] += src->cm[i][j];
+    }
+  }
+  sketch_resum(dst);
+
+  /* Candidates from both sides, re-ranked on the merged counters */
+  memcpy(candidates, dst->topk, sizeof(candidates));
+  count = dst->topkLen;
+  dst->topkLen = 0;
+  for (i = 0; i < count; i++)
+  {
+    topk_offer(dst, candidates[i].epc, candidates[i].epcByteCount,
+               cm_estimate(dst, sketch_hash(candidates[i].epc, candidates[i].epcByteCount)));
+  }
+  for (i = 0; i < src->topkLen; i++)
+  {
+    topk_offer(dst, src->topk[i].epc, src->topk[i].epcByteCount,
+               cm_estimate(dst, sketch_hash(src->topk[i].epc, src->topk[i].epcByteCount)));
+  }
+}
+
+tag_sketch *sketch_antenna(sketch_set *set, uint8_t antenna)
+{
+  if (NULL == set->antenna[antenna])
+  {
+    set->antenna[antenna] = malloc(sizeof(tag_sketch));
+    if (NULL != set->antenna[antenna])
+    {
+      sketch_init(set->antenna[antenna]);
+    }
+  }
+  return set->antenna[antenna];
+}
+
+void sketch_set_free(sketch_set *set)
+{
+  int i;
+
+  for (i = 0; i < 256; i++)
+  {
+    free(set->antenna[i]);
+  }
+  free(set);
+}
+
+/**
+ * Save the sketch set. The file holds the raw sketches in host byte
+ * order: global first, then antenna number and sketch for each antenna.
+ */
+TMR_Status sketch_save(sketch_set *set, const char *path)
+{
+  FILE *f;
+  uint32_t header[2] = {SKETCH_MAGIC, SKETCH_VERSION};
+  uint8_t antenna;
+  int i;
+  bool ok;
+
+  if (NULL == (f = fopen(path, "wb")))
+  {
+    return TMR_ERROR_NOT_FOUND;
+  }
+  ok = (1 == fwrite(header, sizeof(header), 1, f))
+       && (1 == fwrite(&set->global, sizeof(tag_sketch), 1, f));
+  for (i = 0; ok && i < 256; i++)
+  {
+    if (NULL != set->antenna[i])
+    {
+      antenna = (uint8_t)i;
+      ok = (1 == fwrite(&antenna, 1, 1, f))
+           && (1 == fwrite(set->antenna[i], sizeof(tag_sketch), 1, f));
+    }
+  }
+  ok = (0 == fclose(f)) && ok;
+  return ok ? TMR_SUCCESS : TMR_ERROR_INVALID;
+}
+
+/* Merge a file written by sketch_save into the sketch set */
+TMR_Status sketch_merge_file(sketch_set *set, const char *path)
+{
+  FILE *f;
+  uint32_t header[2];
+  uint8_t antenna;
+  tag_sketch *in, *dst;
+  TMR_Status ret = TMR_SUCCESS;
+
+  if (NULL == (f = fopen(path, "rb")))
+  {
+    return TMR_ERROR_NOT_FOUND;
+  }
+  in = malloc(sizeof(tag_sketch));
+  if (NULL == in)
+  {
+    fclose(f);
+    return TMR_ERROR_OUT_OF_MEMORY;
+  }
+  if (1 != fread(header, sizeof(header), 1, f) || SKETCH_MAGIC != header[0]
+      || SKETCH_VERSION != header[1] || 1 != fread(in, sizeof(tag_sketch), 1, f))
+  {
+    ret = TMR_ERROR_INVALID;
+  }
+  else
+  {
+    sketch_merge(&set->global, in);
+    while (1 == fread(&antenna, 1, 1, f))
+    {
+      if (1 != fread(in, sizeof(tag_sketch), 1, f))
+      {
+        ret = TMR_ERROR_INVALID;
+        break;
+      }
+      if (NULL == (dst = sketch_antenna(set, antenna)))
+      {
+        ret = TMR_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      sketch_merge(dst, in);
+    }
+  }
+  free(in);
+  fclose(f);
+  return ret;
+}
+
+void sketch_print_top(const tag_sketch *sk, const char *indent)
+{
+  const topk_entry *order[TOPK_SIZE], *tmp;
+  char epcStr[128];
+  uint32_t i, j;
+
+  for (i = 0; i < sk->topkLen; i++)
+  {
+    order[i] = &sk->topk[i];
+  }
+  for (i = 1; i < sk->topkLen; i++)
+  {
+    for (j = i; j > 0 && order[j]->count > order[j - 1]->count; j--)
+    {
+      tmp = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = tmp;
+    }
+  }
+  for (i = 0; i < sk->topkLen; i++)
+  {
+    TMR_bytesToHex(order[i]->epc, order[i]->epcByteCount, epcStr);
+    printf("%s%s ~%" PRIu32 " reads\n", indent, epcStr, order[i]->count);
+  }
+}
+
+void sketch_report(sketch_set *set)
+{
+  int i;
+
+  printf("\nAll antennas: ~%.0f unique tags, %" PRIu64 " reads\n",
+         sketch_unique(&set->global), set->global.reads);
+  sketch_print_top(&set->global, "  ");
+  for (i = 0; i < 256; i++)
+  {
+    if (NULL != set->antenna[i])
+    {
+      printf("Antenna %d: ~%.0f unique tags, %" PRIu64 " reads\n",
+             i, sketch_unique(set->antenna[i]), set->antenna[i]->reads);
+      sketch_print_top(set->antenna[i], "  ");
+    }
+  }
+}
+
+sketch_set *sketches;
+bool useSketch = false;
+
 void errx(int exitval, const char *fmt, ...)
 {
   va_list ap;
@@ -255,6 +622,10 @@ int main(int argc, char *argv[])
   uint8_t antennaCount = 0x0;
   TMR_String model;
   char str[64];
+  uint32_t durationMs = 1000;
+  const char *savePath = NULL;
+  char *mergePaths[16];
+  int mergeCount = 0, m;
  #if USE_TRANSPORT_LISTENER
   TMR_TransportListenerBlock tb;
 #endif
@@ -266,6 +637,11 @@ int main(int argc, char *argv[])
 
   for (i = 2; i < argc; i+=2)
   {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
     if(0x00 == strcmp("--ant", argv[i]))
     {
       if (NULL != antennaList)
@@ -276,12 +652,44 @@ int main(int argc, char *argv[])
       parseAntennaList(buffer, &antennaCount, argv[i+1]);
       antennaList = buffer;
     }
+    else if (0x00 == strcmp("--track", argv[i]))
+    {
+      if (0x00 == strcmp("sketch", argv[i+1]))
+      {
+        useSketch = true;
+      }
+      else if (0x00 != strcmp("exact", argv[i+1]))
+      {
+        errx(1, "--track must be exact or sketch\n");
+      }
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      durationMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--save", argv[i]))
+    {
+      savePath = argv[i+1];
+    }
+    else if (0x00 == strcmp("--merge", argv[i]))
+    {
+      if (mergeCount >= (int)(sizeof(mergePaths) / sizeof(mergePaths[0])))
+      {
+        errx(1, "Too many --merge files\n");
+      }
+      mergePaths[mergeCount++] = argv[i+1];
+    }
     else
     {
       fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
       usage();
     }
   }
+
+  if (!useSketch && (NULL != savePath || 0 != mergeCount))
+  {
+    errx(1, "--save and --merge need --track sketch\n");
+  }
   
   rp = &r;
   ret = TMR_create(rp, argv[1]);
@@ -366,22 +774,50 @@ int main(int argc, char *argv[])
   ret = TMR_addReadExceptionListener(rp, &reb);
   checkerr(rp, ret, 1, "adding exception listener");
 
-  seenTags = init_tag_database(db_size);
+  if (useSketch)
+  {
+    sketches = calloc(1, sizeof(sketch_set));
+    if (NULL == sketches)
+    {
+      errx(1, "Out of memory\n");
+    }
+    sketch_init(&sketches->global);
+    /* Start from the counts saved by earlier runs or other readers */
+    for (m = 0; m < mergeCount; m++)
+    {
+      if (TMR_SUCCESS != sketch_merge_file(sketches, mergePaths[m]))
+      {
+        errx(1, "Can't merge sketch file %s\n", mergePaths[m]);
+      }
+    }
+  }
+  else
+  {
+    seenTags = init_tag_database(db_size);
+  }
 
   ret = TMR_startReading(rp);
   checkerr(rp, ret, 1, "starting reading");
   
-#ifndef WIN32
-  sleep(1);
-#else
-  Sleep(1000);
-#endif
+  tmr_sleep(durationMs);
 
   ret = TMR_stopReading(rp);
   checkerr(rp, ret, 1, "stopping reading");
 
   ret = TMR_removeReadListener(rp, &rlb);
-  db_free(seenTags);
+  if (useSketch)
+  {
+    sketch_report(sketches);
+    if (NULL != savePath && TMR_SUCCESS != sketch_save(sketches, savePath))
+    {
+      fprintf(stdout, "Can't save sketch file %s\n", savePath);
+    }
+    sketch_set_free(sketches);
+  }
+  else
+  {
+    db_free(seenTags);
+  }
   TMR_destroy(rp);
   return 0;
 
@@ -394,8 +830,20 @@ callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
 {
   char epcStr[128];
   static int uniqueCount, totalCount;
+  tag_sketch *sk;
 
   TMR_bytesToHex(t->tag.epc, t->tag.epcByteCount, epcStr);
+  if (useSketch)
+  {
+    sketch_add(&sketches->global, t->tag.epc, t->tag.epcByteCount);
+    if (NULL != (sk = sketch_antenna(sketches, t->antenna)))
+    {
+      sketch_add(sk, t->tag.epc, t->tag.epcByteCount);
+    }
+    printf("Background read: %s, total tags seen = %d, unique tags seen ~ %.0f\n",
+           epcStr, ++totalCount, sketch_unique(&sketches->global));
+    return;
+  }
   /**
    * If the tag is not present in the database, only then 
    * insert the tag. 
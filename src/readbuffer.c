@@ -263,9 +263,8 @@ int main(int argc, char *argv[])
 
 	  ret = TMR_executeTagOp(rp, &newtagop, NULL, &dataList);
 	  checkerr(rp, ret, 1, "executing Untraceable tagop");
-	  //TODO:Currently C API don't have support for decrypting raw data.
-	  // TO decrypt this data use online AES decryptor
-	  //http://aes.online-domain-tools.com/
+	  //Raw data is encrypted with the tag key, tamverify.c shows
+	  //how to decrypt and verify it locally.
 	  TMR_bytesToHex(dataList.list,dataList.len,dataStr);
 	  printf("Returned buffer Data:%s\n",dataStr);
 
@@ -285,9 +284,8 @@ int main(int argc, char *argv[])
 	  ret = TMR_executeTagOp(rp, &newtagop, NULL, &dataList);
 	  checkerr(rp, ret, 1, "executing Untraceable tagop");
 	 
-	  //TODO:Currently C API don't have support for decrypting raw data.
-	  // TO decrypt this data use online AES decryptor
-	  //http://aes.online-domain-tools.com/
+	  //Raw data is encrypted with the tag key, tamverify.c shows
+	  //how to decrypt and verify it locally.
 	  TMR_bytesToHex(dataList.list,dataList.len,dataStr);
 	  printf("Returned buffer Data:%s\n",dataStr);*/
 	 
@@ -307,9 +305,8 @@ int main(int argc, char *argv[])
 
 	  ret = TMR_executeTagOp(rp, &newtagop, NULL, &dataList);
 	  checkerr(rp, ret, 1, "executing Untraceable tagop");
-	  //TODO:Currently C API don't have support for decrypting raw data.
-	  // TO decrypt this data use online AES decryptor
-	  //http://aes.online-domain-tools.com/
+	  //Raw data is encrypted with the tag key, tamverify.c shows
+	  //how to decrypt and verify it locally.
 	  TMR_bytesToHex(dataList.list,dataList.len,dataStr);
 	  printf("Returned buffer Data:%s\n",dataStr);*/
 	} 
@@ -0,0 +1,1190 @@
+/**
+ * Sample program that shares one reader between many local clients.
+ *
+ * The broker owns the reader and keeps it reading in the background.
+ * Local clients connect to a Unix domain socket and speak a line based
+ * text protocol (try "socat - UNIX-CONNECT:/tmp/readerbroker.sock"):
+ *
+ *   SUBSCRIBE tags [epc=HEXPREFIX] [ant=N] [rssi=MIN]
+ *   SUBSCRIBE stats
+ *   UNSUBSCRIBE tags|stats
+ *   GET /reader/radio/readPower
+ *   SET /reader/radio/readPower 2500
+ *   READ bank wordAddress wordCount [EPC]
+ *
+ * Tag reads are decoded once and pushed to every subscriber whose filter
+ * matches, so any number of consumers share the same RF cycles. Stats are
+ * published periodically. GET, SET and READ need the reader itself: they
+ * go through an arbitration queue served by the one thread that owns the
+ * reader, which pauses background reading, runs every queued request in
+ * arrival order and resumes. Replies start with OK or ERR, events with
+ * TAG or STATS. A subscriber that can't keep up loses tag lines (counted
+ * in the stats) instead of slowing the reader down.
+ * @file readerbroker.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --socket /tmp/readerbroker.sock --stats 5\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+#define DEFAULT_SOCKET "/tmp/readerbroker.sock"
+#define DEFAULT_STATS_S 5
+#define MAX_CLIENTS 32
+#define CLIENT_IN_LEN 512
+/* Pending output per client; tag lines that don't fit are dropped */
+#define CLIENT_OUT_LEN 65536
+#define MAX_LINE_LEN 256
+/* Arbitration queue length */
+#define MAX_COMMANDS 64
+
+/* What a client wants to receive */
+typedef struct Subscription
+{
+  bool tags;
+  bool stats;
+  uint8_t epcPrefix[TMR_MAX_EPC_BYTE_COUNT];
+  uint8_t epcPrefixLen;
+  uint8_t antenna;           /* 0 = any */
+  int32_t minRssi;
+  bool checkRssi;
+} Subscription;
+
+/* One connected client */
+typedef struct Client
+{
+  int fd;                    /* -1 when the slot is free */
+  uint32_t id;               /* unique, so late replies never reach a reused slot */
+  char in[CLIENT_IN_LEN];
+  size_t inLen;
+  char *out;
+  size_t outHead;
+  size_t outLen;
+  uint32_t dropped;
+  /* Requests still in the arbitration queue */
+  uint32_t pending;
+  Subscription sub;
+} Client;
+
+/* A request that needs the reader */
+typedef struct Command
+{
+  uint32_t clientId;
+  char line[MAX_LINE_LEN];
+} Command;
+
+/* Broker state shared by the I/O thread, the arbiter and the read listener */
+typedef struct Broker
+{
+  pthread_mutex_t lock;
+  pthread_cond_t commandReady;
+  Client clients[MAX_CLIENTS];
+  uint32_t nextClientId;
+  int listenFd;
+  int wakePipe[2];
+  /* Arbitration queue */
+  Command commands[MAX_COMMANDS];
+  int cmdHead;
+  int cmdCount;
+  /* Statistics */
+  uint64_t totalReads;
+  uint64_t intervalReads;
+  uint64_t commandsServed;
+  uint64_t droppedLines;
+  uint32_t readErrors;
+  uint32_t statsIntervalMs;
+  uint64_t started;
+} Broker;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static void onSignal(int sig)
+{
+  stopRequested = 1;
+}
+
+/* helper function to convert a hex string to bytes, returns the byte count or -1 */
+static int hexToBytes(const char *hex, uint8_t *out, int max)
+{
+  int len = (int)strlen(hex);
+  int i;
+  unsigned int byte;
+
+  if (0 != (len & 1) || len / 2 > max)
+  {
+    return -1;
+  }
+  for (i = 0; i < len / 2; i++)
+  {
+    if (1 != sscanf(hex + 2 * i, "%2x", &byte))
+    {
+      return -1;
+    }
+    out[i] = (uint8_t)byte;
+  }
+  return len / 2;
+}
+
+/* helper function to wake the I/O thread out of poll() */
+static void wakeIo(Broker *b)
+{
+  char c = 0;
+
+  if (write(b->wakePipe[1], &c, 1) < 0)
+  {
+    /* Pipe already full, the I/O thread is awake anyway */
+  }
+}
+
+/**
+ * helper function to queue a line for a client. Must be called with the
+ * broker lock held. Returns false if it didn't fit.
+ */
+static bool clientSend(Client *c, const char *line, size_t len)
+{
+  size_t tail, first;
+
+  if (len > CLIENT_OUT_LEN - c->outLen)
+  {
+    return false;
+  }
+  tail = (c->outHead + c->outLen) % CLIENT_OUT_LEN;
+  first = (len < CLIENT_OUT_LEN - tail) ? len : CLIENT_OUT_LEN - tail;
+  memcpy(c->out + tail, line, first);
+  memcpy(c->out, line + first, len - first);
+  c->outLen += len;
+  return true;
+}
+
+/* helper function to send a reply to a client by id, if it is still connected */
+static void replyTo(Broker *b, uint32_t clientId, const char *fmt, ...)
+{
+  char line[MAX_LINE_LEN * 2];
+  va_list ap;
+  int len, i;
+
+  va_start(ap, fmt);
+  len = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+  va_end(ap);
+  if (len < 0)
+  {
+    return;
+  }
+  if (len > (int)sizeof(line) - 2)
+  {
+    len = sizeof(line) - 2;
+  }
+  line[len++] = '\n';
+
+  pthread_mutex_lock(&b->lock);
+  for (i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (-1 != b->clients[i].fd && clientId == b->clients[i].id)
+    {
+      /* Replies must not get lost: make room by dropping queued events */
+      if (!clientSend(&b->clients[i], line, len))
+      {
+        b->clients[i].outHead = b->clients[i].outLen = 0;
+        b->clients[i].dropped++;
+        clientSend(&b->clients[i], line, len);
+      }
+      break;
+    }
+  }
+  pthread_mutex_unlock(&b->lock);
+  wakeIo(b);
+}
+
+/* helper function to check a tag read against a subscription */
+static bool matches(const Subscription *s, const TMR_TagReadData *t)
+{
+  if (!s->tags)
+  {
+    return false;
+  }
+  if (0 != s->antenna && t->antenna != s->antenna)
+  {
+    return false;
+  }
+  if (s->checkRssi && t->rssi < s->minRssi)
+  {
+    return false;
+  }
+  if (0 != s->epcPrefixLen
+      && (t->tag.epcByteCount < s->epcPrefixLen
+          || 0 != memcmp(t->tag.epc, s->epcPrefix, s->epcPrefixLen)))
+  {
+    return false;
+  }
+  return true;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  Broker *b = cookie;
+  char epcStr[128];
+  char line[MAX_LINE_LEN];
+  int len, i;
+  bool sent = false;
+  uint64_t ts;
+
+  TMR_bytesToHex(t->tag.epc, t->tag.epcByteCount, epcStr);
+  ts = ((uint64_t)t->timestampHigh << 32) | t->timestampLow;
+  len = snprintf(line, sizeof(line), "TAG %s ant=%u rssi=%d t=%" PRIu64 "\n",
+                 epcStr, t->antenna, t->rssi, ts);
+  if (len >= (int)sizeof(line))
+  {
+    len = sizeof(line) - 1;
+  }
+
+  pthread_mutex_lock(&b->lock);
+  b->totalReads++;
+  b->intervalReads++;
+  for (i = 0; i < MAX_CLIENTS; i++)
+  {
+    Client *c = &b->clients[i];
+
+    if (-1 == c->fd || !matches(&c->sub, t))
+    {
+      continue;
+    }
+    if (clientSend(c, line, len))
+    {
+      sent = true;
+    }
+    else
+    {
+      c->dropped++;
+      b->droppedLines++;
+    }
+  }
+  pthread_mutex_unlock(&b->lock);
+  if (sent)
+  {
+    wakeIo(b);
+  }
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  Broker *b = cookie;
+
+  pthread_mutex_lock(&b->lock);
+  b->readErrors++;
+  pthread_mutex_unlock(&b->lock);
+  fprintf(stderr, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+/* helper function to parse a SUBSCRIBE or UNSUBSCRIBE line (lock held) */
+static const char *handleSubscription(Client *c, char *args, bool subscribe)
+{
+  char *tok, *save = NULL;
+  Subscription s;
+  int n;
+
+  tok = strtok_r(args, " ", &save);
+  if (NULL == tok)
+  {
+    return "ERR expected tags or stats";
+  }
+  if (0 == strcmp("stats", tok))
+  {
+    c->sub.stats = subscribe;
+    return "OK";
+  }
+  if (0 != strcmp("tags", tok))
+  {
+    return "ERR expected tags or stats";
+  }
+  if (!subscribe)
+  {
+    c->sub.tags = false;
+    return "OK";
+  }
+
+  memset(&s, 0, sizeof(s));
+  s.tags = true;
+  s.stats = c->sub.stats;
+  while (NULL != (tok = strtok_r(NULL, " ", &save)))
+  {
+    if (0 == strncmp("epc=", tok, 4))
+    {
+      n = hexToBytes(tok + 4, s.epcPrefix, sizeof(s.epcPrefix));
+      if (n < 0)
+      {
+        return "ERR bad epc prefix";
+      }
+      s.epcPrefixLen = (uint8_t)n;
+    }
+    else if (0 == strncmp("ant=", tok, 4))
+    {
+      s.antenna = (uint8_t)atoi(tok + 4);
+    }
+    else if (0 == strncmp("rssi=", tok, 5))
+    {
+      s.minRssi = atoi(tok + 5);
+      s.checkRssi = true;
+    }
+    else
+    {
+      return "ERR unknown filter";
+    }
+  }
+  c->sub = s;
+  return "OK";
+}
+
+/* helper function to append a request to the arbitration queue (lock held) */
+static bool queueCommand(Broker *b, Client *c, const char *fmt, const char *text)
+{
+  Command *cmd;
+
+  if (MAX_COMMANDS == b->cmdCount)
+  {
+    return false;
+  }
+  cmd = &b->commands[(b->cmdHead + b->cmdCount) % MAX_COMMANDS];
+  cmd->clientId = c->id;
+  snprintf(cmd->line, sizeof(cmd->line), fmt, text);
+  b->cmdCount++;
+  c->pending++;
+  pthread_cond_signal(&b->commandReady);
+  return true;
+}
+
+/* helper function to handle one complete line from a client (lock held) */
+static void handleLine(Broker *b, Client *c, char *line)
+{
+  const char *reply = NULL;
+  char r[64];
+
+  if ('\0' == line[0])
+  {
+    return;
+  }
+  if (0 == strncmp("SUBSCRIBE", line, 9) && (' ' == line[9] || '\0' == line[9]))
+  {
+    reply = handleSubscription(c, line + 9, true);
+  }
+  else if (0 == strncmp("UNSUBSCRIBE", line, 11) && (' ' == line[11] || '\0' == line[11]))
+  {
+    reply = handleSubscription(c, line + 11, false);
+  }
+  else if (0 == strncmp("GET ", line, 4) || 0 == strncmp("SET ", line, 4)
+           || 0 == strncmp("READ ", line, 5))
+  {
+    if (!queueCommand(b, c, "%s", line))
+    {
+      reply = "ERR busy";
+    }
+  }
+  else
+  {
+    reply = "ERR unknown command";
+  }
+
+  /* Replies go out in request order: behind queued requests, if any */
+  if (NULL != reply && (0 == c->pending || !queueCommand(b, c, "REPLY %s", reply)))
+  {
+    snprintf(r, sizeof(r), "%s\n", reply);
+    clientSend(c, r, strlen(r));
+  }
+}
+
+/* helper function to release a client slot (lock held) */
+static void closeClient(Client *c)
+{
+  close(c->fd);
+  c->fd = -1;
+  c->inLen = 0;
+  c->outHead = c->outLen = 0;
+  c->pending = 0;
+  memset(&c->sub, 0, sizeof(c->sub));
+}
+
+/* helper function to publish the stats line to stats subscribers (lock held) */
+static void publishStats(Broker *b, uint64_t elapsedMs)
+{
+  char line[MAX_LINE_LEN];
+  int i, clients = 0, len;
+
+  for (i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (-1 != b->clients[i].fd)
+    {
+      clients++;
+    }
+  }
+  len = snprintf(line, sizeof(line), "STATS uptime=%" PRIu64 " reads=%" PRIu64
+                 " rate=%.1f commands=%" PRIu64 " errors=%" PRIu32
+                 " clients=%d dropped=%" PRIu64 "\n",
+                 (tmr_gettime() - b->started) / 1000, b->totalReads,
+                 (0 != elapsedMs) ? b->intervalReads * 1000.0 / elapsedMs : 0.0,
+                 b->commandsServed, b->readErrors, clients, b->droppedLines);
+  b->intervalReads = 0;
+  for (i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (-1 != b->clients[i].fd && b->clients[i].sub.stats)
+    {
+      clientSend(&b->clients[i], line, len);
+    }
+  }
+}
+
+/* I/O thread: accepts clients, parses their requests, flushes their output */
+static void *ioThread(void *arg)
+{
+  Broker *b = arg;
+  struct pollfd fds[MAX_CLIENTS + 2];
+  int slotOf[MAX_CLIENTS + 2];
+  int nfds, i, fd, timeout;
+  uint64_t lastStats = tmr_gettime(), now;
+  ssize_t n;
+  char drain[64];
+  char *nl;
+  Client *c;
+
+  while (!stopRequested)
+  {
+    fds[0].fd = b->listenFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = b->wakePipe[0];
+    fds[1].events = POLLIN;
+    nfds = 2;
+    pthread_mutex_lock(&b->lock);
+    for (i = 0; i < MAX_CLIENTS; i++)
+    {
+      if (-1 != b->clients[i].fd)
+      {
+        fds[nfds].fd = b->clients[i].fd;
+        fds[nfds].events = POLLIN | ((0 != b->clients[i].outLen) ? POLLOUT : 0);
+        slotOf[nfds] = i;
+        nfds++;
+      }
+    }
+    pthread_mutex_unlock(&b->lock);
+
+    now = tmr_gettime();
+    timeout = (int)((lastStats + b->statsIntervalMs > now)
+                    ? lastStats + b->statsIntervalMs - now : 0);
+    if (timeout > 500)
+    {
+      timeout = 500;   /* notice stop requests */
+    }
+    if (poll(fds, nfds, timeout) < 0 && EINTR != errno)
+    {
+      perror("poll");
+      break;
+    }
+
+    if (fds[1].revents & POLLIN)
+    {
+      while (read(b->wakePipe[0], drain, sizeof(drain)) > 0);
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      fd = accept(b->listenFd, NULL, NULL);
+      if (fd >= 0)
+      {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        pthread_mutex_lock(&b->lock);
+        for (i = 0; i < MAX_CLIENTS && -1 != b->clients[i].fd; i++);
+        if (i == MAX_CLIENTS)
+        {
+          close(fd);
+        }
+        else
+        {
+          b->clients[i].fd = fd;
+          b->clients[i].id = ++b->nextClientId;
+          b->clients[i].dropped = 0;
+        }
+        pthread_mutex_unlock(&b->lock);
+      }
+    }
+
+    pthread_mutex_lock(&b->lock);
+    for (i = 2; i < nfds; i++)
+    {
+      c = &b->clients[slotOf[i]];
+      if (c->fd != fds[i].fd)
+      {
+        continue;
+      }
+      if (fds[i].revents & POLLIN)
+      {
+        n = read(c->fd, c->in + c->inLen, sizeof(c->in) - 1 - c->inLen);
+        if (n <= 0)
+        {
+          closeClient(c);
+          continue;
+        }
+        c->inLen += n;
+        c->in[c->inLen] = '\0';
+        while (NULL != (nl = strchr(c->in, '\n')))
+        {
+          *nl = '\0';
+          if (nl > c->in && '\r' == nl[-1])
+          {
+            nl[-1] = '\0';
+          }
+          handleLine(b, c, c->in);
+          c->inLen -= (nl + 1 - c->in);
+          memmove(c->in, nl + 1, c->inLen + 1);
+        }
+        if (c->inLen == sizeof(c->in) - 1)
+        {
+          /* Line too long, throw it away */
+          c->inLen = 0;
+        }
+      }
+      else if (fds[i].revents & (POLLHUP | POLLERR))
+      {
+        closeClient(c);
+        continue;
+      }
+      if (0 != c->outLen)
+      {
+        size_t chunk = CLIENT_OUT_LEN - c->outHead;
+
+        if (chunk > c->outLen)
+        {
+          chunk = c->outLen;
+        }
+        n = send(c->fd, c->out + c->outHead, chunk, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+          c->outHead = (c->outHead + n) % CLIENT_OUT_LEN;
+          c->outLen -= n;
+        }
+        else if (n < 0 && EAGAIN != errno && EWOULDBLOCK != errno)
+        {
+          closeClient(c);
+        }
+      }
+    }
+
+    now = tmr_gettime();
+    if (now - lastStats >= b->statsIntervalMs)
+    {
+      publishStats(b, now - lastStats);
+      lastStats = now;
+    }
+    pthread_mutex_unlock(&b->lock);
+  }
+  return NULL;
+}
+
+/**
+ * helper function to find how a parameter's value is stored, following
+ * the parameter types demo.c handles.
+ */
+typedef enum ParamKind
+{
+  KIND_UNSUPPORTED,
+  KIND_U32,
+  KIND_I32,
+  KIND_U16,
+  KIND_U8,
+  KIND_BOOL,
+  KIND_SESSION,
+  KIND_STRING
+} ParamKind;
+
+static ParamKind paramKind(TMR_Param param)
+{
+  switch (param)
+  {
+  case TMR_PARAM_COMMANDTIMEOUT:
+  case TMR_PARAM_TRANSPORTTIMEOUT:
+  case TMR_PARAM_READ_ASYNCONTIME:
+  case TMR_PARAM_READ_ASYNCOFFTIME:
+  case TMR_PARAM_REGION_HOPTIME:
+    return KIND_U32;
+  case TMR_PARAM_RADIO_READPOWER:
+  case TMR_PARAM_RADIO_WRITEPOWER:
+    return KIND_I32;
+  case TMR_PARAM_RADIO_POWERMAX:
+  case TMR_PARAM_RADIO_POWERMIN:
+  case TMR_PARAM_PRODUCT_GROUP_ID:
+  case TMR_PARAM_PRODUCT_ID:
+    return KIND_U16;
+  case TMR_PARAM_RADIO_TEMPERATURE:
+  case TMR_PARAM_TAGOP_ANTENNA:
+    return KIND_U8;
+  case TMR_PARAM_ANTENNA_CHECKPORT:
+  case TMR_PARAM_RADIO_ENABLEPOWERSAVE:
+  case TMR_PARAM_TAGREADDATA_UNIQUEBYANTENNA:
+  case TMR_PARAM_TAGREADDATA_UNIQUEBYDATA:
+  case TMR_PARAM_TAGREADDATA_ENABLEREADFILTER:
+    return KIND_BOOL;
+  case TMR_PARAM_GEN2_SESSION:
+    return KIND_SESSION;
+  case TMR_PARAM_VERSION_HARDWARE:
+  case TMR_PARAM_VERSION_SERIAL:
+  case TMR_PARAM_VERSION_MODEL:
+  case TMR_PARAM_VERSION_SOFTWARE:
+  case TMR_PARAM_PRODUCT_GROUP:
+  case TMR_PARAM_READER_DESCRIPTION:
+    return KIND_STRING;
+  default:
+    return KIND_UNSUPPORTED;
+  }
+}
+
+/* helper function to run a GET or SET request */
+static void runParam(Broker *b, TMR_Reader *rp, uint32_t clientId, bool set,
+                     const char *name, const char *valueStr)
+{
+  TMR_Param param = TMR_paramID(name);
+  ParamKind kind = paramKind(param);
+  TMR_Status ret;
+  union
+  {
+    uint32_t u32;
+    int32_t i32;
+    uint16_t u16;
+    uint8_t u8;
+    bool flag;
+    TMR_GEN2_Session session;
+  } v;
+  char string[64];
+  TMR_String str;
+
+  if (TMR_PARAM_NONE == param)
+  {
+    replyTo(b, clientId, "ERR no such parameter %s", name);
+    return;
+  }
+  if (KIND_UNSUPPORTED == kind || (set && (KIND_STRING == kind || NULL == valueStr)))
+  {
+    replyTo(b, clientId, "ERR %s is not supported by the broker", name);
+    return;
+  }
+
+  if (set)
+  {
+    switch (kind)
+    {
+    case KIND_U32:     v.u32 = (uint32_t)strtoul(valueStr, NULL, 0); break;
+    case KIND_I32:     v.i32 = (int32_t)strtol(valueStr, NULL, 0); break;
+    case KIND_U16:     v.u16 = (uint16_t)strtoul(valueStr, NULL, 0); break;
+    case KIND_U8:      v.u8 = (uint8_t)strtoul(valueStr, NULL, 0); break;
+    case KIND_BOOL:    v.flag = (0 == strcmp("true", valueStr) || 0 == strcmp("1", valueStr)); break;
+    default:           v.session = (TMR_GEN2_Session)strtoul(valueStr, NULL, 0); break;
+    }
+    ret = TMR_paramSet(rp, param, &v);
+    if (TMR_SUCCESS != ret)
+    {
+      replyTo(b, clientId, "ERR %s", TMR_strerr(rp, ret));
+    }
+    else
+    {
+      replyTo(b, clientId, "OK");
+    }
+    return;
+  }
+
+  if (KIND_STRING == kind)
+  {
+    str.value = string;
+    str.max = sizeof(string);
+    ret = TMR_paramGet(rp, param, &str);
+  }
+  else
+  {
+    ret = TMR_paramGet(rp, param, &v);
+  }
+  if (TMR_SUCCESS != ret)
+  {
+    replyTo(b, clientId, "ERR %s", TMR_strerr(rp, ret));
+    return;
+  }
+  switch (kind)
+  {
+  case KIND_U32:     replyTo(b, clientId, "OK %" PRIu32, v.u32); break;
+  case KIND_I32:     replyTo(b, clientId, "OK %" PRId32, v.i32); break;
+  case KIND_U16:     replyTo(b, clientId, "OK %u", v.u16); break;
+  case KIND_U8:      replyTo(b, clientId, "OK %u", v.u8); break;
+  case KIND_BOOL:    replyTo(b, clientId, "OK %s", v.flag ? "true" : "false"); break;
+  case KIND_SESSION: replyTo(b, clientId, "OK %d", (int)v.session); break;
+  default:           replyTo(b, clientId, "OK %s", str.value); break;
+  }
+}
+
+/* helper function to run a READ request: bank wordAddress wordCount [EPC] */
+static void runRead(Broker *b, TMR_Reader *rp, uint32_t clientId, char *args)
+{
+  char *bankStr, *addrStr, *countStr, *epcStr, *save = NULL;
+  TMR_TagOp op;
+  TMR_TagFilter filter, *fp = NULL;
+  TMR_TagData target;
+  TMR_uint8List data;
+  uint8_t dataStore[128];
+  char hex[2 * sizeof(dataStore) + 1];
+  uint32_t addr;
+  uint8_t count;
+  int n;
+  TMR_Status ret;
+
+  bankStr = strtok_r(args, " ", &save);
+  addrStr = strtok_r(NULL, " ", &save);
+  countStr = strtok_r(NULL, " ", &save);
+  epcStr = strtok_r(NULL, " ", &save);
+  if (NULL == bankStr || NULL == addrStr || NULL == countStr)
+  {
+    replyTo(b, clientId, "ERR usage: READ bank wordAddress wordCount [EPC]");
+    return;
+  }
+  addr = (uint32_t)strtoul(addrStr, NULL, 0);
+  count = (uint8_t)strtoul(countStr, NULL, 0);
+  if (0 == count || count > sizeof(dataStore) / 2)
+  {
+    replyTo(b, clientId, "ERR wordCount must be 1 to %u", (unsigned)(sizeof(dataStore) / 2));
+    return;
+  }
+  if (NULL != epcStr)
+  {
+    n = hexToBytes(epcStr, target.epc, sizeof(target.epc));
+    if (n <= 0)
+    {
+      replyTo(b, clientId, "ERR bad EPC");
+      return;
+    }
+    target.epcByteCount = (uint8_t)n;
+    TMR_TF_init_tag(&filter, &target);
+    fp = &filter;
+  }
+
+  ret = TMR_TagOp_init_GEN2_ReadData(&op, (TMR_GEN2_Bank)strtoul(bankStr, NULL, 0), addr, count);
+  if (TMR_SUCCESS == ret)
+  {
+    data.list = dataStore;
+    data.max = sizeof(dataStore);
+    data.len = 0;
+    ret = TMR_executeTagOp(rp, &op, fp, &data);
+  }
+  if (TMR_SUCCESS != ret)
+  {
+    replyTo(b, clientId, "ERR %s", TMR_strerr(rp, ret));
+    return;
+  }
+  TMR_bytesToHex(data.list, data.len, hex);
+  replyTo(b, clientId, "OK %s", hex);
+}
+
+/* helper function to run one request taken off the arbitration queue */
+static void runCommand(Broker *b, TMR_Reader *rp, Command *cmd)
+{
+  char *verb, *name, *value, *save = NULL;
+
+  if (0 == strncmp("REPLY ", cmd->line, 6))
+  {
+    replyTo(b, cmd->clientId, "%s", cmd->line + 6);
+    return;
+  }
+  verb = strtok_r(cmd->line, " ", &save);
+  if (0 == strcmp("READ", verb))
+  {
+    runRead(b, rp, cmd->clientId, save);
+    return;
+  }
+  name = strtok_r(NULL, " ", &save);
+  value = strtok_r(NULL, " ", &save);
+  if (NULL == name)
+  {
+    replyTo(b, cmd->clientId, "ERR missing parameter name");
+    return;
+  }
+  runParam(b, rp, cmd->clientId, 0 == strcmp("SET", verb), name, value);
+}
+
+/* helper function to create the listening Unix socket */
+static int openSocket(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  unlink(path);
+  if (0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || 0 != listen(fd, 8))
+  {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+int main(int argc, char *argv[])
+{
+
+#if !defined(TMR_ENABLE_BACKGROUND_READS) || defined(WIN32)
+  errx(1, "This sample requires background read functionality\n"
+          "and Unix domain sockets. Please enable TMR_ENABLE_BACKGROUND_READS\n"
+          "in tm_config.h to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  const char *socketPath = DEFAULT_SOCKET;
+  Broker *b;
+  pthread_t io;
+  Command cmd;
+  struct timespec ts;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  b = calloc(1, sizeof(*b));
+  if (NULL == b)
+  {
+    errx(1, "Out of memory\n");
+  }
+  b->statsIntervalMs = DEFAULT_STATS_S * 1000;
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--socket", argv[i]))
+    {
+      socketPath = argv[i+1];
+    }
+    else if (0x00 == strcmp("--stats", argv[i]))
+    {
+      b->statsIntervalMs = (uint32_t)atoi(argv[i+1]) * 1000;
+      if (0 == b->statsIntervalMs)
+      {
+        errx(1, "--stats must be at least 1 second\n");
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  /* Broker state and socket */
+  pthread_mutex_init(&b->lock, NULL);
+  pthread_cond_init(&b->commandReady, NULL);
+  for (i = 0; i < MAX_CLIENTS; i++)
+  {
+    b->clients[i].fd = -1;
+    b->clients[i].out = malloc(CLIENT_OUT_LEN);
+    if (NULL == b->clients[i].out)
+    {
+      errx(1, "Out of memory\n");
+    }
+  }
+  if (0 != pipe(b->wakePipe))
+  {
+    errx(1, "Can't create wake pipe\n");
+  }
+  fcntl(b->wakePipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(b->wakePipe[1], F_SETFL, O_NONBLOCK);
+  b->listenFd = openSocket(socketPath);
+  if (b->listenFd < 0)
+  {
+    errx(1, "Can't listen on %s: %s\n", socketPath, strerror(errno));
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  b->started = tmr_gettime();
+
+  rlb.listener = callback;
+  rlb.cookie = b;
+  reb.listener = exceptionCallback;
+  reb.cookie = b;
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  if (0 != pthread_create(&io, NULL, ioThread, b))
+  {
+    errx(1, "Can't start I/O thread\n");
+  }
+  printf("Broker listening on %s\n", socketPath);
+
+  /**
+   * Arbiter: this thread alone touches the reader after startup. Queued
+   * requests are run in arrival order during one pause of background
+   * reading, so a burst of requests costs a single stop/start.
+   **/
+  pthread_mutex_lock(&b->lock);
+  while (!stopRequested)
+  {
+    if (0 == b->cmdCount)
+    {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += 1;
+      pthread_cond_timedwait(&b->commandReady, &b->lock, &ts);
+      continue;
+    }
+    pthread_mutex_unlock(&b->lock);
+
+    ret = TMR_stopReading(rp);
+    if (TMR_SUCCESS != ret)
+    {
+      fprintf(stderr, "Error stopping reading: %s\n", TMR_strerr(rp, ret));
+    }
+
+    pthread_mutex_lock(&b->lock);
+    while (0 != b->cmdCount)
+    {
+      cmd = b->commands[b->cmdHead];
+      b->cmdHead = (b->cmdHead + 1) % MAX_COMMANDS;
+      b->cmdCount--;
+      pthread_mutex_unlock(&b->lock);
+
+      runCommand(b, rp, &cmd);
+
+      pthread_mutex_lock(&b->lock);
+      b->commandsServed++;
+      for (i = 0; i < MAX_CLIENTS; i++)
+      {
+        if (-1 != b->clients[i].fd && cmd.clientId == b->clients[i].id)
+        {
+          b->clients[i].pending--;
+        }
+      }
+    }
+    pthread_mutex_unlock(&b->lock);
+
+    ret = TMR_startReading(rp);
+    if (TMR_SUCCESS != ret)
+    {
+      fprintf(stderr, "Error restarting reading: %s\n", TMR_strerr(rp, ret));
+    }
+    pthread_mutex_lock(&b->lock);
+  }
+  pthread_mutex_unlock(&b->lock);
+
+  printf("Shutting down\n");
+  pthread_join(io, NULL);
+  TMR_stopReading(rp);
+  TMR_destroy(rp);
+
+  for (i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (-1 != b->clients[i].fd)
+    {
+      close(b->clients[i].fd);
+    }
+    free(b->clients[i].out);
+  }
+  close(b->listenFd);
+  unlink(socketPath);
+  close(b->wakePipe[0]);
+  close(b->wakePipe[1]);
+  pthread_cond_destroy(&b->commandReady);
+  pthread_mutex_destroy(&b->lock);
+  free(b);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
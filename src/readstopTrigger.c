@@ -1,7 +1,8 @@
 /**
  * Sample program that reads the number of tags requested
  * and prints the tags. It is currently not supporting streaming.
- * stop trigger.
+ * stop trigger. See readstopstream.c for stopping background
+ * reading after a number of tags.
  * @file readstopTrigger.c 
  */
 
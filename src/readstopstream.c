@@ -0,0 +1,565 @@
+/**
+ * Sample program that reads continuously until a given number of
+ * unique tags has been seen, then stops straight away.
+ *
+ * readstopTrigger.c uses the read plan's stop trigger, which only works
+ * with a synchronous TMR_read(). Here the stop-N condition is evaluated
+ * on the host while background reading streams tags in: the read
+ * listener counts unique EPCs (optionally only those starting with
+ * --epc-prefix, which is also sent to the tags as a Gen2 select so
+ * non-matching tags stay quiet), and the moment the Nth one arrives a
+ * completion callback fires and reading is stopped, with no fixed read
+ * timeout to wait out. Each transaction reports its time-to-N and the
+ * time until reading had fully stopped; --transactions runs several
+ * back to back, as a checkout lane would.
+ * @file readstopstream.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --count 1 --timeout 2000 --transactions 5\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1 --epc-prefix E200\n");}
+
+#define DEFAULT_COUNT 1
+#define DEFAULT_TIMEOUT_MS 2000
+#define DEFAULT_TRANSACTIONS 1
+/* Pause between two transactions */
+#define TRANSACTION_GAP_MS 500
+/* Unique tag set slots, must be a power of two and larger than --count */
+#define SEEN_SIZE 1024
+
+/* One tag of the current transaction */
+typedef struct SeenTag
+{
+  uint32_t generation;   /* transaction it belongs to, 0 = never used */
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+} SeenTag;
+
+struct StopOnCount;
+typedef void (*CompletionCallback)(struct StopOnCount *stop, void *cookie);
+
+/* Host-side stop-N trigger for background reading */
+typedef struct StopOnCount
+{
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  uint32_t target;
+  uint8_t prefix[TMR_MAX_EPC_BYTE_COUNT];
+  uint8_t prefixLen;
+  CompletionCallback onComplete;
+  void *cookie;
+  /* Per transaction */
+  SeenTag seen[SEEN_SIZE];
+  uint32_t generation;
+  uint32_t unique;
+  uint32_t reads;
+  bool complete;
+  uint64_t startUs;
+  uint64_t completeUs;
+} StopOnCount;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static uint64_t nowUs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t
+hashEpc(const uint8_t *epc, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= epc[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * helper function to add an EPC to the current transaction's set.
+ * Returns true if it wasn't there yet. Slots of earlier transactions
+ * count as free, so nothing has to be cleared between transactions.
+ */
+static bool addUnique(StopOnCount *stop, const uint8_t *epc, uint8_t len)
+{
+  SeenTag *e;
+  uint32_t slot, i;
+
+  slot = hashEpc(epc, len);
+  for (i = 0; i < SEEN_SIZE; i++)
+  {
+    e = &stop->seen[(slot + i) & (SEEN_SIZE - 1)];
+    if (e->generation != stop->generation)
+    {
+      e->generation = stop->generation;
+      e->epcByteCount = len;
+      memcpy(e->epc, epc, len);
+      return true;
+    }
+    if (e->epcByteCount == len && 0 == memcmp(e->epc, epc, len))
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+/* helper function to arm the trigger for a new transaction */
+static void stopArm(StopOnCount *stop)
+{
+  pthread_mutex_lock(&stop->lock);
+  stop->generation++;
+  stop->unique = 0;
+  stop->reads = 0;
+  stop->complete = false;
+  stop->startUs = nowUs();
+  stop->completeUs = 0;
+  pthread_mutex_unlock(&stop->lock);
+}
+
+/* helper function to wait for completion, false on timeout */
+static bool stopWait(StopOnCount *stop, uint32_t timeoutMs)
+{
+  struct timespec ts;
+  bool complete;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeoutMs / 1000;
+  ts.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&stop->lock);
+  while (!stop->complete)
+  {
+    if (0 != pthread_cond_timedwait(&stop->done, &stop->lock, &ts))
+    {
+      break;
+    }
+  }
+  complete = stop->complete;
+  pthread_mutex_unlock(&stop->lock);
+  return complete;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  StopOnCount *stop = cookie;
+  bool fire = false;
+
+  if (t->tag.epcByteCount < stop->prefixLen
+      || 0 != memcmp(t->tag.epc, stop->prefix, stop->prefixLen))
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&stop->lock);
+  stop->reads++;
+  if (!stop->complete && addUnique(stop, t->tag.epc, t->tag.epcByteCount))
+  {
+    stop->unique++;
+    if (stop->unique == stop->target)
+    {
+      stop->complete = true;
+      stop->completeUs = nowUs();
+      fire = true;
+      pthread_cond_signal(&stop->done);
+    }
+  }
+  pthread_mutex_unlock(&stop->lock);
+
+  /* The completion callback runs on the read thread, keep it short */
+  if (fire && NULL != stop->onComplete)
+  {
+    stop->onComplete(stop, stop->cookie);
+  }
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+/* Completion callback: report the tags of the transaction */
+static void printCompletion(StopOnCount *stop, void *cookie)
+{
+  char epcStr[128];
+  int i;
+
+  printf("  %" PRIu32 " tags after %.1f ms:", stop->unique,
+         (stop->completeUs - stop->startUs) / 1000.0);
+  for (i = 0; i < SEEN_SIZE; i++)
+  {
+    if (stop->seen[i].generation == stop->generation)
+    {
+      TMR_bytesToHex(stop->seen[i].epc, stop->seen[i].epcByteCount, epcStr);
+      printf(" %s", epcStr);
+    }
+  }
+  printf("\n");
+}
+
+/* helper function to convert a hex string to bytes, returns the byte count or -1 */
+static int hexToBytes(const char *hex, uint8_t *out, int max)
+{
+  int len = (int)strlen(hex);
+  int i;
+  unsigned int byte;
+
+  if (0 != (len & 1) || len / 2 > max)
+  {
+    return -1;
+  }
+  for (i = 0; i < len / 2; i++)
+  {
+    if (1 != sscanf(hex + 2 * i, "%2x", &byte))
+    {
+      return -1;
+    }
+    out[i] = (uint8_t)byte;
+  }
+  return len / 2;
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_TagFilter filter;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint32_t timeoutMs = DEFAULT_TIMEOUT_MS;
+  uint32_t transactions = DEFAULT_TRANSACTIONS;
+  uint32_t offTime = 0;
+  uint32_t t, completed = 0;
+  uint64_t toN, toStop, sumToN = 0, minToN = UINT64_MAX, maxToN = 0;
+  StopOnCount *stop;
+  bool complete;
+  int i, n;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  stop = calloc(1, sizeof(*stop));
+  if (NULL == stop)
+  {
+    errx(1, "Out of memory\n");
+  }
+  stop->target = DEFAULT_COUNT;
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--count", argv[i]))
+    {
+      stop->target = (uint32_t)atoi(argv[i+1]);
+      if (0 == stop->target || stop->target >= SEEN_SIZE)
+      {
+        errx(1, "--count must be between 1 and %d\n", SEEN_SIZE - 1);
+      }
+    }
+    else if (0x00 == strcmp("--timeout", argv[i]))
+    {
+      timeoutMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--transactions", argv[i]))
+    {
+      transactions = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--epc-prefix", argv[i]))
+    {
+      n = hexToBytes(argv[i+1], stop->prefix, sizeof(stop->prefix));
+      if (n <= 0)
+      {
+        errx(1, "Can't parse '%s' as an EPC prefix in hex\n", argv[i+1]);
+      }
+      stop->prefixLen = (uint8_t)n;
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  if (0 != stop->prefixLen)
+  {
+    /* EPC memory starts with CRC and PC words, the EPC itself at bit 32 */
+    ret = TMR_TF_init_gen2_select(&filter, false, TMR_GEN2_BANK_EPC, 32,
+                                  stop->prefixLen * 8, stop->prefix);
+    checkerr(rp, ret, 1, "initializing the EPC prefix filter");
+    ret = TMR_RP_set_filter(&plan, &filter);
+    checkerr(rp, ret, 1, "setting the EPC prefix filter");
+  }
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  /* Read without pauses, so no transaction waits out an off time */
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_ASYNCOFFTIME, &offTime);
+  checkerr(rp, ret, 1, "setting async off time");
+
+  pthread_mutex_init(&stop->lock, NULL);
+  pthread_cond_init(&stop->done, NULL);
+  stop->onComplete = printCompletion;
+  stop->cookie = NULL;
+
+  rlb.listener = callback;
+  rlb.cookie = stop;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  for (t = 1; t <= transactions; t++)
+  {
+    printf("Transaction %" PRIu32 ": waiting for %" PRIu32 " tags\n", t, stop->target);
+    stopArm(stop);
+    ret = TMR_startReading(rp);
+    checkerr(rp, ret, 1, "starting reading");
+
+    complete = stopWait(stop, timeoutMs);
+
+    /* Stop right away: the callback thread can't stop its own reader */
+    ret = TMR_stopReading(rp);
+    checkerr(rp, ret, 1, "stopping reading");
+    toStop = nowUs() - stop->startUs;
+
+    pthread_mutex_lock(&stop->lock);
+    if (complete)
+    {
+      toN = stop->completeUs - stop->startUs;
+      completed++;
+      sumToN += toN;
+      minToN = (toN < minToN) ? toN : minToN;
+      maxToN = (toN > maxToN) ? toN : maxToN;
+      printf("  time to %" PRIu32 " tags %.1f ms, reading stopped after %.1f ms (%" PRIu32 " reads)\n",
+             stop->target, toN / 1000.0, toStop / 1000.0, stop->reads);
+    }
+    else
+    {
+      printf("  timed out after %" PRIu32 " ms with %" PRIu32 " of %" PRIu32 " tags\n",
+             timeoutMs, stop->unique, stop->target);
+    }
+    pthread_mutex_unlock(&stop->lock);
+
+    if (t < transactions)
+    {
+      tmr_sleep(TRANSACTION_GAP_MS);
+    }
+  }
+
+  if (0 != completed)
+  {
+    printf("\n%" PRIu32 " of %" PRIu32 " transactions completed, time to %" PRIu32
+           " tags min %.1f / avg %.1f / max %.1f ms\n",
+           completed, transactions, stop->target, minToN / 1000.0,
+           sumToN / 1000.0 / completed, maxToN / 1000.0);
+  }
+
+  TMR_destroy(rp);
+  pthread_cond_destroy(&stop->done);
+  pthread_mutex_destroy(&stop->lock);
+  free(stop);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
@@ -0,0 +1,685 @@
+/**
+ * Sample program that checks an inbound shipment against its manifest
+ * while the tags are being read.
+ *
+ * The manifest is a text file with one expected EPC in hex per line. It
+ * is loaded into a hash table up front, so each read costs one lookup:
+ * the first read of an expected EPC moves it from missing to found, an
+ * EPC that isn't on the manifest is counted once as unexpected. The
+ * found, missing and unexpected counts are kept current as reads stream
+ * in, and the moment the last expected EPC turns up reading stops, so a
+ * complete pallet is released without waiting out --timeout. At the end
+ * the missing and unexpected EPCs are listed; the exit status is 0 for a
+ * complete shipment and 2 otherwise.
+ * @file reconcileread.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 --manifest asn.txt or tmr:///com4 --ant 1,2 --manifest asn.txt --timeout 30000\n"\
+                         "tmr://my-reader.example.com --manifest asn.txt --max-unexpected 1000\n");}
+
+#define DEFAULT_TIMEOUT_MS 30000
+#define DEFAULT_MAX_UNEXPECTED 4096
+/* Upper bound for --max-unexpected, keeps the table size within 32 bits */
+#define MAX_UNEXPECTED (1UL << 24)
+/* EPCs listed per category in the final report */
+#define MAX_LISTED 100
+
+/* One EPC, expected or not */
+typedef struct ManifestEntry
+{
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint32_t reads;
+  uint64_t firstSeenMs;
+} ManifestEntry;
+
+/* Open addressing table of entries, slots hold index + 1 */
+typedef struct EpcTable
+{
+  ManifestEntry *entries;
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t *slots;
+  uint32_t mask;
+} EpcTable;
+
+typedef struct Reconciler
+{
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  EpcTable expected;
+  EpcTable unexpected;
+  uint32_t found;
+  uint64_t untrackedReads;  /* reads of unexpected EPCs once the table was full */
+  uint64_t reads;
+  uint64_t startMs;
+  uint64_t completeMs;
+  bool complete;
+} Reconciler;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static uint64_t nowMs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+hashEpc(const uint8_t *epc, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= epc[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* helper function to parse a hex EPC, returns the byte count or -1 */
+static int parseEpc(const char *hex, uint8_t *epc)
+{
+  int len = 0;
+  unsigned int byte;
+
+  while ('\0' != hex[0] && '\r' != hex[0] && '\n' != hex[0])
+  {
+    if (len >= TMR_MAX_EPC_BYTE_COUNT || 1 != sscanf(hex, "%2x", &byte)
+        || '\0' == hex[1] || '\n' == hex[1])
+    {
+      return -1;
+    }
+    epc[len++] = (uint8_t)byte;
+    hex += 2;
+  }
+  return (0 == len) ? -1 : len;
+}
+
+/* The table is sized so it is never more than half full */
+static bool tableInit(EpcTable *t, uint32_t capacity)
+{
+  uint32_t slots = 1;
+
+  while (slots < 2 * capacity)
+  {
+    slots <<= 1;
+  }
+  t->entries = calloc(capacity, sizeof(ManifestEntry));
+  t->slots = calloc(slots, sizeof(uint32_t));
+  t->count = 0;
+  t->capacity = capacity;
+  t->mask = slots - 1;
+  return NULL != t->entries && NULL != t->slots;
+}
+
+static void tableFree(EpcTable *t)
+{
+  free(t->entries);
+  free(t->slots);
+}
+
+/**
+ * helper function to find an EPC. Returns its entry, or NULL with *slot
+ * set to the free slot it would go in.
+ */
+static ManifestEntry *tableFind(EpcTable *t, const uint8_t *epc, uint8_t len, uint32_t **slot)
+{
+  ManifestEntry *e;
+  uint32_t i;
+
+  for (i = hashEpc(epc, len) & t->mask; ; i = (i + 1) & t->mask)
+  {
+    if (0 == t->slots[i])
+    {
+      *slot = &t->slots[i];
+      return NULL;
+    }
+    e = &t->entries[t->slots[i] - 1];
+    if (e->epcByteCount == len && 0 == memcmp(e->epc, epc, len))
+    {
+      return e;
+    }
+  }
+}
+
+/* helper function to add an EPC, NULL if the table is full */
+static ManifestEntry *tableAdd(EpcTable *t, uint32_t *slot, const uint8_t *epc, uint8_t len)
+{
+  ManifestEntry *e;
+
+  if (t->count == t->capacity)
+  {
+    return NULL;
+  }
+  e = &t->entries[t->count++];
+  e->epcByteCount = len;
+  memcpy(e->epc, epc, len);
+  *slot = t->count;
+  return e;
+}
+
+/**
+ * Load the manifest: one EPC in hex per line, blank lines and lines
+ * starting with # are skipped, repeats count once.
+ */
+static void loadManifest(Reconciler *rc, const char *path)
+{
+  FILE *f;
+  char line[2 * TMR_MAX_EPC_BYTE_COUNT + 8];
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint32_t lines = 0, lineNo = 0, duplicates = 0, *slot;
+  int len;
+
+  if (NULL == (f = fopen(path, "r")))
+  {
+    errx(1, "Can't open manifest %s\n", path);
+  }
+  /* Size the table from the line count, so there's no rehashing */
+  while (NULL != fgets(line, sizeof(line), f))
+  {
+    lines++;
+  }
+  if (!tableInit(&rc->expected, (0 == lines) ? 1 : lines))
+  {
+    errx(1, "Out of memory\n");
+  }
+
+  rewind(f);
+  while (NULL != fgets(line, sizeof(line), f))
+  {
+    lineNo++;
+    if ('#' == line[0] || '\n' == line[0] || '\r' == line[0])
+    {
+      continue;
+    }
+    if ((len = parseEpc(line, epc)) < 0)
+    {
+      errx(1, "%s:%" PRIu32 ": can't parse '%s' as an EPC in hex\n", path, lineNo, line);
+    }
+    if (NULL != tableFind(&rc->expected, epc, (uint8_t)len, &slot))
+    {
+      duplicates++;
+      continue;
+    }
+    tableAdd(&rc->expected, slot, epc, (uint8_t)len);
+  }
+  fclose(f);
+
+  if (0 == rc->expected.count)
+  {
+    errx(1, "Manifest %s lists no EPCs\n", path);
+  }
+  printf("Manifest %s: %" PRIu32 " expected EPCs", path, rc->expected.count);
+  if (0 != duplicates)
+  {
+    printf(" (%" PRIu32 " repeated lines ignored)", duplicates);
+  }
+  printf("\n");
+}
+
+/* helper function to wait until the manifest is complete, false on timeout */
+static bool waitComplete(Reconciler *rc, uint32_t timeoutMs)
+{
+  struct timespec ts;
+  bool complete;
+
+  /* done waits on CLOCK_MONOTONIC, like nowMs */
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += timeoutMs / 1000;
+  ts.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&rc->lock);
+  while (!rc->complete)
+  {
+    if (0 != pthread_cond_timedwait(&rc->done, &rc->lock, &ts))
+    {
+      break;
+    }
+  }
+  complete = rc->complete;
+  pthread_mutex_unlock(&rc->lock);
+  return complete;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  Reconciler *rc = cookie;
+  ManifestEntry *e;
+  uint32_t *slot;
+  char epcStr[128];
+  bool firstExpected = false, firstUnexpected = false;
+  uint32_t found = 0, missing = 0, unexpected = 0;
+
+  pthread_mutex_lock(&rc->lock);
+  rc->reads++;
+  e = tableFind(&rc->expected, t->tag.epc, t->tag.epcByteCount, &slot);
+  if (NULL != e)
+  {
+    if (0 == e->reads++)
+    {
+      e->firstSeenMs = nowMs() - rc->startMs;
+      rc->found++;
+      firstExpected = true;
+      if (rc->found == rc->expected.count && !rc->complete)
+      {
+        rc->complete = true;
+        rc->completeMs = e->firstSeenMs;
+        pthread_cond_signal(&rc->done);
+      }
+    }
+  }
+  else
+  {
+    e = tableFind(&rc->unexpected, t->tag.epc, t->tag.epcByteCount, &slot);
+    if (NULL == e)
+    {
+      e = tableAdd(&rc->unexpected, slot, t->tag.epc, t->tag.epcByteCount);
+      if (NULL == e)
+      {
+        rc->untrackedReads++;
+      }
+      else
+      {
+        e->firstSeenMs = nowMs() - rc->startMs;
+        firstUnexpected = true;
+      }
+    }
+    if (NULL != e)
+    {
+      e->reads++;
+    }
+  }
+  found = rc->found;
+  missing = rc->expected.count - rc->found;
+  unexpected = rc->unexpected.count;
+  pthread_mutex_unlock(&rc->lock);
+
+  /* Report only the first read of each EPC */
+  if (firstExpected || firstUnexpected)
+  {
+    TMR_bytesToHex(t->tag.epc, t->tag.epcByteCount, epcStr);
+    printf("%s %s  found %" PRIu32 " missing %" PRIu32 " unexpected %" PRIu32 "\n",
+           firstExpected ? "FOUND     " : "UNEXPECTED", epcStr, found, missing, unexpected);
+  }
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+/* helper function to list the EPCs of a table that were or weren't read */
+static void listEntries(const char *title, const EpcTable *t, bool read)
+{
+  char epcStr[128];
+  uint32_t i, listed = 0, total = 0;
+
+  for (i = 0; i < t->count; i++)
+  {
+    if ((0 != t->entries[i].reads) == read)
+    {
+      total++;
+    }
+  }
+  if (0 == total)
+  {
+    return;
+  }
+  printf("%s (%" PRIu32 "):\n", title, total);
+  for (i = 0; i < t->count && listed < MAX_LISTED; i++)
+  {
+    if ((0 != t->entries[i].reads) == read)
+    {
+      TMR_bytesToHex(t->entries[i].epc, t->entries[i].epcByteCount, epcStr);
+      if (read)
+      {
+        printf("  %s  %" PRIu32 " reads, first after %" PRIu64 " ms\n",
+               epcStr, t->entries[i].reads, t->entries[i].firstSeenMs);
+      }
+      else
+      {
+        printf("  %s\n", epcStr);
+      }
+      listed++;
+    }
+  }
+  if (listed < total)
+  {
+    printf("  ... and %" PRIu32 " more\n", total - listed);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  const char *manifestPath = NULL;
+  uint32_t timeoutMs = DEFAULT_TIMEOUT_MS;
+  uint32_t maxUnexpected = DEFAULT_MAX_UNEXPECTED;
+  uint32_t offTime = 0;
+  uint64_t stoppedMs;
+  Reconciler *rc;
+  bool complete;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--manifest", argv[i]))
+    {
+      manifestPath = argv[i+1];
+    }
+    else if (0x00 == strcmp("--timeout", argv[i]))
+    {
+      timeoutMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--max-unexpected", argv[i]))
+    {
+      char *end;
+      unsigned long value;
+
+      value = strtoul(argv[i+1], &end, 10);
+      if (('\0' == argv[i+1][0]) || ('\0' != *end) || ('-' == argv[i+1][0])
+          || (0 == value) || (MAX_UNEXPECTED < value))
+      {
+        errx(1, "--max-unexpected must be between 1 and %lu\n", MAX_UNEXPECTED);
+      }
+      maxUnexpected = (uint32_t)value;
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+  if (NULL == manifestPath)
+  {
+    fprintf(stdout, "Missing --manifest\n");
+    usage();
+  }
+
+  rc = calloc(1, sizeof(*rc));
+  if (NULL == rc)
+  {
+    errx(1, "Out of memory\n");
+  }
+  loadManifest(rc, manifestPath);
+  /* Unexpected EPCs beyond this are only counted */
+  if (!tableInit(&rc->unexpected, maxUnexpected))
+  {
+    errx(1, "Out of memory\n");
+  }
+  pthread_mutex_init(&rc->lock, NULL);
+  {
+    pthread_condattr_t attr;
+
+    /* A wall clock step must not stretch or cut the wait */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&rc->done, &attr);
+    pthread_condattr_destroy(&attr);
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  /* Read without pauses, a complete pallet shouldn't wait out an off time */
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_ASYNCOFFTIME, &offTime);
+  checkerr(rp, ret, 1, "setting async off time");
+
+  rlb.listener = callback;
+  rlb.cookie = rc;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  rc->startMs = nowMs();
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  complete = waitComplete(rc, timeoutMs);
+
+  /* Stop right away: the callback thread can't stop its own reader */
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+  stoppedMs = nowMs() - rc->startMs;
+
+  pthread_mutex_lock(&rc->lock);
+  printf("\n");
+  if (complete)
+  {
+    printf("Shipment COMPLETE: all %" PRIu32 " EPCs found after %" PRIu64
+           " ms, reading stopped after %" PRIu64 " ms\n",
+           rc->expected.count, rc->completeMs, stoppedMs);
+  }
+  else
+  {
+    printf("Shipment INCOMPLETE after %" PRIu32 " ms\n", timeoutMs);
+  }
+  printf("found %" PRIu32 ", missing %" PRIu32 ", unexpected %" PRIu32 "%s"
+         ", %" PRIu64 " reads\n", rc->found, rc->expected.count - rc->found,
+         rc->unexpected.count, (0 != rc->untrackedReads) ? " or more" : "", rc->reads);
+  listEntries("Missing", &rc->expected, false);
+  listEntries("Unexpected", &rc->unexpected, true);
+  if (0 != rc->untrackedReads)
+  {
+    printf("  ... plus %" PRIu64 " reads of EPCs past --max-unexpected\n", rc->untrackedReads);
+  }
+  pthread_mutex_unlock(&rc->lock);
+
+  TMR_destroy(rp);
+  pthread_cond_destroy(&rc->done);
+  pthread_mutex_destroy(&rc->lock);
+  tableFree(&rc->expected);
+  tableFree(&rc->unexpected);
+  free(rc);
+  return complete ? 0 : 2;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
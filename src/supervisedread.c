@@ -0,0 +1,660 @@
+/**
+ * Sample program that keeps background reading alive across reader
+ * and transport failures.
+ *
+ * The read exception listener classifies every error. Errors the module
+ * recovers from on its own are counted and ignored; errors that leave
+ * the connection unusable (a timeout, a USB reset, a lost LLRP
+ * keep-alive, a module assert) wake up a supervisor loop in the main
+ * thread, which tears the reader down and recreates and reconnects it
+ * with exponential backoff. The cached region, read power and read plan
+ * are applied again and the same listener blocks are re-registered, so
+ * the tag table kept by the read listener survives the outage. Errors
+ * that no reconnect can fix (bad configuration) end the program. The
+ * duration of every outage is measured and summarized on exit.
+ * @file supervisedread.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --power 2500 --duration 3600\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+#define DEFAULT_DURATION_S 300
+/* Reconnect backoff, doubled after every failed attempt */
+#define BACKOFF_MIN_MS 500
+#define BACKOFF_MAX_MS 30000
+/* Number of tag table slots, must be a power of two */
+#define TAG_TABLE_SIZE 8192
+
+/* What to do about an error reported by the reader */
+typedef enum ErrorClass
+{
+  ERROR_TRANSIENT,   /* the reader carries on, just count it */
+  ERROR_RECONNECT,   /* the connection is gone, tear down and reconnect */
+  ERROR_FATAL        /* reconnecting won't help, give up */
+} ErrorClass;
+
+/* One tag seen since the program started */
+typedef struct TagEntry
+{
+  bool used;
+  uint8_t epcByteCount;
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  uint32_t readCount;
+  uint64_t firstSeen;
+  uint64_t lastSeen;
+} TagEntry;
+
+/* Configuration applied on every (re)connect */
+typedef struct ReaderConfig
+{
+  const char *uri;
+  uint8_t antennaList[16];
+  uint8_t antennaCount;
+  bool setPower;
+  int32_t readPower;
+  /* Region picked on the first connect, reused afterwards */
+  TMR_Region region;
+} ReaderConfig;
+
+/* Supervisor state, shared with the listeners */
+typedef struct Supervisor
+{
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  ReaderConfig config;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+  /* Set by the exception listener, cleared by the supervisor loop */
+  bool reconnectNeeded;
+  bool fatal;
+  TMR_Status lastError;
+  char lastErrorMsg[256];
+  /* Tag table, kept across reconnects */
+  TagEntry *tags;
+  uint32_t uniqueTags;
+  uint64_t totalReads;
+  /* Error and outage metrics */
+  uint32_t transientErrors;
+  uint32_t outages;
+  uint32_t reconnectAttempts;
+  uint64_t outageStart;
+  uint64_t totalOutageMs;
+  uint64_t longestOutageMs;
+} Supervisor;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/**
+ * helper function to sort an error into what the supervisor does about it.
+ * Anything on the transport (timeouts, errno failures such as a USB
+ * reset, LLRP keep-alive loss) needs a new connection; so does a module
+ * that asserted or overheated. Configuration errors are fatal. The
+ * remaining module codes are per-command failures the module survives.
+ */
+static ErrorClass classifyError(TMR_Status error)
+{
+  if (TMR_ERROR_IS_COMM(error))
+  {
+    return ERROR_RECONNECT;
+  }
+  switch (error)
+  {
+  case TMR_ERROR_SYSTEM_UNKNOWN_ERROR:
+  case TMR_ERROR_TM_ASSERT_FAILED:
+  case TMR_ERROR_TEMPERATURE_EXCEED_LIMITS:
+  case TMR_ERROR_BUFFER_OVERFLOW:
+  /* LLRP transport failures carry their own error type, not COMM */
+  case TMR_ERROR_LLRP_CONNECTIONFAILED:
+  case TMR_ERROR_LLRP_SENDIO_ERROR:
+  case TMR_ERROR_LLRP_RECEIVEIO_ERROR:
+  case TMR_ERROR_LLRP_RECEIVE_TIMEOUT:
+  case TMR_ERROR_LLRP_READER_CONNECTION_LOST:
+    return ERROR_RECONNECT;
+  case TMR_ERROR_INVALID:
+  case TMR_ERROR_UNSUPPORTED:
+  case TMR_ERROR_INVALID_ANTENNA_CONFIG:
+  case TMR_ERROR_INVALID_REGION:
+    return ERROR_FATAL;
+  default:
+    return ERROR_TRANSIENT;
+  }
+}
+
+static uint32_t
+hashEpc(const uint8_t *epc, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    hash ^= epc[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* helper function to find the tag table slot for an EPC by linear probing */
+static TagEntry *findTag(Supervisor *sv, const uint8_t *epc, uint8_t len)
+{
+  TagEntry *e;
+  uint32_t slot, i;
+
+  slot = hashEpc(epc, len);
+  for (i = 0; i < TAG_TABLE_SIZE; i++)
+  {
+    e = &sv->tags[(slot + i) & (TAG_TABLE_SIZE - 1)];
+    if (!e->used)
+    {
+      return e;
+    }
+    if ((e->epcByteCount == len) && (0 == memcmp(e->epc, epc, len)))
+    {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  Supervisor *sv = cookie;
+  TagEntry *e;
+  uint64_t now = tmr_gettime();
+  char epcStr[128];
+
+  pthread_mutex_lock(&sv->lock);
+  sv->totalReads++;
+  e = findTag(sv, t->tag.epc, t->tag.epcByteCount);
+  if (NULL != e && !e->used)
+  {
+    e->used = true;
+    e->epcByteCount = t->tag.epcByteCount;
+    memcpy(e->epc, t->tag.epc, t->tag.epcByteCount);
+    e->firstSeen = now;
+    sv->uniqueTags++;
+
+    TMR_bytesToHex(t->tag.epc, t->tag.epcByteCount, epcStr);
+    printf("New tag[ant:%i]: %s\n", t->antenna, epcStr);
+  }
+  if (NULL != e)
+  {
+    e->readCount++;
+    e->lastSeen = now;
+  }
+  pthread_mutex_unlock(&sv->lock);
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  Supervisor *sv = cookie;
+  ErrorClass cls = classifyError(error);
+
+  pthread_mutex_lock(&sv->lock);
+  if (ERROR_TRANSIENT == cls)
+  {
+    sv->transientErrors++;
+  }
+  else if (!sv->reconnectNeeded && !sv->fatal)
+  {
+    /* Only the first error of an outage counts, the rest is fallout */
+    sv->lastError = error;
+    snprintf(sv->lastErrorMsg, sizeof(sv->lastErrorMsg), "%s", TMR_strerr(reader, error));
+    if (ERROR_FATAL == cls)
+    {
+      sv->fatal = true;
+    }
+    else
+    {
+      sv->reconnectNeeded = true;
+      sv->outageStart = tmr_gettime();
+    }
+    pthread_cond_signal(&sv->wake);
+  }
+  pthread_mutex_unlock(&sv->lock);
+}
+
+/**
+ * helper function to create, connect and configure the reader and start
+ * background reading. Used for the first connect and every reconnect.
+ * On failure the error message is copied to errMsg and the reader is
+ * destroyed again.
+ */
+static TMR_Status startReader(Supervisor *sv, TMR_Reader *rp, const char **what,
+                              char *errMsg, size_t errLen)
+{
+  ReaderConfig *cfg = &sv->config;
+  TMR_ReadPlan plan;
+  TMR_Status ret;
+
+  *what = "creating reader";
+  ret = TMR_create(rp, cfg->uri);
+  if (TMR_SUCCESS != ret)
+  {
+    snprintf(errMsg, errLen, "%s", TMR_strerr(rp, ret));
+    return ret;
+  }
+
+#if USE_TRANSPORT_LISTENER
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    sv->tb.listener = serialPrinter;
+  }
+  else
+  {
+    sv->tb.listener = stringPrinter;
+  }
+  sv->tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &sv->tb);
+#endif
+
+  *what = "connecting reader";
+  ret = TMR_connect(rp);
+  if (TMR_SUCCESS != ret)
+  {
+    goto fail;
+  }
+
+  if (TMR_REGION_NONE == cfg->region)
+  {
+    *what = "getting region";
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &cfg->region);
+    if (TMR_SUCCESS != ret)
+    {
+      goto fail;
+    }
+    if (TMR_REGION_NONE == cfg->region)
+    {
+      TMR_RegionList regions;
+      TMR_Region _regionStore[32];
+      regions.list = _regionStore;
+      regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+      regions.len = 0;
+
+      *what = "getting supported regions";
+      ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+      if (TMR_SUCCESS != ret)
+      {
+        goto fail;
+      }
+      if (regions.len < 1)
+      {
+        ret = TMR_ERROR_INVALID_REGION;
+        goto fail;
+      }
+      cfg->region = regions.list[0];
+    }
+  }
+  /* A module that reset may have come back with a different region */
+  *what = "setting region";
+  ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &cfg->region);
+  if (TMR_SUCCESS != ret)
+  {
+    goto fail;
+  }
+
+  if (cfg->setPower)
+  {
+    *what = "setting read power";
+    ret = TMR_paramSet(rp, TMR_PARAM_RADIO_READPOWER, &cfg->readPower);
+    if (TMR_SUCCESS != ret)
+    {
+      goto fail;
+    }
+  }
+
+  *what = "setting read plan";
+  ret = TMR_RP_init_simple(&plan, cfg->antennaCount,
+                           (0 != cfg->antennaCount) ? cfg->antennaList : NULL,
+                           TMR_TAG_PROTOCOL_GEN2, 1000);
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  }
+  if (TMR_SUCCESS != ret)
+  {
+    goto fail;
+  }
+
+  /* The same blocks (and so the same tag table) on every new reader */
+  *what = "adding listeners";
+  ret = TMR_addReadListener(rp, &sv->rlb);
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_addReadExceptionListener(rp, &sv->reb);
+  }
+  if (TMR_SUCCESS != ret)
+  {
+    goto fail;
+  }
+
+  *what = "starting reading";
+  ret = TMR_startReading(rp);
+  if (TMR_SUCCESS != ret)
+  {
+    goto fail;
+  }
+  return TMR_SUCCESS;
+
+fail:
+  snprintf(errMsg, errLen, "%s", TMR_strerr(rp, ret));
+  TMR_destroy(rp);
+  return ret;
+}
+
+/* helper function to wait on the supervisor condition until a deadline */
+static void waitUntil(Supervisor *sv, uint64_t deadline)
+{
+  struct timespec ts;
+  uint64_t now = tmr_gettime();
+  uint64_t waitMs = (deadline > now) ? deadline - now : 0;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += waitMs / 1000;
+  ts.tv_nsec += (waitMs % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  pthread_cond_timedwait(&sv->wake, &sv->lock, &ts);
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  Supervisor sv;
+  const char *what;
+  char errMsg[128];
+  bool running;
+  uint8_t *antennaList = NULL;
+  uint32_t duration = DEFAULT_DURATION_S;
+  uint32_t backoff, attempts;
+  uint64_t end, outage, outageStart;
+  TMR_String model;
+  char str[64];
+  int i;
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  memset(&sv, 0, sizeof(sv));
+  sv.config.uri = argv[1];
+  sv.config.region = TMR_REGION_NONE;
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(sv.config.antennaList, &sv.config.antennaCount, argv[i+1]);
+      antennaList = sv.config.antennaList;
+    }
+    else if (0x00 == strcmp("--power", argv[i]))
+    {
+      sv.config.readPower = atoi(argv[i+1]);
+      sv.config.setPower = true;
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      duration = (uint32_t)atoi(argv[i+1]);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  sv.tags = calloc(TAG_TABLE_SIZE, sizeof(TagEntry));
+  if (NULL == sv.tags)
+  {
+    errx(1, "Out of memory\n");
+  }
+  pthread_mutex_init(&sv.lock, NULL);
+  pthread_cond_init(&sv.wake, NULL);
+
+  sv.rlb.listener = callback;
+  sv.rlb.cookie = &sv;
+  sv.reb.listener = exceptionCallback;
+  sv.reb.cookie = &sv;
+
+  rp = &r;
+
+  /* The first connect has to work, otherwise the setup is wrong */
+  ret = TMR_create(rp, sv.config.uri);
+  checkerr(rp, ret, 1, "creating reader");
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+  TMR_destroy(rp);
+
+  ret = startReader(&sv, rp, &what, errMsg, sizeof(errMsg));
+  if (TMR_SUCCESS != ret)
+  {
+    errx(1, "Error %s: %s\n", what, errMsg);
+  }
+  running = true;
+  printf("Reading for %" PRIu32 " seconds\n", duration);
+
+  end = tmr_gettime() + (uint64_t)duration * 1000;
+  pthread_mutex_lock(&sv.lock);
+  while (tmr_gettime() < end && !sv.fatal)
+  {
+    if (!sv.reconnectNeeded)
+    {
+      waitUntil(&sv, end);
+      continue;
+    }
+
+    fprintf(stderr, "Reader lost: %s. Reconnecting.\n", sv.lastErrorMsg);
+    pthread_mutex_unlock(&sv.lock);
+
+    /* Tear down what is left of the old connection */
+    TMR_stopReading(rp);
+    TMR_destroy(rp);
+    running = false;
+
+    /**
+     * Rearm before the new reader starts reading, so an error on the new
+     * connection starts the next outage instead of being taken for
+     * fallout of this one.
+     */
+    pthread_mutex_lock(&sv.lock);
+    outageStart = sv.outageStart;
+    sv.reconnectNeeded = false;
+    pthread_mutex_unlock(&sv.lock);
+
+    backoff = BACKOFF_MIN_MS;
+    attempts = 0;
+    for (;;)
+    {
+      attempts++;
+      ret = startReader(&sv, rp, &what, errMsg, sizeof(errMsg));
+      if (TMR_SUCCESS == ret)
+      {
+        running = true;
+        break;
+      }
+      fprintf(stderr, "  attempt %" PRIu32 " failed %s: %s, next in %" PRIu32 " ms\n",
+              attempts, what, errMsg, backoff);
+      if (ERROR_FATAL == classifyError(ret) || tmr_gettime() + backoff >= end)
+      {
+        break;
+      }
+      tmr_sleep(backoff);
+      backoff = (backoff * 2 > BACKOFF_MAX_MS) ? BACKOFF_MAX_MS : backoff * 2;
+    }
+
+    pthread_mutex_lock(&sv.lock);
+    outage = tmr_gettime() - outageStart;
+    sv.outages++;
+    sv.reconnectAttempts += attempts;
+    sv.totalOutageMs += outage;
+    if (outage > sv.longestOutageMs)
+    {
+      sv.longestOutageMs = outage;
+    }
+    if (TMR_SUCCESS != ret)
+    {
+      fprintf(stderr, "Giving up after %" PRIu32 " attempts (%" PRIu64 " ms down)\n",
+              attempts, outage);
+      snprintf(sv.lastErrorMsg, sizeof(sv.lastErrorMsg), "%s %s", what, errMsg);
+      sv.fatal = true;
+      break;
+    }
+    fprintf(stderr, "Reading again after %" PRIu64 " ms down, %" PRIu32 " attempts,"
+            " %" PRIu32 " tags known\n", outage, attempts, sv.uniqueTags);
+  }
+  pthread_mutex_unlock(&sv.lock);
+
+  if (running)
+  {
+    TMR_stopReading(rp);
+    TMR_destroy(rp);
+  }
+  if (sv.fatal && 0 != sv.lastErrorMsg[0])
+  {
+    fprintf(stderr, "Stopped on error: %s\n", sv.lastErrorMsg);
+  }
+
+  printf("\n%" PRIu32 " unique tags, %" PRIu64 " reads\n", sv.uniqueTags, sv.totalReads);
+  printf("%" PRIu32 " transient errors ignored\n", sv.transientErrors);
+  printf("%" PRIu32 " outages, %" PRIu32 " reconnect attempts, %" PRIu64
+         " ms down in total, longest %" PRIu64 " ms\n",
+         sv.outages, sv.reconnectAttempts, sv.totalOutageMs, sv.longestOutageMs);
+
+  pthread_cond_destroy(&sv.wake);
+  pthread_mutex_destroy(&sv.lock);
+  free(sv.tags);
+  return sv.fatal ? 1 : 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
@@ -0,0 +1,825 @@
+/**
+ * Sample program that authenticates every NXP UCODE DNA tag in the
+ * field and decrypts and verifies the responses locally.
+ *
+ * Each tag found by an inventory gets its own random IChallenge and a
+ * TAM1 (or, with --blocks, TAM2) Authenticate or ReadBuffer with
+ * SendRawData set. The raw responses are then checked in one batch on
+ * a pool of worker threads. A response is authentic when it decrypts
+ * under the tag key to the TAM constant followed by the tag random
+ * number and the IChallenge that was sent. TAM2 custom data is
+ * decrypted from the blocks that follow, chained in CBC mode.
+ *
+ * AES decryption uses AES-NI or the ARMv8 crypto extensions when the
+ * compiler targets them (-maes, -march=armv8-a+crypto). Otherwise it
+ * falls back to a portable implementation that computes the S-box
+ * arithmetically, without lookup tables or secret-dependent branches.
+ * @file tamverify.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#if defined(__AES__) && defined(__SSE2__)
+#include <wmmintrin.h>
+#define AES_BACKEND "AES-NI"
+#elif defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+#include <arm_neon.h>
+#define AES_BACKEND "ARMv8 crypto extensions"
+#else
+#define AES_PORTABLE 1
+#define AES_BACKEND "portable constant-time"
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2 --key 0123456789ABCDEF0123456789ABCDEF\n"\
+                         "tmr:///com4 --keyid 1 --blocks 1 --op readbuffer --workers 4\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+#define MAX_TAGS 128
+#define MAX_WORKERS 16
+#define DEFAULT_WORKERS 4
+/* Largest TAM2 request, in 128-bit blocks of custom data */
+#define MAX_TAM2_BLOCKS 4
+#define CHALLENGE_BYTES 10
+
+/* Leading constants of the TAM1 and TAM2 plaintext, ISO/IEC 29167-10 */
+#define TAM1_CONSTANT 0x96C5
+#define TAM2_CONSTANT 0xFD5B
+
+typedef struct AesKey
+{
+  /* Encryption round keys */
+  uint8_t rk[11][16];
+  /* Round keys for the equivalent inverse cipher */
+  uint8_t dk[11][16];
+} AesKey;
+
+typedef struct AuthJob
+{
+  TMR_TagData tag;
+  uint8_t challenge[CHALLENGE_BYTES];
+  TMR_Status status;
+  uint8_t response[256];
+  uint16_t responseLen;
+  bool authentic;
+  uint32_t tagRandom;
+  uint8_t plain[16 * MAX_TAM2_BLOCKS];
+  uint8_t plainLen;
+} AuthJob;
+
+typedef struct VerifyPool
+{
+  pthread_t threads[MAX_WORKERS];
+  int workers;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  bool shutdown;
+  const AesKey *key;
+  uint8_t blocks;
+  AuthJob *jobs;
+  uint32_t count;
+  uint32_t next;
+  uint32_t finished;
+} VerifyPool;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* Multiply in GF(2^8) without branching on either operand */
+static uint8_t
+gfMul(uint8_t a, uint8_t b)
+{
+  uint8_t p = 0;
+  int i;
+
+  for (i = 0; i < 8; i++)
+  {
+    p ^= a & (uint8_t)-(b & 1);
+    a = (uint8_t)((a << 1) ^ (0x1b & (uint8_t)-(a >> 7)));
+    b >>= 1;
+  }
+  return p;
+}
+
+/* Inverse in GF(2^8) as x^254, which maps 0 to 0 */
+static uint8_t
+gfInv(uint8_t x)
+{
+  uint8_t x2, x3, x12, x15, x240;
+
+  x2 = gfMul(x, x);
+  x3 = gfMul(x2, x);
+  x12 = gfMul(x3, x3);
+  x12 = gfMul(x12, x12);
+  x15 = gfMul(x12, x3);
+  x240 = gfMul(x15, x15);
+  x240 = gfMul(x240, x240);
+  x240 = gfMul(x240, x240);
+  x240 = gfMul(x240, x240);
+  return gfMul(gfMul(x240, x12), x2);
+}
+
+static uint8_t
+rotl8(uint8_t x, int n)
+{
+  return (uint8_t)((x << n) | (x >> (8 - n)));
+}
+
+static uint8_t
+subByte(uint8_t x)
+{
+  uint8_t b = gfInv(x);
+
+  return b ^ rotl8(b, 1) ^ rotl8(b, 2) ^ rotl8(b, 3) ^ rotl8(b, 4) ^ 0x63;
+}
+
+#ifdef AES_PORTABLE
+static uint8_t
+invSubByte(uint8_t x)
+{
+  return gfInv(rotl8(x, 1) ^ rotl8(x, 3) ^ rotl8(x, 6) ^ 0x05);
+}
+#endif
+
+static void
+invMixColumns(uint8_t *s)
+{
+  uint8_t a0, a1, a2, a3;
+  int c;
+
+  for (c = 0; c < 4; c++)
+  {
+    a0 = s[4 * c];
+    a1 = s[4 * c + 1];
+    a2 = s[4 * c + 2];
+    a3 = s[4 * c + 3];
+    s[4 * c]     = gfMul(a0, 14) ^ gfMul(a1, 11) ^ gfMul(a2, 13) ^ gfMul(a3, 9);
+    s[4 * c + 1] = gfMul(a0, 9) ^ gfMul(a1, 14) ^ gfMul(a2, 11) ^ gfMul(a3, 13);
+    s[4 * c + 2] = gfMul(a0, 13) ^ gfMul(a1, 9) ^ gfMul(a2, 14) ^ gfMul(a3, 11);
+    s[4 * c + 3] = gfMul(a0, 11) ^ gfMul(a1, 13) ^ gfMul(a2, 9) ^ gfMul(a3, 14);
+  }
+}
+
+static void
+aesExpandKey(AesKey *key, const uint8_t secret[16])
+{
+  uint8_t rcon = 1;
+  uint8_t t[4], tmp;
+  int r, i;
+
+  memcpy(key->rk[0], secret, 16);
+  for (r = 1; r <= 10; r++)
+  {
+    t[0] = subByte(key->rk[r - 1][13]) ^ rcon;
+    t[1] = subByte(key->rk[r - 1][14]);
+    t[2] = subByte(key->rk[r - 1][15]);
+    t[3] = subByte(key->rk[r - 1][12]);
+    for (i = 0; i < 16; i++)
+    {
+      tmp = key->rk[r - 1][i] ^ ((i < 4) ? t[i] : key->rk[r][i - 4]);
+      key->rk[r][i] = tmp;
+    }
+    rcon = gfMul(rcon, 2);
+  }
+
+  memcpy(key->dk[0], key->rk[0], 16);
+  memcpy(key->dk[10], key->rk[10], 16);
+  for (r = 1; r < 10; r++)
+  {
+    memcpy(key->dk[r], key->rk[r], 16);
+    invMixColumns(key->dk[r]);
+  }
+}
+
+static void
+aesDecryptBlock(const AesKey *key, const uint8_t in[16], uint8_t out[16])
+{
+#if defined(__AES__) && defined(__SSE2__)
+  __m128i d;
+  int r;
+
+  d = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), _mm_loadu_si128((const __m128i *)key->dk[10]));
+  for (r = 9; r > 0; r--)
+  {
+    d = _mm_aesdec_si128(d, _mm_loadu_si128((const __m128i *)key->dk[r]));
+  }
+  d = _mm_aesdeclast_si128(d, _mm_loadu_si128((const __m128i *)key->dk[0]));
+  _mm_storeu_si128((__m128i *)out, d);
+#elif defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+  uint8x16_t d;
+  int r;
+
+  d = vaesdq_u8(vld1q_u8(in), vld1q_u8(key->dk[10]));
+  for (r = 9; r > 0; r--)
+  {
+    d = vaesdq_u8(vaesimcq_u8(d), vld1q_u8(key->dk[r]));
+  }
+  vst1q_u8(out, veorq_u8(d, vld1q_u8(key->dk[0])));
+#else
+  uint8_t s[16], t[16];
+  int r, i;
+
+  for (i = 0; i < 16; i++)
+  {
+    s[i] = in[i] ^ key->rk[10][i];
+  }
+  for (r = 9; r >= 0; r--)
+  {
+    /* InvShiftRows and InvSubBytes, state is column-major */
+    for (i = 0; i < 16; i++)
+    {
+      t[i] = invSubByte(s[(i + 16 - 4 * (i & 3)) & 15]);
+    }
+    for (i = 0; i < 16; i++)
+    {
+      s[i] = t[i] ^ key->rk[r][i];
+    }
+    if (0 < r)
+    {
+      invMixColumns(s);
+    }
+  }
+  memcpy(out, s, 16);
+#endif
+}
+
+/**
+ * helper function to check the AES block against the FIPS-197
+ * example vector before trusting any verdict it gives.
+ */
+static bool
+aesSelfTest(void)
+{
+  static const uint8_t secret[16] =
+  {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+  };
+  static const uint8_t cipher[16] =
+  {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+  };
+  static const uint8_t plain[16] =
+  {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+  };
+  AesKey key;
+  uint8_t out[16];
+
+  aesExpandKey(&key, secret);
+  aesDecryptBlock(&key, cipher, out);
+  return (0 == memcmp(out, plain, 16));
+}
+
+/**
+ * helper function to decrypt one raw TAM response and compare it with
+ * the challenge that was sent. The comparison does not stop early, so
+ * its timing does not depend on where a forged response differs.
+ */
+static void
+verifyJob(const AesKey *key, uint8_t blocks, AuthJob *job)
+{
+  uint16_t expected, constant;
+  const uint8_t *c;
+  uint8_t p[16], diff;
+  int i, j;
+
+  job->authentic = false;
+  job->plainLen = 0;
+  expected = 16 * (1 + blocks);
+  if ((TMR_SUCCESS != job->status) || (job->responseLen < expected))
+  {
+    return;
+  }
+
+  /* The ciphertext is the tail of the raw reply */
+  c = job->response + job->responseLen - expected;
+  constant = (0 == blocks) ? TAM1_CONSTANT : TAM2_CONSTANT;
+  aesDecryptBlock(key, c, p);
+  diff = (uint8_t)((p[0] ^ (constant >> 8)) | (p[1] ^ (constant & 0xff)));
+  for (i = 0; i < CHALLENGE_BYTES; i++)
+  {
+    diff |= p[6 + i] ^ job->challenge[i];
+  }
+  job->authentic = (0 == diff);
+  job->tagRandom = ((uint32_t)p[2] << 24) | ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 8) | p[5];
+
+  for (i = 1; i <= blocks; i++)
+  {
+    aesDecryptBlock(key, c + 16 * i, p);
+    for (j = 0; j < 16; j++)
+    {
+      job->plain[16 * (i - 1) + j] = p[j] ^ c[16 * (i - 1) + j];
+    }
+  }
+  job->plainLen = 16 * blocks;
+}
+
+static void *
+verifyWorker(void *arg)
+{
+  VerifyPool *pool = arg;
+  uint32_t i;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1)
+  {
+    while (!pool->shutdown && (pool->next >= pool->count))
+    {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if (pool->shutdown)
+    {
+      break;
+    }
+    i = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+
+    verifyJob(pool->key, pool->blocks, &pool->jobs[i]);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->finished++;
+    if (pool->finished == pool->count)
+    {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static void
+startPool(VerifyPool *pool, int workers, const AesKey *key, uint8_t blocks)
+{
+  int i;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->shutdown = false;
+  pool->key = key;
+  pool->blocks = blocks;
+  pool->jobs = NULL;
+  pool->count = pool->next = pool->finished = 0;
+  pool->workers = workers;
+  for (i = 0; i < workers; i++)
+  {
+    if (0 != pthread_create(&pool->threads[i], NULL, verifyWorker, pool))
+    {
+      errx(1, "Error creating verify worker\n");
+    }
+  }
+}
+
+/**
+ * helper function to hand a batch of responses to the pool and wait
+ * until every one of them has been verified.
+ */
+static void
+verifyBatch(VerifyPool *pool, AuthJob *jobs, uint32_t count)
+{
+  if (0 == count)
+  {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->jobs = jobs;
+  pool->count = count;
+  pool->next = 0;
+  pool->finished = 0;
+  pthread_cond_broadcast(&pool->work);
+  while (pool->finished < pool->count)
+  {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+stopPool(VerifyPool *pool)
+{
+  int i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (i = 0; i < pool->workers; i++)
+  {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->done);
+}
+
+/* helper function to fill a fresh, unpredictable IChallenge */
+static void
+fillChallenge(uint8_t *challenge)
+{
+  FILE *fp;
+  size_t got = 0;
+  int i;
+
+  fp = fopen("/dev/urandom", "rb");
+  if (NULL != fp)
+  {
+    got = fread(challenge, 1, CHALLENGE_BYTES, fp);
+    fclose(fp);
+  }
+  for (i = (int)got; i < CHALLENGE_BYTES; i++)
+  {
+    challenge[i] = (uint8_t)rand();
+  }
+}
+
+static void
+parseKey(uint8_t *secret, const char *hex)
+{
+  int i;
+
+  if (32 != strlen(hex))
+  {
+    fprintf(stdout, "Key must be 32 hex digits\n");
+    usage();
+  }
+  for (i = 0; i < 16; i++)
+  {
+    if (1 != sscanf(hex + 2 * i, "%2hhx", &secret[i]))
+    {
+      fprintf(stdout, "Can't parse '%s' as a key\n", hex);
+      usage();
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint8_t secret[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+  TMR_NXP_KeyId keyId = KEY0;
+  uint32_t blocks = 0, workers = DEFAULT_WORKERS, keyNum;
+  bool useReadBuffer = false;
+  static AuthJob jobs[MAX_TAGS];
+  uint32_t jobCount = 0, authentic = 0, j;
+  AesKey aesKey;
+  VerifyPool pool;
+  uint64_t airStart, airTime, verifyStart, verifyTime;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--key", argv[i]))
+    {
+      parseKey(secret, argv[i+1]);
+    }
+    else if (0x00 == strcmp("--keyid", argv[i]))
+    {
+      if ((1 != sscanf(argv[i+1], "%"SCNu32, &keyNum)) || (1 < keyNum))
+      {
+        fprintf(stdout, "Key id must be 0 or 1\n");
+        usage();
+      }
+      keyId = (0 == keyNum) ? KEY0 : KEY1;
+    }
+    else if (0x00 == strcmp("--blocks", argv[i]))
+    {
+      if ((1 != sscanf(argv[i+1], "%"SCNu32, &blocks)) || (MAX_TAM2_BLOCKS < blocks))
+      {
+        fprintf(stdout, "Block count must be 0 to %d\n", MAX_TAM2_BLOCKS);
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--op", argv[i]))
+    {
+      if (0x00 == strcmp("readbuffer", argv[i+1]))
+      {
+        useReadBuffer = true;
+      }
+      else if (0x00 != strcmp("authenticate", argv[i+1]))
+      {
+        fprintf(stdout, "Operation must be authenticate or readbuffer\n");
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--workers", argv[i]))
+    {
+      if ((1 != sscanf(argv[i+1], "%"SCNu32, &workers)) || (0 == workers) || (MAX_WORKERS < workers))
+      {
+        fprintf(stdout, "Worker count must be 1 to %d\n", MAX_WORKERS);
+        usage();
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  if (!aesSelfTest())
+  {
+    errx(1, "Error: AES self test failed (%s)\n", AES_BACKEND);
+  }
+  printf("AES backend: %s\n", AES_BACKEND);
+  aesExpandKey(&aesKey, secret);
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  {
+    TMR_ReadPlan plan;
+
+    ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+    checkerr(rp, ret, 1, "initializing the  read plan");
+    ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+    checkerr(rp, ret, 1, "setting read plan");
+  }
+
+  ret = TMR_read(rp, 500, NULL);
+  if (TMR_ERROR_TAG_ID_BUFFER_FULL == ret)
+  {
+    /* In case of TAG ID Buffer Full, extract the tags present
+    * in buffer.
+    */
+    fprintf(stdout, "reading tags:%s\n", TMR_strerr(rp, ret));
+  }
+  else
+  {
+    checkerr(rp, ret, 1, "reading tags");
+  }
+  while ((TMR_SUCCESS == TMR_hasMoreTags(rp)) && (jobCount < MAX_TAGS))
+  {
+    TMR_TagReadData trd;
+
+    ret = TMR_getNextTag(rp, &trd);
+    checkerr(rp, ret, 1, "fetching tag");
+    jobs[jobCount++].tag = trd.tag;
+  }
+  printf("%"PRIu32" tags to authenticate\n", jobCount);
+
+  /* Collect the raw responses, one tag at a time */
+  srand((unsigned int)tmr_gettime());
+  airStart = tmr_gettime();
+  for (j = 0; j < jobCount; j++)
+  {
+    AuthJob *job = &jobs[j];
+    TMR_TagOp tagop;
+    TMR_TagFilter filter;
+    TMR_uint8List key, ichallenge, dataList;
+    TMR_TagOp_GEN2_NXP_Tam1Authentication tam1;
+    TMR_TagOp_GEN2_NXP_Tam2Authentication tam2;
+    TMR_TagOp_GEN2_NXP_Readbuffer readbuffer;
+
+    fillChallenge(job->challenge);
+    key.list = secret;
+    key.max = key.len = sizeof(secret);
+    ichallenge.list = job->challenge;
+    ichallenge.max = ichallenge.len = CHALLENGE_BYTES;
+    dataList.list = job->response;
+    dataList.max = sizeof(job->response);
+    dataList.len = 0;
+
+    memset(&readbuffer, 0, sizeof(readbuffer));
+    if (0 == blocks)
+    {
+      ret = TMR_TagOp_init_GEN2_NXP_AES_Tam1authentication(&tam1, keyId, &key, &ichallenge, true);
+      checkerr(rp, ret, 1, "initializing Tam1 authentication");
+      readbuffer.authenticate.tam1Auth = tam1;
+      readbuffer.authenticate.type = TAM1_AUTHENTICATION;
+    }
+    else
+    {
+      ret = TMR_TagOp_init_GEN2_NXP_AES_Tam2authentication(&tam2, keyId, &key, &ichallenge, EPC, 0, (uint8_t)blocks, true);
+      checkerr(rp, ret, 1, "initializing Tam2 authentication");
+      readbuffer.authenticate.tam2Auth = tam2;
+      readbuffer.authenticate.type = TAM2_AUTHENTICATION;
+    }
+
+    if (useReadBuffer)
+    {
+      ret = TMR_TagOp_init_GEN2_NXP_AES_ReadBuffer(&tagop, 0, (uint16_t)(128 * (1 + blocks)), &readbuffer);
+      checkerr(rp, ret, 1, "initializing ReadBuffer");
+    }
+    else
+    {
+      ret = TMR_TagOp_init_GEN2_NXP_AES_Authenticate(&tagop, &readbuffer.authenticate);
+      checkerr(rp, ret, 1, "initializing Authenticate");
+    }
+
+    ret = TMR_TF_init_tag(&filter, &job->tag);
+    checkerr(rp, ret, 1, "initializing tag filter");
+    job->status = TMR_executeTagOp(rp, &tagop, &filter, &dataList);
+    job->responseLen = dataList.len;
+  }
+  airTime = tmr_gettime() - airStart;
+
+  startPool(&pool, (int)workers, &aesKey, (uint8_t)blocks);
+  verifyStart = tmr_gettime();
+  verifyBatch(&pool, jobs, jobCount);
+  verifyTime = tmr_gettime() - verifyStart;
+  stopPool(&pool);
+
+  for (j = 0; j < jobCount; j++)
+  {
+    char epcStr[128];
+    char dataStr[2 * 16 * MAX_TAM2_BLOCKS + 1];
+
+    TMR_bytesToHex(jobs[j].tag.epc, jobs[j].tag.epcByteCount, epcStr);
+    if (TMR_SUCCESS != jobs[j].status)
+    {
+      printf("%s: no response (%s)\n", epcStr, TMR_strerr(rp, jobs[j].status));
+      continue;
+    }
+    if (!jobs[j].authentic)
+    {
+      printf("%s: NOT AUTHENTIC\n", epcStr);
+      continue;
+    }
+    authentic++;
+    printf("%s: authentic, TRnd32 %08"PRIx32, epcStr, jobs[j].tagRandom);
+    if (0 < jobs[j].plainLen)
+    {
+      TMR_bytesToHex(jobs[j].plain, jobs[j].plainLen, dataStr);
+      printf(", data %s", dataStr);
+    }
+    printf("\n");
+  }
+
+  printf("%"PRIu32"/%"PRIu32" tags authentic\n", authentic, jobCount);
+  printf("Air time %"PRIu64" ms, verification %"PRIu64" ms on %"PRIu32" workers\n", airTime, verifyTime, workers);
+
+  TMR_destroy(rp);
+  return 0;
+}
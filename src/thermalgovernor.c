@@ -0,0 +1,549 @@
+/**
+ * Sample program that reads tags in the background and throttles the
+ * RF duty cycle based on the module temperature reported through the
+ * streamed reader stats.
+ *
+ * The governor steps through a table of thermal levels. Each level
+ * raises the asyncOffTime, lowers the read power and, when an antenna
+ * list is given, reads from fewer antennas. Levels are entered on the
+ * way up as soon as the temperature crosses the level threshold and
+ * left one at a time on the way down once the module has cooled below
+ * the level's exit temperature, so the reader recovers its throughput
+ * without oscillating around a single threshold.
+ *
+ * Reader parameters cannot be changed from inside a listener, so the
+ * stats listener only records the temperature and a separate governor
+ * thread stops, reconfigures and restarts the background read.
+ * @file thermalgovernor.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1,2\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1,2\n");}
+
+/* How long to read for, in seconds */
+#define READ_DURATION 300
+
+/* How often the governor re-evaluates when no stats arrive, in milliseconds */
+#define GOVERNOR_PERIOD 1000
+
+/**
+ * One step of the thermal throttling table.
+ * enterTemp:     temperature (C) at or above which this level is entered
+ * exitTemp:      temperature (C) at or below which this level is left
+ * asyncOffTime:  RF off time between search cycles (ms)
+ * powerDrop:     reduction applied to the base read power (cdBm)
+ * antennaStride: use every Nth antenna of the antenna list
+ */
+typedef struct ThermalLevel
+{
+  const char *name;
+  int8_t enterTemp;
+  int8_t exitTemp;
+  uint32_t asyncOffTime;
+  int32_t powerDrop;
+  uint8_t antennaStride;
+} ThermalLevel;
+
+static const ThermalLevel levels[] =
+{
+  { "NORMAL",   -128, -128,    0,    0, 1 },
+  { "WARM",       60,   55,  100,  300, 1 },
+  { "HOT",        70,   64,  500,  600, 2 },
+  { "CRITICAL",   80,   74, 1500, 1000, 4 },
+};
+#define NUM_LEVELS (sizeof(levels)/sizeof(levels[0]))
+
+typedef struct ThermalGovernor
+{
+  TMR_Reader *reader;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool exitThread;
+  bool haveTemperature;
+  int8_t temperature;
+  int8_t peakTemperature;
+  uint8_t level;
+  uint32_t transitions;
+  uint64_t levelEnteredAt;
+  uint64_t timeInLevel[NUM_LEVELS];
+  int32_t basePower;
+  int32_t minPower;
+  uint8_t *antennaList;
+  uint8_t antennaCount;
+} ThermalGovernor;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie);
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie);
+void statsCallback (TMR_Reader *reader, const TMR_Reader_StatsValues* stats, void *cookie);
+
+/**
+ * helper function to pick the level for the given temperature.
+ * Heating up may skip levels, cooling down only leaves one level at
+ * a time so the reader comes back gradually.
+ */
+static uint8_t
+nextLevel(uint8_t current, int8_t temperature)
+{
+  uint8_t target = current;
+
+  while (((size_t)target + 1 < NUM_LEVELS) && (temperature >= levels[target + 1].enterTemp))
+  {
+    target++;
+  }
+  if ((target == current) && (current > 0) && (temperature <= levels[current].exitTemp))
+  {
+    target = current - 1;
+  }
+  return target;
+}
+
+/**
+ * helper function to apply the settings of a level. Background reading
+ * is stopped while the parameters are changed and started again, also
+ * when a change fails, so a failed transition never leaves the reader
+ * idle.
+ */
+static TMR_Status
+applyLevel(ThermalGovernor *gov, uint8_t level)
+{
+  const ThermalLevel *lvl = &levels[level];
+  TMR_Reader *rp = gov->reader;
+  TMR_ReadPlan plan;
+  TMR_Status ret, startRet;
+  uint8_t antennas[20];
+  uint8_t count = 0;
+  uint32_t offTime;
+  int32_t power;
+  uint8_t i;
+
+  for (i = 0; i < gov->antennaCount; i += lvl->antennaStride)
+  {
+    antennas[count++] = gov->antennaList[i];
+  }
+
+  power = gov->basePower - lvl->powerDrop;
+  if (power < gov->minPower)
+  {
+    power = gov->minPower;
+  }
+  offTime = lvl->asyncOffTime;
+
+  ret = TMR_stopReading(rp);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_ASYNCOFFTIME, &offTime);
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_RADIO_READPOWER, &power);
+  }
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_RP_init_simple(&plan, count, (0 == count) ? NULL : antennas, TMR_TAG_PROTOCOL_GEN2, 1000);
+  }
+  if (TMR_SUCCESS == ret)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  }
+
+  /* Whatever got applied, keep reading */
+  startRet = TMR_startReading(rp);
+  if (TMR_SUCCESS != ret)
+  {
+    return ret;
+  }
+
+  printf("Thermal level %s: asyncOffTime %"PRIu32" ms, read power %"PRId32" cdBm, %d antenna(s)\n",
+         lvl->name, offTime, power, count);
+
+  return startRet;
+}
+
+static void*
+governorRoutine(void *arg)
+{
+  ThermalGovernor *gov = arg;
+  struct timespec deadline;
+  uint64_t now;
+  uint8_t target;
+  int8_t temperature;
+  TMR_Status ret;
+
+  while (1)
+  {
+    pthread_mutex_lock(&gov->lock);
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += GOVERNOR_PERIOD / 1000;
+    pthread_cond_timedwait(&gov->cond, &gov->lock, &deadline);
+    if (gov->exitThread)
+    {
+      pthread_mutex_unlock(&gov->lock);
+      break;
+    }
+    if (false == gov->haveTemperature)
+    {
+      pthread_mutex_unlock(&gov->lock);
+      continue;
+    }
+    temperature = gov->temperature;
+    pthread_mutex_unlock(&gov->lock);
+
+    target = nextLevel(gov->level, temperature);
+    if (target == gov->level)
+    {
+      continue;
+    }
+
+    ret = applyLevel(gov, target);
+    if (TMR_SUCCESS != ret)
+    {
+      /* The level is unchanged, so the next period tries again */
+      fprintf(stdout, "Error applying thermal level %s: %s\n", levels[target].name,
+              TMR_strerr(gov->reader, ret));
+      continue;
+    }
+
+    now = tmr_gettime();
+    printf("Thermal transition %s -> %s at %d(C), %"PRIu64" ms in previous level\n",
+           levels[gov->level].name, levels[target].name, temperature, now - gov->levelEnteredAt);
+    gov->timeInLevel[gov->level] += now - gov->levelEnteredAt;
+    gov->levelEnteredAt = now;
+    gov->level = target;
+    gov->transitions++;
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  TMR_StatsListenerBlock slb;
+  TMR_Reader_StatsFlag setFlag;
+  ThermalGovernor gov;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  uint64_t now;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  memset(&gov, 0, sizeof(gov));
+  gov.reader = rp;
+  gov.antennaList = antennaList;
+  gov.antennaCount = antennaCount;
+  pthread_mutex_init(&gov.lock, NULL);
+  pthread_cond_init(&gov.cond, NULL);
+
+  /* The configured power is the ceiling the governor restores to */
+  ret = TMR_paramGet(rp, TMR_PARAM_RADIO_READPOWER, &gov.basePower);
+  checkerr(rp, ret, 1, "getting read power");
+  {
+    uint16_t minPower;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_RADIO_POWERMIN, &minPower);
+    checkerr(rp, ret, 1, "getting minimum power");
+    gov.minPower = minPower;
+  }
+
+  // initialize the read plan
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+
+  /* Commit read plan */
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  rlb.listener = callback;
+  rlb.cookie = NULL;
+
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  slb.listener = statsCallback;
+  slb.cookie = &gov;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_addStatsListener(rp, &slb);
+  checkerr(rp, ret, 1, "adding the stats listener");
+
+  /** Only the temperature is needed to drive the governor */
+  setFlag = TMR_READER_STATS_FLAG_TEMPERATURE;
+  ret = TMR_paramSet(rp, TMR_PARAM_READER_STATS_ENABLE, &setFlag);
+  checkerr(rp, ret, 1, "setting the  fields");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  gov.levelEnteredAt = tmr_gettime();
+  if (0 != pthread_create(&gov.thread, NULL, governorRoutine, &gov))
+  {
+    errx(1, "Error creating governor thread\n");
+  }
+
+  printf("Reading for %d seconds with thermal governor\n", READ_DURATION);
+#ifndef WIN32
+  sleep(READ_DURATION);
+#else
+  Sleep(READ_DURATION * 1000);
+#endif
+
+  /* wait for the governor to exit before stopping the reader it drives */
+  pthread_mutex_lock(&gov.lock);
+  gov.exitThread = true;
+  pthread_cond_signal(&gov.cond);
+  pthread_mutex_unlock(&gov.lock);
+  pthread_join(gov.thread, NULL);
+
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+
+  now = tmr_gettime();
+  gov.timeInLevel[gov.level] += now - gov.levelEnteredAt;
+  printf("Peak temperature %d(C), %"PRIu32" transitions\n", gov.peakTemperature, gov.transitions);
+  for (i = 0; i < NUM_LEVELS; i++)
+  {
+    printf("  %-8s %"PRIu64" ms\n", levels[i].name, gov.timeInLevel[i]);
+  }
+
+  pthread_cond_destroy(&gov.cond);
+  pthread_mutex_destroy(&gov.lock);
+  TMR_destroy(rp);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}
+
+
+void
+callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  char epcStr[128];
+
+  TMR_bytesToHex(t->tag.epc, t->tag.epcByteCount, epcStr);
+  printf("Background read[ant:%i]: %s\n", t->antenna, epcStr);
+}
+
+void
+exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+void
+statsCallback (TMR_Reader *reader, const TMR_Reader_StatsValues* stats, void *cookie)
+{
+  ThermalGovernor *gov = cookie;
+
+  /** Each  field should be validated before extracting the value */
+  if (TMR_READER_STATS_FLAG_TEMPERATURE & stats->valid)
+  {
+    pthread_mutex_lock(&gov->lock);
+    if ((false == gov->haveTemperature) || (stats->temperature > gov->peakTemperature))
+    {
+      gov->peakTemperature = stats->temperature;
+    }
+    gov->temperature = stats->temperature;
+    gov->haveTemperature = true;
+    pthread_cond_signal(&gov->cond);
+    pthread_mutex_unlock(&gov->lock);
+  }
+}
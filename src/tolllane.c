@@ -0,0 +1,671 @@
+/**
+ * Sample program that runs the Denatran IAV full-pass authentication
+ * on every OBU passing a toll lane.
+ *
+ * OBUs are inventoried with short fast-search reads. Each new OBU then
+ * gets the full-pass sequence (Activate Siniav Mode, OBU Auth Full
+ * Pass1 and Pass2, ReadFromMemMap), addressed with a tag filter so no
+ * other OBU in the field answers. Every step is timed and retried on
+ * failure, but the whole sequence has to fit a per-vehicle time budget:
+ * once the budget is spent the vehicle is abandoned and the lane moves
+ * on. Reporting the responses is handed to a worker thread, so the
+ * host-side work on one vehicle overlaps the module's work on the next.
+ * @file tolllane.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 or tmr:///com4 --ant 1 --budget 40 --retries 2 --duration 60\n"\
+                         "tmr://my-reader.example.com or tmr://my-reader.example.com --ant 1\n");}
+
+#define DEFAULT_BUDGET_MS 40
+#define DEFAULT_RETRIES 2
+#define DEFAULT_DURATION_S 60
+/* Length of one inventory round */
+#define INVENTORY_TIMEOUT 30
+/* Below this, a tagop can't complete, so the vehicle is given up */
+#define MIN_COMMAND_TIMEOUT_MS 5
+/* An OBU seen again within this time is the same vehicle */
+#define HOLDOFF_MS 3000
+#define MAX_RECENT 64
+#define MAX_TAGS_PER_ROUND 16
+#define RECORD_QUEUE_SIZE 32
+#define MAX_RESPONSE_BYTES 64
+
+typedef enum IavStep
+{
+  STEP_ACTIVATE_SINIAV,
+  STEP_FULL_PASS1,
+  STEP_FULL_PASS2,
+  STEP_READ_MEMMAP,
+  STEP_COUNT
+} IavStep;
+
+static const char *stepNames[STEP_COUNT] =
+{
+  "ActivateSiniav", "FullPass1", "FullPass2", "ReadMemMap"
+};
+
+typedef struct VehicleRecord
+{
+  TMR_TagData tag;
+  TMR_Status status;
+  bool overBudget;
+  /* First step that did not complete, STEP_COUNT when all did */
+  IavStep lastStep;
+  uint32_t stepUs[STEP_COUNT];
+  uint8_t attempts[STEP_COUNT];
+  uint8_t response[STEP_COUNT][MAX_RESPONSE_BYTES];
+  uint8_t responseLen[STEP_COUNT];
+  uint32_t totalUs;
+  char error[64];
+} VehicleRecord;
+
+typedef struct RecordQueue
+{
+  VehicleRecord records[RECORD_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t dropped;
+  bool done;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} RecordQueue;
+
+typedef struct LaneStats
+{
+  uint32_t vehicles;
+  uint32_t completed;
+  uint32_t overBudget;
+  uint32_t failed;
+  uint32_t retries;
+  uint64_t stepTotalUs[STEP_COUNT];
+  uint32_t stepMaxUs[STEP_COUNT];
+  uint32_t stepCount[STEP_COUNT];
+  uint32_t maxVehicleUs;
+} LaneStats;
+
+typedef struct RecentTag
+{
+  TMR_TagData tag;
+  uint64_t lastSeen;
+} RecentTag;
+
+static RecordQueue queue;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+      fprintf(out, "\n         ");
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+/* The budget is tens of milliseconds, so time steps in microseconds */
+static uint64_t
+nowUs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static bool
+sameTag(const TMR_TagData *a, const TMR_TagData *b)
+{
+  return (a->epcByteCount == b->epcByteCount) && (0 == memcmp(a->epc, b->epc, a->epcByteCount));
+}
+
+/**
+ * helper function to tell whether an OBU belongs to a vehicle that was
+ * already handled. Remembers the OBU either way.
+ */
+static bool
+recentlySeen(RecentTag *recent, const TMR_TagData *tag, uint64_t now)
+{
+  int i, oldest = 0;
+
+  for (i = 0; i < MAX_RECENT; i++)
+  {
+    if ((0 < recent[i].tag.epcByteCount) && sameTag(&recent[i].tag, tag))
+    {
+      bool seen = (now - recent[i].lastSeen < HOLDOFF_MS);
+
+      recent[i].lastSeen = now;
+      return seen;
+    }
+    if (recent[i].lastSeen < recent[oldest].lastSeen)
+    {
+      oldest = i;
+    }
+  }
+  recent[oldest].tag = *tag;
+  recent[oldest].lastSeen = now;
+  return false;
+}
+
+static TMR_Status
+initStep(TMR_TagOp *op, IavStep step, TMR_uint8List *token)
+{
+  uint8_t controlByte = 0x80;
+
+  switch (step)
+  {
+    case STEP_ACTIVATE_SINIAV:
+      return TMR_TagOp_init_GEN2_Denatran_IAV_Activate_Siniav_Mode(op, controlByte, token);
+    case STEP_FULL_PASS1:
+      return TMR_TagOp_init_GEN2_Denatran_IAV_OBU_Auth_Full_Pass1(op, controlByte);
+    case STEP_FULL_PASS2:
+      return TMR_TagOp_init_GEN2_Denatran_IAV_OBU_Auth_Full_Pass2(op, controlByte);
+    case STEP_READ_MEMMAP:
+      return TMR_TagOp_init_GEN2_Denatran_IAV_OBU_ReadFromMemMap(op, controlByte, 0xffff);
+    default:
+      return TMR_ERROR_INVALID;
+  }
+}
+
+/**
+ * helper function to run the full-pass sequence on one OBU within the
+ * time budget, retrying steps that fail.
+ */
+static void
+processVehicle(TMR_Reader *rp, const TMR_TagData *tag, TMR_uint8List *token,
+               uint32_t budgetMs, uint32_t retries, VehicleRecord *rec, LaneStats *stats)
+{
+  TMR_TagFilter filter;
+  TMR_TagOp op;
+  TMR_uint8List dataList;
+  uint8_t data[128];
+  uint64_t start, stepStart, deadline, now;
+  uint32_t timeoutMs;
+  IavStep step;
+
+  memset(rec, 0, sizeof(*rec));
+  rec->tag = *tag;
+  rec->status = TMR_SUCCESS;
+  TMR_TF_init_tag(&filter, &rec->tag);
+  start = nowUs();
+  deadline = start + (uint64_t)budgetMs * 1000;
+
+  for (step = STEP_ACTIVATE_SINIAV; step < STEP_COUNT; step++)
+  {
+    stepStart = nowUs();
+    do
+    {
+      /**
+       * No attempt may run past the deadline, so each one gets whatever
+       * is left of the budget as its command timeout. The serial reader
+       * keeps the timeout on the host and sends it with the tagop, so
+       * setting it costs no extra round trip.
+       */
+      now = nowUs();
+      timeoutMs = (now < deadline) ? (uint32_t)((deadline - now) / 1000) : 0;
+      if (timeoutMs > budgetMs)
+      {
+        timeoutMs = budgetMs;
+      }
+      if (timeoutMs < MIN_COMMAND_TIMEOUT_MS)
+      {
+        rec->overBudget = true;
+        break;
+      }
+      if (0 < rec->attempts[step])
+      {
+        stats->retries++;
+      }
+      rec->attempts[step]++;
+      dataList.list = data;
+      dataList.max = sizeof(data);
+      dataList.len = 0;
+      rec->status = TMR_paramSet(rp, TMR_PARAM_COMMANDTIMEOUT, &timeoutMs);
+      if (TMR_SUCCESS == rec->status)
+      {
+        rec->status = initStep(&op, step, token);
+      }
+      if (TMR_SUCCESS == rec->status)
+      {
+        rec->status = TMR_executeTagOp(rp, &op, &filter, &dataList);
+      }
+    } while ((TMR_SUCCESS != rec->status) && (rec->attempts[step] <= retries));
+
+    rec->stepUs[step] = (uint32_t)(nowUs() - stepStart);
+    if (rec->overBudget || (TMR_SUCCESS != rec->status))
+    {
+      break;
+    }
+    rec->responseLen[step] = (dataList.len < MAX_RESPONSE_BYTES) ? (uint8_t)dataList.len : MAX_RESPONSE_BYTES;
+    memcpy(rec->response[step], dataList.list, rec->responseLen[step]);
+
+    stats->stepTotalUs[step] += rec->stepUs[step];
+    stats->stepCount[step]++;
+    if (rec->stepUs[step] > stats->stepMaxUs[step])
+    {
+      stats->stepMaxUs[step] = rec->stepUs[step];
+    }
+  }
+  rec->lastStep = step;
+  if (TMR_SUCCESS != rec->status)
+  {
+    snprintf(rec->error, sizeof(rec->error), "%s", TMR_strerr(rp, rec->status));
+  }
+  rec->totalUs = (uint32_t)(nowUs() - start);
+
+  stats->vehicles++;
+  if (rec->totalUs > stats->maxVehicleUs)
+  {
+    stats->maxVehicleUs = rec->totalUs;
+  }
+  if (STEP_COUNT == step)
+  {
+    stats->completed++;
+  }
+  else if (rec->overBudget)
+  {
+    stats->overBudget++;
+  }
+  else
+  {
+    stats->failed++;
+  }
+}
+
+/* helper function to queue a record without ever blocking the lane */
+static void
+postRecord(const VehicleRecord *rec)
+{
+  pthread_mutex_lock(&queue.lock);
+  if (queue.tail - queue.head < RECORD_QUEUE_SIZE)
+  {
+    queue.records[queue.tail % RECORD_QUEUE_SIZE] = *rec;
+    queue.tail++;
+    pthread_cond_signal(&queue.ready);
+  }
+  else
+  {
+    queue.dropped++;
+  }
+  pthread_mutex_unlock(&queue.lock);
+}
+
+static void
+reportRecord(const VehicleRecord *rec)
+{
+  char epcStr[128];
+  char dataStr[2 * MAX_RESPONSE_BYTES + 1];
+  int step;
+
+  TMR_bytesToHex(rec->tag.epc, rec->tag.epcByteCount, epcStr);
+  if (STEP_COUNT == rec->lastStep)
+  {
+    printf("OBU %s authenticated in %"PRIu32" us\n", epcStr, rec->totalUs);
+  }
+  else
+  {
+    printf("OBU %s failed at %s after %"PRIu32" us: %s\n", epcStr, stepNames[rec->lastStep], rec->totalUs,
+           rec->overBudget ? "time budget spent" : rec->error);
+  }
+  for (step = 0; step < (int)rec->lastStep; step++)
+  {
+    TMR_bytesToHex(rec->response[step], rec->responseLen[step], dataStr);
+    printf("  %-14s %6"PRIu32" us, %d attempt(s), %s\n", stepNames[step], rec->stepUs[step],
+           rec->attempts[step], dataStr);
+  }
+}
+
+static void *
+reportThread(void *arg)
+{
+  VehicleRecord rec;
+
+  pthread_mutex_lock(&queue.lock);
+  while (1)
+  {
+    while (!queue.done && (queue.head == queue.tail))
+    {
+      pthread_cond_wait(&queue.ready, &queue.lock);
+    }
+    if (queue.head == queue.tail)
+    {
+      break;
+    }
+    rec = queue.records[queue.head % RECORD_QUEUE_SIZE];
+    queue.head++;
+    pthread_mutex_unlock(&queue.lock);
+
+    reportRecord(&rec);
+
+    pthread_mutex_lock(&queue.lock);
+  }
+  pthread_mutex_unlock(&queue.lock);
+  return arg;
+}
+
+int main(int argc, char *argv[])
+{
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t i;
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  TMR_ReadPlan plan;
+  TMR_uint8List token;
+  uint8_t value[8] = {0xde, 0xad, 0xbe, 0xef, 0xde, 0xad, 0xbe, 0xef};
+  uint32_t budgetMs = DEFAULT_BUDGET_MS, retries = DEFAULT_RETRIES, duration = DEFAULT_DURATION_S;
+  static RecentTag recent[MAX_RECENT];
+  static LaneStats stats;
+  static VehicleRecord rec;
+  TMR_TagData tags[MAX_TAGS_PER_ROUND];
+  uint32_t tagCount, t;
+  uint64_t end, now;
+  pthread_t reporter;
+  int step;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  token.len = token.max = sizeof(value)/sizeof(value[0]);
+  token.list = value;
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing value for %s\n", argv[i]);
+      usage();
+    }
+    if(0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--budget", argv[i]))
+    {
+      if ((1 != sscanf(argv[i+1], "%"SCNu32, &budgetMs)) || (MIN_COMMAND_TIMEOUT_MS > budgetMs))
+      {
+        fprintf(stdout, "Can't parse '%s' as a time budget of at least %d milliseconds\n", argv[i+1],
+                MIN_COMMAND_TIMEOUT_MS);
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--retries", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNu32, &retries))
+      {
+        fprintf(stdout, "Can't parse '%s' as a retry count\n", argv[i+1]);
+        usage();
+      }
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      if (1 != sscanf(argv[i+1], "%"SCNu32, &duration))
+      {
+        fprintf(stdout, "Can't parse '%s' as a duration in seconds\n", argv[i+1]);
+        usage();
+      }
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+  //Use first antenna for operation
+  if (NULL != antennaList)
+  {
+    ret = TMR_paramSet(rp, TMR_PARAM_TAGOP_ANTENNA, &antennaList[0]);
+    checkerr(rp, ret, 1, "setting tagop antenna");
+  }
+
+  /* Same link settings as denatranIAVcustomtagoperations */
+  {
+    TMR_GEN2_LinkFrequency freq = TMR_GEN2_LINKFREQUENCY_320KHZ;
+    TMR_GEN2_Session session = TMR_GEN2_SESSION_S0;
+    TMR_GEN2_Target target = TMR_GEN2_TARGET_AB;
+    TMR_GEN2_Tari tari = TMR_GEN2_TARI_6_25US;
+    TMR_GEN2_TagEncoding tagEncoding = TMR_GEN2_FM0;
+    TMR_SR_GEN2_Q qValue;
+    qValue.type = TMR_SR_GEN2_Q_STATIC;
+    qValue.u.staticQ.initialQ = 0;
+
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_BLF, &freq);
+    checkerr(rp, ret, 1, "setting the BLF to 320KHZ");
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_SESSION, &session);
+    checkerr(rp, ret, 1, "setting the session to S0");
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_TARGET, &target);
+    checkerr(rp, ret, 1, "setting the target to AB");
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_TARI, &tari);
+    checkerr(rp, ret, 1, "setting the tari to 6.25");
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_TAGENCODING, &tagEncoding);
+    checkerr(rp, ret, 1, "setting the tagencdoing to FM0");
+    ret = TMR_paramSet(rp, TMR_PARAM_GEN2_Q, &qValue);
+    checkerr(rp, ret, 1, "setting Q as static");
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the read plan");
+  ret = TMR_RP_set_useFastSearch(&plan, true);
+  checkerr(rp, ret, 1, "setting fast search");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  pthread_mutex_init(&queue.lock, NULL);
+  pthread_cond_init(&queue.ready, NULL);
+  if (0 != pthread_create(&reporter, NULL, reportThread, NULL))
+  {
+    errx(1, "Error creating report thread\n");
+  }
+
+  printf("Lane open: budget %"PRIu32" ms per vehicle, %"PRIu32" retries per step\n", budgetMs, retries);
+  end = tmr_gettime() + (uint64_t)duration * 1000;
+  while (tmr_gettime() < end)
+  {
+    ret = TMR_read(rp, INVENTORY_TIMEOUT, NULL);
+    if ((TMR_SUCCESS != ret) && (TMR_ERROR_TAG_ID_BUFFER_FULL != ret))
+    {
+      fprintf(stdout, "reading tags:%s\n", TMR_strerr(rp, ret));
+      continue;
+    }
+
+    /* Drain the buffer before any tagop reuses the module */
+    tagCount = 0;
+    while (TMR_SUCCESS == TMR_hasMoreTags(rp))
+    {
+      TMR_TagReadData trd;
+
+      ret = TMR_getNextTag(rp, &trd);
+      checkerr(rp, ret, 1, "fetching tag");
+      if (tagCount < MAX_TAGS_PER_ROUND)
+      {
+        tags[tagCount++] = trd.tag;
+      }
+    }
+
+    now = tmr_gettime();
+    for (t = 0; t < tagCount; t++)
+    {
+      if (recentlySeen(recent, &tags[t], now))
+      {
+        continue;
+      }
+      processVehicle(rp, &tags[t], &token, budgetMs, retries, &rec, &stats);
+      postRecord(&rec);
+    }
+  }
+
+  pthread_mutex_lock(&queue.lock);
+  queue.done = true;
+  pthread_cond_signal(&queue.ready);
+  pthread_mutex_unlock(&queue.lock);
+  pthread_join(reporter, NULL);
+
+  printf("\n%"PRIu32" vehicles: %"PRIu32" authenticated, %"PRIu32" over budget, %"PRIu32" failed, %"PRIu32" retries\n",
+         stats.vehicles, stats.completed, stats.overBudget, stats.failed, stats.retries);
+  printf("Slowest vehicle %"PRIu32" us, %"PRIu32" reports dropped\n", stats.maxVehicleUs, queue.dropped);
+  for (step = 0; step < STEP_COUNT; step++)
+  {
+    if (0 < stats.stepCount[step])
+    {
+      printf("  %-14s avg %6"PRIu64" us, max %6"PRIu32" us\n", stepNames[step],
+             stats.stepTotalUs[step] / stats.stepCount[step], stats.stepMaxUs[step]);
+    }
+  }
+
+  TMR_destroy(rp);
+  return 0;
+}
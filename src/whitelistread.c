@@ -0,0 +1,1150 @@
+/**
+ * Sample program that checks every tag read against an EPC whitelist
+ * that keeps changing while reading goes on.
+ *
+ * The whitelist starts from a set file (the sorted format written by
+ * exitalarm --build) that is mapped into memory. Additions and removals
+ * arrive as text lines, "+EPC" or "-EPC", on a local datagram socket
+ * (--socket) and/or appended to a file that is tailed (--tail). An
+ * updater thread gathers them every --publish ms into a small sorted
+ * delta and publishes a new immutable generation: the mapped base plus
+ * that delta. Every --compact ms, or once the delta holds --max-delta
+ * EPCs, base and delta are merged into a new set file that replaces the
+ * old one on disk, and a generation with an empty delta is swapped in.
+ *
+ * The read listener never takes a lock. It announces the epoch it
+ * entered in, follows the current-generation pointer and looks the EPC
+ * up; a replaced generation is only freed once every reader has left
+ * the epoch it was retired in, the same way RCU reclaims memory.
+ * @file whitelistread.c
+ */
+
+#include <tm_reader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#endif
+
+/* Enable this to use transportListener */
+#ifndef USE_TRANSPORT_LISTENER
+#define USE_TRANSPORT_LISTENER 0
+#endif
+
+#define usage() {errx(1, "Please provide reader URL, such as:\n"\
+                         "tmr:///com4 --set allowed.set --socket /tmp/whitelist.sock\n"\
+                         "tmr:///com4 --ant 1,2 --set allowed.set --tail sales.log --publish 50 --compact 10000 --max-delta 4096\n"\
+                         "tmr://my-reader.example.com --set allowed.set --socket /tmp/whitelist.sock --duration 60000\n");}
+
+#define DEFAULT_PUBLISH_MS 50
+#define DEFAULT_COMPACT_MS 10000
+#define DEFAULT_MAX_DELTA 4096
+#define DEFAULT_DURATION_MS 30000
+/* Threads that may look EPCs up */
+#define MAX_READERS 8
+/* Changes waiting for the updater; further ones are dropped and counted */
+#define MAX_PENDING 65536
+/* How often the tailed file is checked for new lines */
+#define TAIL_POLL_MS 100
+
+/* Set records: EPC length byte, then the EPC padded with zeros */
+#define MAX_RECORD_SIZE (1 + TMR_MAX_EPC_BYTE_COUNT)
+#define DEFAULT_RECORD_SIZE (1 + 12)
+#define SET_MAGIC "TMEPCSET"
+
+/* The tag path relies on these being lock-free */
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_EXCHANGE(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_FETCH_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+
+/* Header of a set file, followed by count sorted records */
+typedef struct EpcSetHeader
+{
+  char magic[8];
+  uint32_t recordSize;
+  uint32_t reserved;
+  uint64_t count;
+} EpcSetHeader;
+
+/* A mapped set file, shared by the generations built on it */
+typedef struct BaseMap
+{
+  const uint8_t *map;
+  uint64_t size;
+  const uint8_t *records;
+  uint32_t recordSize;
+  uint64_t count;
+  uint32_t refs;      /* generations using it, updater thread only */
+} BaseMap;
+
+typedef enum DeltaState
+{
+  DELTA_ADD = 1,
+  DELTA_REMOVE
+} DeltaState;
+
+/* A change on top of the base, records are full size */
+typedef struct DeltaEntry
+{
+  uint32_t seq;
+  uint8_t state;
+  uint8_t record[MAX_RECORD_SIZE];
+} DeltaEntry;
+
+/* Immutable once published */
+typedef struct Generation
+{
+  uint64_t number;
+  BaseMap *base;
+  DeltaEntry *delta;
+  uint32_t deltaCount;
+  /* Set when it is replaced */
+  uint64_t retireEpoch;
+  struct Generation *nextRetired;
+} Generation;
+
+/* Epoch a reader entered in, 0 while it is outside; one cache line each */
+typedef struct ReaderSlot
+{
+  uint64_t epoch;
+  uint8_t pad[56];
+} ReaderSlot;
+
+typedef struct WhitelistStore
+{
+  /* Shared with the readers */
+  Generation *current;
+  uint64_t epoch;
+  ReaderSlot readers[MAX_READERS];
+  uint32_t readerCount;
+  /* Fed by the sources, drained by the updater */
+  pthread_mutex_t pendingLock;
+  DeltaEntry *pending;
+  uint32_t pendingCount;
+  uint64_t dropped;
+  /* Updater thread only */
+  const char *path;
+  uint32_t publishMs;
+  uint32_t compactMs;
+  uint32_t maxDelta;
+  Generation *retired;
+  uint64_t nextNumber;
+  uint64_t published;
+  uint64_t compactions;
+  uint64_t reclaimed;
+  uint64_t applied;
+  volatile bool stop;
+} WhitelistStore;
+
+/* Read path statistics, touched by the read listener only */
+typedef struct ReadStats
+{
+  WhitelistStore *store;
+  int slot;
+  uint64_t reads;
+  uint64_t listed;
+  uint64_t lastGeneration;
+} ReadStats;
+
+/* A source of changes: the socket or the tailed file */
+typedef struct DeltaSource
+{
+  WhitelistStore *store;
+  const char *path;
+  int fd;
+} DeltaSource;
+
+void errx(int exitval, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+
+  exit(exitval);
+}
+
+void checkerr(TMR_Reader* rp, TMR_Status ret, int exitval, const char *msg)
+{
+  if (TMR_SUCCESS != ret)
+  {
+    errx(exitval, "Error %s: %s\n", msg, TMR_strerr(rp, ret));
+  }
+}
+
+void serialPrinter(bool tx, uint32_t dataLen, const uint8_t data[],
+                   uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+  uint32_t i;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  for (i = 0; i < dataLen; i++)
+  {
+    if (i > 0 && (i & 15) == 0)
+    {
+      fprintf(out, "\n         ");
+    }
+    fprintf(out, " %02x", data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void stringPrinter(bool tx,uint32_t dataLen, const uint8_t data[],uint32_t timeout, void *cookie)
+{
+  FILE *out = cookie;
+
+  fprintf(out, "%s", tx ? "Sending: " : "Received:");
+  fprintf(out, "%s\n", data);
+}
+
+void parseAntennaList(uint8_t *antenna, uint8_t *antennaCount, char *args)
+{
+  char *token = NULL;
+  char *str = ",";
+  uint8_t i = 0x00;
+  int scans;
+
+  /* get the first token */
+  if (NULL == args)
+  {
+    fprintf(stdout, "Missing argument\n");
+    usage();
+  }
+
+  token = strtok(args, str);
+  if (NULL == token)
+  {
+    fprintf(stdout, "Missing argument after %s\n", args);
+    usage();
+  }
+
+  while(NULL != token)
+  {
+    scans = sscanf(token, "%"SCNu8, &antenna[i]);
+    if (1 != scans)
+    {
+      fprintf(stdout, "Can't parse '%s' as an 8-bit unsigned integer value\n", token);
+      usage();
+    }
+    i++;
+    token = strtok(NULL, str);
+  }
+  *antennaCount = i;
+}
+
+static uint64_t nowMs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* helper function to turn an EPC into a full size record */
+static void makeRecord(const uint8_t *epc, uint8_t len, uint8_t *record)
+{
+  memset(record, 0, MAX_RECORD_SIZE);
+  record[0] = len;
+  memcpy(record + 1, epc, len);
+}
+
+/* helper function to parse a hex EPC, returns the byte count or -1 */
+static int parseEpc(const char *hex, uint8_t *epc)
+{
+  int len = 0;
+  unsigned int byte;
+
+  while ('\0' != hex[0] && '\r' != hex[0] && '\n' != hex[0])
+  {
+    if (len >= TMR_MAX_EPC_BYTE_COUNT || 1 != sscanf(hex, "%2x", &byte)
+        || '\0' == hex[1] || '\n' == hex[1])
+    {
+      return -1;
+    }
+    epc[len++] = (uint8_t)byte;
+    hex += 2;
+  }
+  return (0 == len) ? -1 : len;
+}
+
+/**
+ * helper function to map a set file. A missing file is an empty set,
+ * the first compaction will create it.
+ */
+static BaseMap *openBase(const char *path)
+{
+  const EpcSetHeader *header;
+  struct stat st;
+  BaseMap *b;
+  void *map;
+  int fd;
+
+  b = calloc(1, sizeof(*b));
+  if (NULL == b)
+  {
+    return NULL;
+  }
+  b->recordSize = DEFAULT_RECORD_SIZE;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    if (ENOENT == errno)
+    {
+      return b;
+    }
+    perror("Can't open set file");
+    free(b);
+    return NULL;
+  }
+  if (0 != fstat(fd, &st) || (uint64_t)st.st_size < sizeof(EpcSetHeader))
+  {
+    fprintf(stderr, "Can't use \"%s\": not a set file\n", path);
+    close(fd);
+    free(b);
+    return NULL;
+  }
+  b->size = (uint64_t)st.st_size;
+  map = mmap(NULL, b->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map)
+  {
+    perror("Can't map set file");
+    free(b);
+    return NULL;
+  }
+  b->map = map;
+
+  header = (const EpcSetHeader *)b->map;
+  if (0 != memcmp(header->magic, SET_MAGIC, sizeof(header->magic))
+      || 0 == header->recordSize || header->recordSize > MAX_RECORD_SIZE
+      || header->count > (b->size - sizeof(EpcSetHeader)) / header->recordSize)
+  {
+    fprintf(stderr, "Can't use \"%s\": bad header or truncated\n", path);
+    munmap((void *)b->map, b->size);
+    free(b);
+    return NULL;
+  }
+  b->records = b->map + sizeof(EpcSetHeader);
+  b->recordSize = header->recordSize;
+  b->count = header->count;
+  madvise((void *)b->map, b->size, MADV_RANDOM);
+  return b;
+}
+
+static void releaseBase(BaseMap *b)
+{
+  if (0 != --b->refs)
+  {
+    return;
+  }
+  if (NULL != b->map)
+  {
+    /* The file may have been replaced already, the mapping stays valid */
+    munmap((void *)b->map, b->size);
+  }
+  free(b);
+}
+
+static bool baseContains(const BaseMap *b, const uint8_t *record)
+{
+  uint64_t lo = 0, hi = b->count, mid;
+  int cmp;
+
+  if (record[0] + 1 > (int)b->recordSize)
+  {
+    return false;
+  }
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    cmp = memcmp(b->records + mid * b->recordSize, record, b->recordSize);
+    if (0 == cmp)
+    {
+      return true;
+    }
+    if (cmp < 0)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
+/* helper function to look a record up in a generation, delta first */
+static bool generationContains(const Generation *g, const uint8_t *record)
+{
+  uint32_t lo = 0, hi = g->deltaCount, mid;
+  int cmp;
+
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    cmp = memcmp(g->delta[mid].record, record, MAX_RECORD_SIZE);
+    if (0 == cmp)
+    {
+      return DELTA_ADD == g->delta[mid].state;
+    }
+    if (cmp < 0)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return baseContains(g->base, record);
+}
+
+static int compareDelta(const void *a, const void *b)
+{
+  const DeltaEntry *x = a, *y = b;
+  int cmp;
+
+  cmp = memcmp(x->record, y->record, MAX_RECORD_SIZE);
+  if (0 != cmp)
+  {
+    return cmp;
+  }
+  return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
+
+static Generation *newGeneration(WhitelistStore *s, BaseMap *base, uint32_t deltaMax)
+{
+  Generation *g;
+
+  g = calloc(1, sizeof(*g));
+  if (NULL == g)
+  {
+    return NULL;
+  }
+  if (0 != deltaMax && NULL == (g->delta = malloc(deltaMax * sizeof(DeltaEntry))))
+  {
+    free(g);
+    return NULL;
+  }
+  g->number = s->nextNumber++;
+  g->base = base;
+  base->refs++;
+  return g;
+}
+
+static void freeGeneration(Generation *g)
+{
+  releaseBase(g->base);
+  free(g->delta);
+  free(g);
+}
+
+/**
+ * Register a thread that will call storeContains(). Returns its slot,
+ * or -1 when all MAX_READERS slots are taken.
+ */
+static int storeRegisterReader(WhitelistStore *s)
+{
+  uint32_t slot = ATOMIC_FETCH_ADD(&s->readerCount, 1);
+
+  return (slot < MAX_READERS) ? (int)slot : -1;
+}
+
+/**
+ * Look an EPC up on the tag path. Lock-free: the slot's epoch keeps
+ * the generation alive while it is being read.
+ */
+static bool storeContains(WhitelistStore *s, int slot, const uint8_t *epc,
+                          uint8_t len, uint64_t *generation)
+{
+  uint8_t record[MAX_RECORD_SIZE];
+  Generation *g;
+  bool listed;
+
+  makeRecord(epc, len, record);
+  ATOMIC_STORE(&s->readers[slot].epoch, ATOMIC_LOAD(&s->epoch));
+  g = ATOMIC_LOAD(&s->current);
+  listed = generationContains(g, record);
+  *generation = g->number;
+  ATOMIC_STORE(&s->readers[slot].epoch, 0);
+  return listed;
+}
+
+/* Queue an addition or removal for the next generation */
+static void storeSubmit(WhitelistStore *s, const uint8_t *epc, uint8_t len, DeltaState state)
+{
+  DeltaEntry *e;
+
+  pthread_mutex_lock(&s->pendingLock);
+  if (s->pendingCount >= MAX_PENDING)
+  {
+    s->dropped++;
+  }
+  else
+  {
+    e = &s->pending[s->pendingCount++];
+    e->state = (uint8_t)state;
+    makeRecord(epc, len, e->record);
+  }
+  pthread_mutex_unlock(&s->pendingLock);
+}
+
+/* helper function to swap a generation in and queue the old one for reclamation */
+static void publish(WhitelistStore *s, Generation *g)
+{
+  Generation *old;
+
+  old = ATOMIC_EXCHANGE(&s->current, g);
+  /* Readers that enter from now on can't see the old generation */
+  old->retireEpoch = ATOMIC_FETCH_ADD(&s->epoch, 1);
+  old->nextRetired = s->retired;
+  s->retired = old;
+  s->published++;
+}
+
+/* helper function to free the retired generations no reader can still be using */
+static void reclaim(WhitelistStore *s)
+{
+  Generation **link, *g;
+  uint64_t oldest = UINT64_MAX, e;
+  uint32_t i;
+
+  for (i = 0; i < MAX_READERS; i++)
+  {
+    e = ATOMIC_LOAD(&s->readers[i].epoch);
+    if (0 != e && e < oldest)
+    {
+      oldest = e;
+    }
+  }
+  link = &s->retired;
+  while (NULL != (g = *link))
+  {
+    if (g->retireEpoch < oldest)
+    {
+      *link = g->nextRetired;
+      freeGeneration(g);
+      s->reclaimed++;
+    }
+    else
+    {
+      link = &g->nextRetired;
+    }
+  }
+}
+
+/**
+ * helper function to build the next generation: the current delta with
+ * the pending changes on top. When an EPC changes several times only
+ * the last change counts.
+ */
+static Generation *applyChanges(WhitelistStore *s, const Generation *cur,
+                                DeltaEntry *changes, uint32_t count)
+{
+  Generation *g;
+  uint32_t i, n, total = cur->deltaCount + count;
+
+  g = newGeneration(s, cur->base, total);
+  if (NULL == g)
+  {
+    return NULL;
+  }
+  memcpy(g->delta, cur->delta, cur->deltaCount * sizeof(DeltaEntry));
+  memcpy(g->delta + cur->deltaCount, changes, count * sizeof(DeltaEntry));
+  for (i = 0; i < total; i++)
+  {
+    g->delta[i].seq = i;
+  }
+  qsort(g->delta, total, sizeof(DeltaEntry), compareDelta);
+  /* Keep the last entry of each run of equal records */
+  for (i = 0, n = 0; i < total; i++)
+  {
+    if (i + 1 < total && 0 == memcmp(g->delta[i].record, g->delta[i + 1].record, MAX_RECORD_SIZE))
+    {
+      continue;
+    }
+    g->delta[n++] = g->delta[i];
+  }
+  g->deltaCount = n;
+  return g;
+}
+
+/**
+ * helper function to merge base and delta into a new set file. It is
+ * written next to the old one and renamed over it, so the file on disk
+ * is always complete.
+ */
+static BaseMap *compact(WhitelistStore *s, const Generation *cur)
+{
+  const BaseMap *b = cur->base;
+  uint8_t baseRecord[MAX_RECORD_SIZE];
+  char tmpPath[512];
+  EpcSetHeader header;
+  uint64_t i = 0, written = 0;
+  uint32_t j = 0, recordSize = b->recordSize;
+  const uint8_t *out;
+  FILE *f;
+  int cmp;
+  bool ok;
+
+  /* Grow the records if an added EPC is longer than the old ones */
+  for (j = 0; j < cur->deltaCount; j++)
+  {
+    if (DELTA_ADD == cur->delta[j].state && cur->delta[j].record[0] + 1u > recordSize)
+    {
+      recordSize = cur->delta[j].record[0] + 1u;
+    }
+  }
+
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", s->path);
+  if (NULL == (f = fopen(tmpPath, "wb")))
+  {
+    perror("Can't create compacted set file");
+    return NULL;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SET_MAGIC, sizeof(header.magic));
+  header.recordSize = recordSize;
+  ok = (1 == fwrite(&header, sizeof(header), 1, f));
+
+  j = 0;
+  while (ok && (i < b->count || j < cur->deltaCount))
+  {
+    out = NULL;
+    if (i < b->count)
+    {
+      memset(baseRecord, 0, sizeof(baseRecord));
+      memcpy(baseRecord, b->records + i * b->recordSize, b->recordSize);
+    }
+    cmp = (i >= b->count) ? 1 : (j >= cur->deltaCount) ? -1
+          : memcmp(baseRecord, cur->delta[j].record, MAX_RECORD_SIZE);
+    if (cmp < 0)
+    {
+      out = baseRecord;
+      i++;
+    }
+    else
+    {
+      if (DELTA_ADD == cur->delta[j].state)
+      {
+        out = cur->delta[j].record;
+      }
+      i += (0 == cmp);
+      j++;
+    }
+    if (NULL != out)
+    {
+      ok = (1 == fwrite(out, recordSize, 1, f));
+      written++;
+    }
+  }
+
+  header.count = written;
+  ok = ok && 0 == fseek(f, 0, SEEK_SET) && 1 == fwrite(&header, sizeof(header), 1, f)
+       && 0 == fflush(f) && 0 == fsync(fileno(f));
+  ok = (0 == fclose(f)) && ok;
+  if (!ok || 0 != rename(tmpPath, s->path))
+  {
+    perror("Can't write compacted set file");
+    remove(tmpPath);
+    return NULL;
+  }
+  return openBase(s->path);
+}
+
+/**
+ * Updater thread: the only writer. Publishes pending changes every
+ * --publish ms, compacts when due and frees what readers have left.
+ */
+static void *updater(void *arg)
+{
+  WhitelistStore *s = arg;
+  DeltaEntry *batch, *swap;
+  Generation *cur, *next;
+  BaseMap *base;
+  uint32_t count;
+  uint64_t lastCompact = nowMs(), started;
+
+  batch = malloc(MAX_PENDING * sizeof(DeltaEntry));
+  if (NULL == batch)
+  {
+    errx(1, "Out of memory\n");
+  }
+
+  while (!s->stop)
+  {
+    tmr_sleep(s->publishMs);
+
+    /* Swap buffers so the sources are held up as little as possible */
+    pthread_mutex_lock(&s->pendingLock);
+    count = s->pendingCount;
+    swap = s->pending;
+    s->pending = batch;
+    batch = swap;
+    s->pendingCount = 0;
+    pthread_mutex_unlock(&s->pendingLock);
+
+    cur = s->current;
+    if (0 != count)
+    {
+      next = applyChanges(s, cur, batch, count);
+      if (NULL != next)
+      {
+        publish(s, next);
+        s->applied += count;
+        printf("Generation %" PRIu64 ": %" PRIu32 " changes, delta now %" PRIu32 " EPCs\n",
+               next->number, count, next->deltaCount);
+        cur = next;
+      }
+    }
+
+    if (0 != cur->deltaCount
+        && (cur->deltaCount >= s->maxDelta || nowMs() - lastCompact >= s->compactMs))
+    {
+      started = nowMs();
+      base = compact(s, cur);
+      if (NULL != base && NULL != (next = newGeneration(s, base, 0)))
+      {
+        publish(s, next);
+        s->compactions++;
+        printf("Generation %" PRIu64 ": compacted to %" PRIu64 " EPCs in %" PRIu64 " ms\n",
+               next->number, base->count, nowMs() - started);
+      }
+      else if (NULL != base)
+      {
+        base->refs = 1;
+        releaseBase(base);
+      }
+      lastCompact = nowMs();
+    }
+
+    reclaim(s);
+  }
+  free(batch);
+  return NULL;
+}
+
+/* helper function to apply one "+EPC" / "-EPC" line */
+static void submitLine(WhitelistStore *s, const char *line)
+{
+  uint8_t epc[TMR_MAX_EPC_BYTE_COUNT];
+  DeltaState state = DELTA_ADD;
+  int len;
+
+  if ('+' == line[0] || '-' == line[0])
+  {
+    state = ('-' == line[0]) ? DELTA_REMOVE : DELTA_ADD;
+    line++;
+  }
+  if ('#' == line[0] || '\n' == line[0] || '\r' == line[0] || '\0' == line[0])
+  {
+    return;
+  }
+  len = parseEpc(line, epc);
+  if (len < 0)
+  {
+    fprintf(stderr, "Ignoring whitelist change '%s'\n", line);
+    return;
+  }
+  storeSubmit(s, epc, (uint8_t)len, state);
+}
+
+/**
+ * Socket source thread: each datagram holds one or more change lines,
+ * e.g. from  echo +E2001234 | socat - UNIX-SENDTO:/tmp/whitelist.sock
+ */
+static void *socketSource(void *arg)
+{
+  DeltaSource *src = arg;
+  char msg[4096];
+  char *line, *save;
+  ssize_t n;
+
+  while (!src->store->stop)
+  {
+    n = recv(src->fd, msg, sizeof(msg) - 1, 0);
+    if (n <= 0)
+    {
+      continue;   /* receive timeout, look at the stop flag again */
+    }
+    msg[n] = '\0';
+    for (line = strtok_r(msg, "\n", &save); NULL != line; line = strtok_r(NULL, "\n", &save))
+    {
+      submitLine(src->store, line);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Tail source thread: applies the lines already in the file, then
+ * follows it like tail -f. A line is only applied once its newline has
+ * been written.
+ */
+static void *tailSource(void *arg)
+{
+  DeltaSource *src = arg;
+  FILE *f = NULL;
+  char line[2 * TMR_MAX_EPC_BYTE_COUNT + 8];
+  size_t have = 0;
+
+  while (!src->store->stop)
+  {
+    if (NULL == f && NULL == (f = fopen(src->path, "r")))
+    {
+      tmr_sleep(TAIL_POLL_MS);
+      continue;
+    }
+    if (NULL != fgets(line + have, (int)(sizeof(line) - have), f))
+    {
+      have += strlen(line + have);
+      if ('\n' == line[have - 1] || have == sizeof(line) - 1)
+      {
+        submitLine(src->store, line);
+        have = 0;
+      }
+      continue;
+    }
+    clearerr(f);
+    tmr_sleep(TAIL_POLL_MS);
+  }
+  if (NULL != f)
+  {
+    fclose(f);
+  }
+  return NULL;
+}
+
+/* helper function to bind the datagram socket changes arrive on */
+static int openSocket(const char *path)
+{
+  struct sockaddr_un addr;
+  struct timeval tv;
+  int fd;
+
+  fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+  /* Wake up now and then so the thread notices shutdown */
+  tv.tv_sec = 0;
+  tv.tv_usec = 200000;
+  if (0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))
+      || 0 != setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void callback(TMR_Reader *reader, const TMR_TagReadData *t, void *cookie)
+{
+  ReadStats *stats = cookie;
+  char epcStr[128];
+  uint64_t generation;
+  bool listed;
+
+  listed = storeContains(stats->store, stats->slot, t->tag.epc, t->tag.epcByteCount, &generation);
+  stats->reads++;
+  stats->listed += listed;
+  stats->lastGeneration = generation;
+
+  TMR_bytesToHex(t->tag.epc, t->tag.epcByteCount, epcStr);
+  printf("Background read: %s %s (generation %" PRIu64 ")\n",
+         epcStr, listed ? "whitelisted" : "NOT whitelisted", generation);
+}
+
+void exceptionCallback(TMR_Reader *reader, TMR_Status error, void *cookie)
+{
+  fprintf(stdout, "Error:%s\n", TMR_strerr(reader, error));
+}
+
+int main(int argc, char *argv[])
+{
+
+#ifndef TMR_ENABLE_BACKGROUND_READS
+  errx(1, "This sample requires background read functionality.\n"
+          "Please enable TMR_ENABLE_BACKGROUND_READS in tm_config.h\n"
+          "to run this codelet\n");
+  return -1;
+#else
+
+  TMR_Reader r, *rp;
+  TMR_Status ret;
+  TMR_Region region;
+  TMR_ReadPlan plan;
+  TMR_ReadListenerBlock rlb;
+  TMR_ReadExceptionListenerBlock reb;
+  uint8_t *antennaList = NULL;
+  uint8_t buffer[20];
+  uint8_t antennaCount = 0x0;
+  TMR_String model;
+  char str[64];
+  const char *socketPath = NULL;
+  uint32_t durationMs = DEFAULT_DURATION_MS;
+  pthread_t updaterTid, socketTid, tailTid;
+  DeltaSource sock, tail;
+  WhitelistStore *store;
+  ReadStats stats;
+  BaseMap *base;
+  Generation *g;
+  int i;
+#if USE_TRANSPORT_LISTENER
+  TMR_TransportListenerBlock tb;
+#endif
+
+  if (argc < 2)
+  {
+    usage();
+  }
+
+  store = calloc(1, sizeof(*store));
+  if (NULL == store)
+  {
+    errx(1, "Out of memory\n");
+  }
+  store->publishMs = DEFAULT_PUBLISH_MS;
+  store->compactMs = DEFAULT_COMPACT_MS;
+  store->maxDelta = DEFAULT_MAX_DELTA;
+  store->epoch = 1;
+  store->nextNumber = 1;
+  memset(&sock, 0, sizeof(sock));
+  memset(&tail, 0, sizeof(tail));
+
+  for (i = 2; i < argc; i+=2)
+  {
+    if (i + 1 >= argc)
+    {
+      fprintf(stdout, "Missing argument after %s\n", argv[i]);
+      usage();
+    }
+    if (0x00 == strcmp("--ant", argv[i]))
+    {
+      if (NULL != antennaList)
+      {
+        fprintf(stdout, "Duplicate argument: --ant specified more than once\n");
+        usage();
+      }
+      parseAntennaList(buffer, &antennaCount, argv[i+1]);
+      antennaList = buffer;
+    }
+    else if (0x00 == strcmp("--set", argv[i]))
+    {
+      store->path = argv[i+1];
+    }
+    else if (0x00 == strcmp("--socket", argv[i]))
+    {
+      socketPath = argv[i+1];
+    }
+    else if (0x00 == strcmp("--tail", argv[i]))
+    {
+      tail.path = argv[i+1];
+    }
+    else if (0x00 == strcmp("--publish", argv[i]))
+    {
+      store->publishMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--compact", argv[i]))
+    {
+      store->compactMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--max-delta", argv[i]))
+    {
+      store->maxDelta = (uint32_t)atoi(argv[i+1]);
+    }
+    else if (0x00 == strcmp("--duration", argv[i]))
+    {
+      durationMs = (uint32_t)atoi(argv[i+1]);
+    }
+    else
+    {
+      fprintf(stdout, "Argument %s is not recognized\n", argv[i]);
+      usage();
+    }
+  }
+  if (NULL == store->path)
+  {
+    fprintf(stdout, "Missing --set\n");
+    usage();
+  }
+
+  store->pending = malloc(MAX_PENDING * sizeof(DeltaEntry));
+  base = openBase(store->path);
+  if (NULL == store->pending || NULL == base)
+  {
+    errx(1, "Can't load whitelist %s\n", store->path);
+  }
+  store->current = newGeneration(store, base, 0);
+  if (NULL == store->current)
+  {
+    errx(1, "Out of memory\n");
+  }
+  pthread_mutex_init(&store->pendingLock, NULL);
+  printf("Generation %" PRIu64 ": %" PRIu64 " EPCs from %s\n",
+         store->current->number, base->count, store->path);
+
+  stats.store = store;
+  stats.slot = storeRegisterReader(store);
+  stats.reads = stats.listed = stats.lastGeneration = 0;
+
+  if (0 != pthread_create(&updaterTid, NULL, updater, store))
+  {
+    errx(1, "Can't start the updater thread\n");
+  }
+  if (NULL != socketPath)
+  {
+    sock.store = store;
+    sock.path = socketPath;
+    sock.fd = openSocket(socketPath);
+    if (sock.fd < 0 || 0 != pthread_create(&socketTid, NULL, socketSource, &sock))
+    {
+      errx(1, "Can't listen on %s\n", socketPath);
+    }
+  }
+  if (NULL != tail.path)
+  {
+    tail.store = store;
+    if (0 != pthread_create(&tailTid, NULL, tailSource, &tail))
+    {
+      errx(1, "Can't start tailing %s\n", tail.path);
+    }
+  }
+
+  rp = &r;
+  ret = TMR_create(rp, argv[1]);
+  checkerr(rp, ret, 1, "creating reader");
+
+#if USE_TRANSPORT_LISTENER
+
+  if (TMR_READER_TYPE_SERIAL == rp->readerType)
+  {
+    tb.listener = serialPrinter;
+  }
+  else
+  {
+    tb.listener = stringPrinter;
+  }
+  tb.cookie = stdout;
+
+  TMR_addTransportListener(rp, &tb);
+#endif
+
+  ret = TMR_connect(rp);
+  checkerr(rp, ret, 1, "connecting reader");
+
+  region = TMR_REGION_NONE;
+  ret = TMR_paramGet(rp, TMR_PARAM_REGION_ID, &region);
+  checkerr(rp, ret, 1, "getting region");
+
+  if (TMR_REGION_NONE == region)
+  {
+    TMR_RegionList regions;
+    TMR_Region _regionStore[32];
+    regions.list = _regionStore;
+    regions.max = sizeof(_regionStore)/sizeof(_regionStore[0]);
+    regions.len = 0;
+
+    ret = TMR_paramGet(rp, TMR_PARAM_REGION_SUPPORTEDREGIONS, &regions);
+    checkerr(rp, ret, __LINE__, "getting supported regions");
+
+    if (regions.len < 1)
+    {
+      checkerr(rp, TMR_ERROR_INVALID_REGION, __LINE__, "Reader doesn't supportany regions");
+    }
+    region = regions.list[0];
+    ret = TMR_paramSet(rp, TMR_PARAM_REGION_ID, &region);
+    checkerr(rp, ret, 1, "setting region");
+  }
+
+  model.value = str;
+  model.max = 64;
+  TMR_paramGet(rp, TMR_PARAM_VERSION_MODEL, &model);
+  if (((0 == strcmp("M6e Micro", model.value)) ||(0 == strcmp("M6e Nano", model.value)))
+    && (NULL == antennaList))
+  {
+    fprintf(stdout, "Module doesn't has antenna detection support please provide antenna list\n");
+    usage();
+  }
+
+  ret = TMR_RP_init_simple(&plan, antennaCount, antennaList, TMR_TAG_PROTOCOL_GEN2, 1000);
+  checkerr(rp, ret, 1, "initializing the  read plan");
+  ret = TMR_paramSet(rp, TMR_PARAM_READ_PLAN, &plan);
+  checkerr(rp, ret, 1, "setting read plan");
+
+  rlb.listener = callback;
+  rlb.cookie = &stats;
+  reb.listener = exceptionCallback;
+  reb.cookie = NULL;
+
+  ret = TMR_addReadListener(rp, &rlb);
+  checkerr(rp, ret, 1, "adding read listener");
+
+  ret = TMR_addReadExceptionListener(rp, &reb);
+  checkerr(rp, ret, 1, "adding exception listener");
+
+  ret = TMR_startReading(rp);
+  checkerr(rp, ret, 1, "starting reading");
+
+  tmr_sleep(durationMs);
+
+  ret = TMR_stopReading(rp);
+  checkerr(rp, ret, 1, "stopping reading");
+
+  store->stop = true;
+  pthread_join(updaterTid, NULL);
+  if (NULL != socketPath)
+  {
+    pthread_join(socketTid, NULL);
+    close(sock.fd);
+    unlink(socketPath);
+  }
+  if (NULL != tail.path)
+  {
+    pthread_join(tailTid, NULL);
+  }
+
+  printf("\n%" PRIu64 " reads, %" PRIu64 " whitelisted, last seen generation %" PRIu64 "\n",
+         stats.reads, stats.listed, stats.lastGeneration);
+  printf("%" PRIu64 " changes applied (%" PRIu64 " dropped), %" PRIu64 " generations published, %"
+         PRIu64 " compactions, %" PRIu64 " generations reclaimed\n",
+         store->applied, store->dropped, store->published, store->compactions, store->reclaimed);
+
+  TMR_destroy(rp);
+
+  /* No readers are left, everything can go */
+  while (NULL != (g = store->retired))
+  {
+    store->retired = g->nextRetired;
+    freeGeneration(g);
+  }
+  freeGeneration(store->current);
+  pthread_mutex_destroy(&store->pendingLock);
+  free(store->pending);
+  free(store);
+  return 0;
+
+#endif /* TMR_ENABLE_BACKGROUND_READS */
+}